@@ -0,0 +1,453 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+// Heap allocation tracking. With CG_ALLOC_TRACKING defined, the global operator new/delete are replaced (in
+// the one source file that defines ALLOC_TRACKER_IMPLEMENTATION before including this header) by versions
+// that count every allocation and its size, charge it to the innermost zone open on the allocating thread
+// (PROFILE_ZONE opens one, with or without the profiler) and, when sampling, record the call stack of every
+// Nth allocation. endFrame() turns the running counters into what a frame allocated and flags the frames
+// that allocated more often than the limit.
+//
+// Only operator new/delete are counted; memory taken with malloc directly (C libraries, drivers) is not.
+// Without CG_ALLOC_TRACKING nothing is replaced and the macros expand to nothing.
+
+#include <string>
+
+// Allocations charged to one zone, or one sampled call stack, over a whole run.
+struct AllocationSite {
+    std::string name;
+    unsigned long long count;	// allocations, or samples for a call stack
+    unsigned long long bytes;
+};
+
+#ifdef CG_ALLOC_TRACKING
+
+#include <atomic>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#ifdef __GLIBC__
+#include <execinfo.h>
+#include <cxxabi.h>
+#endif
+
+// What was allocated, by any thread, between two frame ends.
+struct AllocFrame {
+    unsigned long long count;
+    unsigned long long bytes;
+    unsigned long long frees;
+};
+
+class AllocTracker
+{
+public:
+    static const unsigned int MAX_ZONES = 256;		// distinct zone names; allocations in further zones go unzoned
+    static const unsigned int STACK_DEPTH = 16;
+    static const unsigned int MAX_SAMPLES = 4096;	// ring of sampled call stacks, the oldest are overwritten
+
+    unsigned long long limit;		// allocations per frame above which a frame fails, 0 for no limit
+    unsigned int sampleInterval;	// every Nth allocation of a thread has its call stack recorded, 0 for none
+    unsigned int failedFrames;
+
+    static AllocTracker &instance()
+    {
+        static AllocTracker tracker;
+        return tracker;
+    }
+
+    // the innermost zone open on the calling thread, NULL outside of zones
+    static const char *&currentZone()
+    {
+        static thread_local const char *zone = NULL;
+        return zone;
+    }
+
+    // called by operator new for every allocation
+    void allocated(std::size_t size)
+    {
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        ZoneCounters &zone = zones[slot(currentZone())];
+        zone.count.fetch_add(1, std::memory_order_relaxed);
+        zone.bytes.fetch_add(size, std::memory_order_relaxed);
+        if(sampleInterval > 0)
+        {
+            static thread_local unsigned int tick = 0;
+            static thread_local bool sampling = false;
+            // backtrace() may allocate the first time it runs, which must not sample again
+            if(++tick >= sampleInterval && !sampling)
+            {
+                tick = 0;
+                sampling = true;
+                sample(size);
+                sampling = false;
+            }
+        }
+    }
+
+    void freed()
+    {
+        frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // starts counting frames; whatever was allocated before (loading, start up) is left out of the run totals
+    void beginFrames()
+    {
+        frameCount = count.load(std::memory_order_relaxed);
+        frameBytes = bytes.load(std::memory_order_relaxed);
+        frameFrees = frees.load(std::memory_order_relaxed);
+        for(unsigned int i = 0; i < MAX_ZONES; i++)
+        {
+            zoneFrameCount[i] = zoneRunCount[i] = zones[i].count.load(std::memory_order_relaxed);
+            zoneRunBytes[i] = zones[i].bytes.load(std::memory_order_relaxed);
+        }
+        runCount = runBytes = worstCount = 0;
+        frames = worstFrame = failedFrames = 0;
+    }
+
+    // what was allocated since the previous frame end; a frame over the limit is reported with its zones
+    AllocFrame endFrame()
+    {
+        AllocFrame frame;
+        unsigned long long c = count.load(std::memory_order_relaxed);
+        unsigned long long b = bytes.load(std::memory_order_relaxed);
+        unsigned long long f = frees.load(std::memory_order_relaxed);
+        frame.count = c - frameCount;
+        frame.bytes = b - frameBytes;
+        frame.frees = f - frameFrees;
+        frameCount = c;
+        frameBytes = b;
+        frameFrees = f;
+        frames++;
+        runCount += frame.count;
+        runBytes += frame.bytes;
+        if(frame.count > worstCount)
+        {
+            worstCount = frame.count;
+            worstFrame = frames;
+        }
+
+        // the zones that allocated the most this frame, kept in a fixed array so reporting doesn't allocate
+        const unsigned int TOP = 5;
+        unsigned int top[TOP];
+        unsigned long long topCount[TOP];
+        unsigned int found = 0;
+        for(unsigned int i = 0; i < MAX_ZONES; i++)
+        {
+            unsigned long long now = zones[i].count.load(std::memory_order_relaxed);
+            unsigned long long delta = now - zoneFrameCount[i];
+            zoneFrameCount[i] = now;
+            if(delta == 0 || (found == TOP && delta <= topCount[TOP - 1]))
+                continue;
+            unsigned int j = found < TOP ? found++ : TOP - 1;
+            while(j > 0 && topCount[j - 1] < delta)
+            {
+                top[j] = top[j - 1];
+                topCount[j] = topCount[j - 1];
+                j--;
+            }
+            top[j] = i;
+            topCount[j] = delta;
+        }
+        if(limit > 0 && frame.count > limit)
+        {
+            failedFrames++;
+            printf("ERROR::ALLOC:: frame %llu made %llu allocations (%llu bytes), over the limit of %llu:", frames,
+                   frame.count, frame.bytes, limit);
+            for(unsigned int i = 0; i < found; i++)
+                printf(" %s %llu%s", zoneName(top[i]), topCount[i], i + 1 < found ? "," : "\n");
+        }
+        return frame;
+    }
+
+    // allocations per zone since beginFrames(), zones of the same name merged, the most bytes first
+    std::vector<AllocationSite> zoneTotals() const
+    {
+        std::vector<AllocationSite> sites;
+        for(unsigned int i = 0; i < MAX_ZONES; i++)
+        {
+            unsigned long long c = zones[i].count.load(std::memory_order_relaxed) - zoneRunCount[i];
+            unsigned long long b = zones[i].bytes.load(std::memory_order_relaxed) - zoneRunBytes[i];
+            if(c == 0)
+                continue;
+            unsigned int j = 0;
+            while(j < sites.size() && sites[j].name != zoneName(i))
+                j++;
+            if(j == sites.size())
+            {
+                AllocationSite site = { zoneName(i), 0, 0 };
+                sites.push_back(site);
+            }
+            sites[j].count += c;
+            sites[j].bytes += b;
+        }
+        std::sort(sites.begin(), sites.end(), moreBytes);
+        return sites;
+    }
+
+    // the `top` call stacks sampled most often, innermost function first; empty where backtrace() isn't available
+    std::vector<AllocationSite> sampledStacks(unsigned int top) const
+    {
+        std::vector<AllocationSite> sites;
+#ifdef __GLIBC__
+        unsigned int n = (unsigned int)std::min<unsigned long long>(nextSample.load(std::memory_order_acquire), MAX_SAMPLES);
+        std::vector<const Sample*> sorted(n);
+        for(unsigned int i = 0; i < n; i++)
+            sorted[i] = &samples[i];
+        std::sort(sorted.begin(), sorted.end(), stackLess);
+
+        std::vector<const Sample*> stacks;
+        std::vector<AllocationSite> counts;
+        for(unsigned int i = 0; i < n; i++)
+        {
+            if(stacks.empty() || stackLess(stacks.back(), sorted[i]))
+            {
+                stacks.push_back(sorted[i]);
+                AllocationSite site = { "", 0, 0 };
+                counts.push_back(site);
+            }
+            counts.back().count++;
+            counts.back().bytes += sorted[i]->size;
+        }
+        std::vector<unsigned int> order(stacks.size());
+        for(unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return counts[a].count > counts[b].count; });
+        for(unsigned int i = 0; i < order.size() && i < top; i++)
+        {
+            AllocationSite site = counts[order[i]];
+            site.name = symbolize(*stacks[order[i]]);
+            sites.push_back(site);
+        }
+#endif
+        return sites;
+    }
+
+    // one line per run for the console, with the zones that allocated the most bytes
+    void printSummary() const
+    {
+        if(frames == 0)
+            return;
+        printf(" Allocations: %.1f per frame (%.1f KB), worst %llu in frame %llu", (double)runCount / frames,
+               runBytes / 1024.0 / frames, worstCount, worstFrame);
+        if(limit > 0)
+            printf(", %u frames over the limit of %llu", failedFrames, limit);
+        std::vector<AllocationSite> sites = zoneTotals();
+        for(unsigned int i = 0; i < sites.size() && i < 5; i++)
+            printf("%s %s %.1f (%.1f KB)", i == 0 ? "; per frame by zone:" : ",", sites[i].name.c_str(),
+                   (double)sites[i].count / frames, sites[i].bytes / 1024.0 / frames);
+        printf("\n");
+    }
+
+private:
+    struct ZoneCounters {
+        std::atomic<const char*> name;	// string literal, compared by address
+        std::atomic<unsigned long long> count;
+        std::atomic<unsigned long long> bytes;
+    };
+
+    struct Sample {
+        void *frames[STACK_DEPTH];
+        unsigned int depth;
+        std::size_t size;
+    };
+
+    std::atomic<unsigned long long> count, bytes, frees;
+    ZoneCounters zones[MAX_ZONES];	// slot 0 holds the allocations made outside of any zone
+    Sample samples[MAX_SAMPLES];
+    std::atomic<unsigned long long> nextSample;
+
+    // frame and run bookkeeping, only touched by the thread that ends frames
+    unsigned long long frameCount, frameBytes, frameFrees;
+    unsigned long long zoneFrameCount[MAX_ZONES], zoneRunCount[MAX_ZONES], zoneRunBytes[MAX_ZONES];
+    unsigned long long runCount, runBytes, worstCount, frames, worstFrame;
+
+    AllocTracker() : limit(0), sampleInterval(0), failedFrames(0), count(0), bytes(0), frees(0), nextSample(0)
+    {
+        for(unsigned int i = 0; i < MAX_ZONES; i++)
+        {
+            zones[i].name.store(NULL, std::memory_order_relaxed);
+            zones[i].count.store(0, std::memory_order_relaxed);
+            zones[i].bytes.store(0, std::memory_order_relaxed);
+        }
+        beginFrames();
+    }
+
+    // the slot of a zone name: an open addressed table that only ever grows, so lookups need no lock
+    unsigned int slot(const char *name)
+    {
+        if(name == NULL)
+            return 0;
+        unsigned int i = (unsigned int)(((std::uintptr_t)name >> 3) * 2654435761u) % (MAX_ZONES - 1) + 1;
+        for(unsigned int probe = 1; probe < MAX_ZONES; probe++)
+        {
+            const char *key = zones[i].name.load(std::memory_order_acquire);
+            if(key == NULL && zones[i].name.compare_exchange_strong(key, name, std::memory_order_acq_rel))
+                return i;
+            if(key == name)
+                return i;
+            i = i % (MAX_ZONES - 1) + 1;
+        }
+        return 0;
+    }
+
+    const char *zoneName(unsigned int slot) const
+    {
+        return slot == 0 ? "(no zone)" : zones[slot].name.load(std::memory_order_relaxed);
+    }
+
+    void sample(std::size_t size)
+    {
+#ifdef __GLIBC__
+        Sample &s = samples[nextSample.fetch_add(1, std::memory_order_acq_rel) % MAX_SAMPLES];
+        s.depth = backtrace(s.frames, STACK_DEPTH);
+        s.size = size;
+#else
+        (void)size;
+#endif
+    }
+
+#ifdef __GLIBC__
+    static bool stackLess(const Sample *a, const Sample *b)
+    {
+        if(a->depth != b->depth)
+            return a->depth < b->depth;
+        return memcmp(a->frames, b->frames, a->depth * sizeof(void*)) < 0;
+    }
+
+    // function names of a stack, demangled, without the frames of the tracker and operator new themselves;
+    // functions that aren't exported (link with -rdynamic) show as addresses
+    static std::string symbolize(const Sample &s)
+    {
+        std::string stack;
+        char **symbols = backtrace_symbols(s.frames, s.depth);
+        if(symbols == NULL)
+            return stack;
+        for(unsigned int i = 0; i < s.depth; i++)
+        {
+            std::string symbol = symbols[i];
+            std::size_t open = symbol.find('('), plus = symbol.find('+', open);
+            if(open != std::string::npos && plus != std::string::npos && plus > open + 1)
+            {
+                std::string mangled = symbol.substr(open + 1, plus - open - 1);
+                int status = 0;
+                char *name = abi::__cxa_demangle(mangled.c_str(), NULL, NULL, &status);
+                symbol = status == 0 && name ? name : mangled;
+                free(name);
+            }
+            if(stack.empty() && (symbol.find("AllocTracker") != std::string::npos || symbol.find("operator new") != std::string::npos))
+                continue;
+            if(symbol.size() > 120)
+                symbol = symbol.substr(0, 117) + "...";
+            stack += (stack.empty() ? "" : " <- ") + symbol;
+        }
+        free(symbols);
+        return stack;
+    }
+#endif
+
+    static bool moreBytes(const AllocationSite &a, const AllocationSite &b)
+    {
+        return a.bytes > b.bytes;
+    }
+};
+
+// RAII zone: charges the allocations the calling thread makes until it goes out of scope to `name`.
+class AllocZone
+{
+public:
+    AllocZone(const char *name) : previous(AllocTracker::currentZone())
+    {
+        AllocTracker::currentZone() = name;
+    }
+
+    ~AllocZone()
+    {
+        AllocTracker::currentZone() = previous;
+    }
+
+private:
+    const char *previous;
+};
+
+#define ALLOC_SET_LIMIT(allocations) (AllocTracker::instance().limit = (allocations))
+#define ALLOC_SET_SAMPLE_INTERVAL(interval) (AllocTracker::instance().sampleInterval = (interval))
+#define ALLOC_BEGIN_FRAMES() AllocTracker::instance().beginFrames()
+
+// the replaced operators; they must be defined in exactly one source file of the program
+#ifdef ALLOC_TRACKER_IMPLEMENTATION
+void *operator new(std::size_t size)
+{
+    void *p = malloc(size > 0 ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    AllocTracker::instance().allocated(size);
+    return p;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    void *p = malloc(size > 0 ? size : 1);
+    if(p != NULL)
+        AllocTracker::instance().allocated(size);
+    return p;
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept
+{
+    if(p == NULL)
+        return;
+    AllocTracker::instance().freed();
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    operator delete(p);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    operator delete(p);
+}
+#endif
+#endif
+
+#else
+
+#define ALLOC_SET_LIMIT(allocations)
+#define ALLOC_SET_SAMPLE_INTERVAL(interval)
+#define ALLOC_BEGIN_FRAMES()
+
+#endif
+#endif
@@ -0,0 +1,683 @@
+#ifndef ANIMATION_CLIP_H
+#define ANIMATION_CLIP_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/entity_store.h>
+#include <learnopengl/transform_store.h>
+#include <learnopengl/spline_path.h>
+#include <learnopengl/float4.h>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+using namespace std;
+
+enum TrackChannel {
+    CHANNEL_TRANSLATION,
+    CHANNEL_ROTATION,
+    CHANNEL_SCALE
+};
+
+enum TrackInterpolation {
+    INTERPOLATION_LINEAR,
+    INTERPOLATION_CUBIC		// Catmull-Rom through the keys; rotations use squad, its counterpart on quaternions
+};
+
+// A node the clip animates; playing the clip creates one instance per node.
+struct ClipNode {
+    string name;
+    int obj;		// model drawn by the node, -1 for a group
+    int parent;		// index of the parent node, -1 for a root
+    TransformComponents pose;
+};
+
+// Keys of one channel of one node. Values are vec4s so both kinds of channel share the layout; rotations
+// are (x, y, z, w), translations and scales leave w at 0. Two keys at the same time make a jump.
+struct ClipTrack {
+    int node;
+    TrackChannel channel;
+    TrackInterpolation interpolation;
+    vector<float> times;
+    vector<glm::vec4> values;
+    vector<glm::vec4> controls;	// cubic rotations: squad's inner quaternion of every key, set up by load()
+};
+
+// A node whose position travels along a spline at constant speed, from the start of the clip to its end.
+struct ClipPath {
+    int node;
+    SplinePath path;
+};
+
+// A marker that fires when playback passes its time, e.g. "model planet 4" to swap a node's model.
+struct ClipEvent {
+    float time;
+    string name;
+    vector<string> args;
+};
+
+// A keyframe clip. The file is line based, '#' starts a comment:
+//
+//   duration 10                                  length in seconds
+//   loop                                         start over instead of ending
+//   node <name> <obj> <parent>                   node to create, obj -1 for a group, parent '-' for a root
+//   pose <node> px py pz  rw rx ry rz  sx sy sz  initial local transform
+//   track <node> translation|rotation|scale linear|cubic    cubic rotations are squad, C1 through the keys
+//   key <time> x y z                             key of the last track (rotations: key <time> w x y z)
+//   path <node> catmull-rom|bezier|bspline       the node travels along a spline over the whole clip
+//   point x y z                                  point of the last path
+//   event <time> <name> [args...]
+class AnimationClip
+{
+public:
+    string path;
+    float duration;
+    bool loop;
+    vector<ClipNode> nodes;
+    vector<ClipTrack> tracks;
+    vector<ClipPath> paths;
+    vector<ClipEvent> events;
+
+    AnimationClip() : duration(0.0f), loop(false) {}
+
+    bool load(const string &path)
+    {
+        this->path = path;
+        ifstream file(path.c_str());
+        if(!file)
+        {
+            cout << "ERROR::CLIP:: Could not open animation clip " << path << endl;
+            return false;
+        }
+        string line;
+        int lineNr = 0;
+        while(getline(file, line))
+        {
+            lineNr++;
+            line = line.substr(0, line.find('#'));
+            istringstream in(line);
+            string keyword;
+            if(!(in >> keyword))
+                continue;
+
+            bool ok = true;
+            if(keyword == "duration")
+                ok = (bool)(in >> duration);
+            else if(keyword == "loop")
+                loop = true;
+            else if(keyword == "node")
+            {
+                ClipNode node;
+                string parent;
+                ok = (bool)(in >> node.name >> node.obj >> parent);
+                node.parent = parent == "-" ? -1 : findNode(parent);
+                ok = ok && (parent == "-" || node.parent >= 0);
+                node.pose.position = glm::vec3(0.0f);
+                node.pose.rotation = glm::quat();
+                node.pose.scale = glm::vec3(1.0f);
+                Shear none = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+                node.pose.shear = none;
+                nodes.push_back(node);
+            }
+            else if(keyword == "pose")
+            {
+                string name;
+                TransformComponents pose;
+                ok = (in >> name) && (in >> pose.position.x >> pose.position.y >> pose.position.z
+                                         >> pose.rotation.w >> pose.rotation.x >> pose.rotation.y >> pose.rotation.z
+                                         >> pose.scale.x >> pose.scale.y >> pose.scale.z);
+                int node = findNode(name);
+                ok = ok && node >= 0;
+                if(ok)
+                {
+                    pose.shear = nodes[node].pose.shear;
+                    nodes[node].pose = pose;
+                }
+            }
+            else if(keyword == "track")
+            {
+                ClipTrack track;
+                string name, channel, interpolation;
+                ok = (bool)(in >> name >> channel >> interpolation);
+                track.node = findNode(name);
+                track.channel = channel == "rotation" ? CHANNEL_ROTATION : channel == "scale" ? CHANNEL_SCALE : CHANNEL_TRANSLATION;
+                track.interpolation = interpolation == "cubic" ? INTERPOLATION_CUBIC : INTERPOLATION_LINEAR;
+                ok = ok && track.node >= 0 && (channel == "translation" || channel == "rotation" || channel == "scale")
+                        && (interpolation == "linear" || interpolation == "cubic");
+                tracks.push_back(track);
+            }
+            else if(keyword == "key")
+            {
+                float time;
+                glm::vec4 value(0.0f);
+                ok = !tracks.empty() && (in >> time);
+                if(ok && tracks.back().channel == CHANNEL_ROTATION)
+                    ok = (bool)(in >> value.w >> value.x >> value.y >> value.z);
+                else if(ok)
+                    ok = (bool)(in >> value.x >> value.y >> value.z);
+                ok = ok && (tracks.back().times.empty() || time >= tracks.back().times.back());
+                if(ok)
+                {
+                    tracks.back().times.push_back(time);
+                    tracks.back().values.push_back(value);
+                }
+            }
+            else if(keyword == "path")
+            {
+                ClipPath path;
+                string name, kind;
+                ok = (bool)(in >> name >> kind);
+                path.node = findNode(name);
+                path.path.setKind(kind == "bezier" ? SPLINE_BEZIER : kind == "bspline" ? SPLINE_BSPLINE : SPLINE_CATMULL_ROM);
+                ok = ok && path.node >= 0 && (kind == "catmull-rom" || kind == "bezier" || kind == "bspline");
+                paths.push_back(path);
+            }
+            else if(keyword == "point")
+            {
+                glm::vec3 point;
+                ok = !paths.empty() && (in >> point.x >> point.y >> point.z);
+                if(ok)
+                    paths.back().path.addPoint(point);
+            }
+            else if(keyword == "event")
+            {
+                ClipEvent event;
+                ok = (bool)(in >> event.time >> event.name);
+                string arg;
+                while(in >> arg)
+                    event.args.push_back(arg);
+                events.push_back(event);
+            }
+            else
+                ok = false;
+
+            if(!ok)
+            {
+                cout << "ERROR::CLIP:: " << path << ":" << lineNr << ": could not parse '" << line << "'" << endl;
+                return false;
+            }
+        }
+        for(unsigned int i = 0; i < tracks.size(); i++)
+            if(tracks[i].times.empty())
+            {
+                cout << "ERROR::CLIP:: " << path << ": a track of " << nodes[tracks[i].node].name << " has no keys" << endl;
+                return false;
+            }
+        for(unsigned int i = 0; i < tracks.size(); i++)
+            if(tracks[i].channel == CHANNEL_ROTATION && tracks[i].interpolation == INTERPOLATION_CUBIC)
+                squadControls(tracks[i]);
+        for(unsigned int i = 0; i < paths.size(); i++)
+        {
+            if(paths[i].path.segments() == 0)
+            {
+                cout << "ERROR::CLIP:: " << path << ": the path of " << nodes[paths[i].node].name << " has too few points" << endl;
+                return false;
+            }
+            paths[i].path.update();
+        }
+        return true;
+    }
+
+    int findNode(const string &name) const
+    {
+        for(unsigned int i = 0; i < nodes.size(); i++)
+            if(nodes[i].name == name)
+                return i;
+        return -1;
+    }
+
+private:
+    // squad (Shoemake) between keys q1 and q2 is slerp(slerp(q1, q2, t), slerp(s1, s2, t), 2t(1 - t)), where
+    // each key's s = q exp(-(log(q^-1 next) + log(q^-1 previous)) / 4) makes the curve's tangent at the key
+    // the Catmull-Rom one; the ends use their own key as the missing neighbour
+    static void squadControls(ClipTrack &track)
+    {
+        unsigned int n = track.values.size();
+        track.controls.resize(n);
+        for(unsigned int i = 0; i < n; i++)
+        {
+            glm::quat q = toQuat(track.values[i]);
+            glm::quat previous = toQuat(track.values[i > 0 ? i - 1 : i]), next = toQuat(track.values[i + 1 < n ? i + 1 : i]);
+            // neighbours on q's side of the sphere, so the logs take the short way
+            if(glm::dot(q, previous) < 0.0f)
+                previous = -previous;
+            if(glm::dot(q, next) < 0.0f)
+                next = -next;
+            glm::quat inverse = glm::conjugate(q);
+            glm::vec3 tangent = -(logarithm(inverse * next) + logarithm(inverse * previous)) * 0.25f;
+            glm::quat s = q * exponential(tangent);
+            track.controls[i] = glm::vec4(s.x, s.y, s.z, s.w);
+        }
+    }
+
+    static glm::quat toQuat(const glm::vec4 &v)
+    {
+        return glm::normalize(glm::quat(v.w, v.x, v.y, v.z));
+    }
+
+    // of a unit quaternion: the rotation axis times half the angle
+    static glm::vec3 logarithm(const glm::quat &q)
+    {
+        glm::vec3 v(q.x, q.y, q.z);
+        float length = glm::length(v);
+        return length > 1e-6f ? v * (atan2(length, q.w) / length) : v;
+    }
+
+    static glm::quat exponential(const glm::vec3 &v)
+    {
+        float angle = glm::length(v);
+        glm::vec3 axis = angle > 1e-6f ? v * (sin(angle) / angle) : v;
+        return glm::quat(cos(angle), axis.x, axis.y, axis.z);
+    }
+};
+
+// A clip being played on a set of instances, one per clip node.
+struct ClipInstance {
+    const AnimationClip *clip;
+    vector<Entity> nodes;
+    vector<unsigned int> cursor;	// per track, the key segment found last time
+    float time;
+    float speed;
+    bool started;					// updated at least once, so markers at its start time have fired
+    bool finished;
+};
+
+// An event marker passed during an update.
+struct FiredClipEvent {
+    unsigned int instance;
+    const ClipEvent *event;
+};
+
+// Plays any number of clips at once. update() advances every instance, fires the markers it passes and
+// writes the evaluated channels into the transform store. Evaluation is done in two passes: the first finds
+// each track's key segment and gathers the keys into flat structure-of-arrays batches (one for vec3s, one for
+// rotations), the second interpolates whole batches four samples at a time with Float4 (SSE when available),
+// finishing the last few with the same code on plain floats. Rotations use a polynomial slerp (Eberly, "A
+// Fast and Accurate Algorithm for Computing SLERP") so they need no trigonometry either.
+class Animator
+{
+public:
+    vector<ClipInstance> instances;
+
+    // starts a clip on instances already created for its nodes; returns the instance id.
+    unsigned int play(const AnimationClip *clip, const vector<Entity> &nodes, float speed = 1.0f)
+    {
+        ClipInstance instance;
+        instance.clip = clip;
+        instance.nodes = nodes;
+        instance.cursor.assign(clip->tracks.size(), 0);
+        instance.time = 0.0f;
+        instance.speed = speed;
+        instance.started = false;
+        instance.finished = false;
+        // reuse the place of a finished instance so ids stay small
+        for(unsigned int i = 0; i < instances.size(); i++)
+            if(instances[i].finished)
+            {
+                instances[i] = instance;
+                return i;
+            }
+        instances.push_back(instance);
+        return instances.size() - 1;
+    }
+
+    void stop(unsigned int instance) { instances[instance].finished = true; }
+
+    unsigned int playing() const
+    {
+        unsigned int n = 0;
+        for(unsigned int i = 0; i < instances.size(); i++)
+            n += !instances[i].finished;
+        return n;
+    }
+
+    // advances every instance by `delta` seconds. Markers passed go to `events`; the instances that reached
+    // the end of a non looping clip are reported in `ended` (their nodes are left for the caller to remove).
+    void update(float delta, const EntityStore &entities, TransformStore &transforms,
+                vector<FiredClipEvent> *events = NULL, vector<unsigned int> *ended = NULL)
+    {
+        vec3Batch.clear();
+        quatBatch.clear();
+        for(unsigned int i = 0; i < instances.size(); i++)
+        {
+            ClipInstance &instance = instances[i];
+            if(instance.finished)
+                continue;
+            const AnimationClip &clip = *instance.clip;
+            float from = instance.time;
+            float to = from + delta * instance.speed;
+            bool end = !clip.loop && to >= clip.duration;
+            if(end)
+                to = clip.duration;
+
+            // the first update also fires the markers right at the start time, e.g. at 0
+            if(events)
+                fireEvents(i, clip, from, to, !instance.started, events);
+            instance.started = true;
+            if(clip.loop && clip.duration > 0.0f && to >= clip.duration)
+            {
+                to = fmod(to, clip.duration);
+                if(events)
+                    fireEvents(i, clip, 0.0f, to, true, events);
+                instance.cursor.assign(clip.tracks.size(), 0);
+            }
+            instance.time = to;
+            gather(instance, entities);
+
+            if(end)
+            {
+                instance.finished = true;
+                if(ended)
+                    ended->push_back(i);
+            }
+        }
+        vec3Batch.evaluate();
+        quatBatch.evaluate();
+        vec3Batch.scatter(transforms);
+        quatBatch.scatter(transforms);
+    }
+
+    // interpolates between keys the way the batches do, one value at a time
+    static glm::vec4 sample(const ClipTrack &track, float time)
+    {
+        unsigned int cursor = 0;
+        unsigned int k[4];
+        float t = segment(track, time, cursor, k);
+        Vec3Batch vec;
+        QuatBatch quat;
+        if(track.channel == CHANNEL_ROTATION)
+        {
+            quat.add(track, k, t, 0, CHANNEL_ROTATION);
+            quat.evaluate();
+            return glm::vec4(quat.rx[0], quat.ry[0], quat.rz[0], quat.rw[0]);
+        }
+        vec.add(track, k, t, 0, track.channel);
+        vec.evaluate();
+        return glm::vec4(vec.rx[0], vec.ry[0], vec.rz[0], 0.0f);
+    }
+
+private:
+    // weighted sums of four vec3s per sample over three component streams: Catmull-Rom or linear between
+    // keys (with the weights of the outer keys 0 for linear), or a path segment's polynomial.
+    struct Vec3Batch {
+        vector<float> x[4], y[4], z[4], w[4];
+        vector<float> rx, ry, rz;
+        vector<unsigned int> target;
+        vector<unsigned char> channel;
+
+        void clear()
+        {
+            for(int j = 0; j < 4; j++)
+            {
+                x[j].clear(); y[j].clear(); z[j].clear(); w[j].clear();
+            }
+            target.clear();
+            channel.clear();
+        }
+
+        void add(const ClipTrack &track, const unsigned int k[4], float t, unsigned int dense, TrackChannel ch)
+        {
+            float c[4];
+            weights(track.interpolation, t, c);
+            for(int j = 0; j < 4; j++)
+            {
+                const glm::vec4 &v = track.values[k[j]];
+                x[j].push_back(v.x);
+                y[j].push_back(v.y);
+                z[j].push_back(v.z);
+                w[j].push_back(c[j]);
+            }
+            target.push_back(dense);
+            channel.push_back(ch);
+        }
+
+        // a spline segment in power basis: the weights are s^3, s^2, s and 1
+        void addPolynomial(const glm::vec3 c[4], float s, unsigned int dense)
+        {
+            float power[4] = { s * s * s, s * s, s, 1.0f };
+            for(int j = 0; j < 4; j++)
+            {
+                x[j].push_back(c[j].x);
+                y[j].push_back(c[j].y);
+                z[j].push_back(c[j].z);
+                w[j].push_back(power[j]);
+            }
+            target.push_back(dense);
+            channel.push_back(CHANNEL_TRANSLATION);
+        }
+
+        void evaluate()
+        {
+            unsigned int n = target.size();
+            rx.resize(n); ry.resize(n); rz.resize(n);
+            const float *x0 = n ? &x[0][0] : NULL, *x1 = n ? &x[1][0] : NULL, *x2 = n ? &x[2][0] : NULL, *x3 = n ? &x[3][0] : NULL;
+            const float *y0 = n ? &y[0][0] : NULL, *y1 = n ? &y[1][0] : NULL, *y2 = n ? &y[2][0] : NULL, *y3 = n ? &y[3][0] : NULL;
+            const float *z0 = n ? &z[0][0] : NULL, *z1 = n ? &z[1][0] : NULL, *z2 = n ? &z[2][0] : NULL, *z3 = n ? &z[3][0] : NULL;
+            const float *w0 = n ? &w[0][0] : NULL, *w1 = n ? &w[1][0] : NULL, *w2 = n ? &w[2][0] : NULL, *w3 = n ? &w[3][0] : NULL;
+            float *ox = n ? &rx[0] : NULL, *oy = n ? &ry[0] : NULL, *oz = n ? &rz[0] : NULL;
+            unsigned int i = 0;
+            for(; i + 4 <= n; i += 4)
+            {
+                Float4 c0 = loadFloat4(w0 + i), c1 = loadFloat4(w1 + i), c2 = loadFloat4(w2 + i), c3 = loadFloat4(w3 + i);
+                storeFloat4(ox + i, c0 * loadFloat4(x0 + i) + c1 * loadFloat4(x1 + i) + c2 * loadFloat4(x2 + i) + c3 * loadFloat4(x3 + i));
+                storeFloat4(oy + i, c0 * loadFloat4(y0 + i) + c1 * loadFloat4(y1 + i) + c2 * loadFloat4(y2 + i) + c3 * loadFloat4(y3 + i));
+                storeFloat4(oz + i, c0 * loadFloat4(z0 + i) + c1 * loadFloat4(z1 + i) + c2 * loadFloat4(z2 + i) + c3 * loadFloat4(z3 + i));
+            }
+            for(; i < n; i++)
+            {
+                ox[i] = w0[i] * x0[i] + w1[i] * x1[i] + w2[i] * x2[i] + w3[i] * x3[i];
+                oy[i] = w0[i] * y0[i] + w1[i] * y1[i] + w2[i] * y2[i] + w3[i] * y3[i];
+                oz[i] = w0[i] * z0[i] + w1[i] * z1[i] + w2[i] * z2[i] + w3[i] * z3[i];
+            }
+        }
+
+        void scatter(TransformStore &transforms) const
+        {
+            for(unsigned int i = 0; i < target.size(); i++)
+            {
+                glm::vec3 v(rx[i], ry[i], rz[i]);
+                if(channel[i] == CHANNEL_SCALE)
+                    transforms.setScale(target[i], v);
+                else
+                    transforms.setPosition(target[i], v);
+            }
+        }
+    };
+
+    // slerp between the two inner keys, or squad for cubic tracks: the slerp of the keys and the slerp of
+    // their controls (see AnimationClip::squadControls) blended by a third slerp with parameter h = 2t(1 - t).
+    // Linear tracks use the keys as their controls, which makes the outer slerp return the inner one.
+    struct QuatBatch {
+        vector<float> q[4][4];		// per component x, y, z, w: key a, key b, control of a, control of b
+        vector<float> t, h;
+        vector<float> rx, ry, rz, rw;
+        vector<unsigned int> target;
+
+        void clear()
+        {
+            for(int j = 0; j < 4; j++)
+                for(int c = 0; c < 4; c++)
+                    q[j][c].clear();
+            t.clear();
+            h.clear();
+            target.clear();
+        }
+
+        void add(const ClipTrack &track, const unsigned int k[4], float s, unsigned int dense, TrackChannel)
+        {
+            bool cubic = track.interpolation == INTERPOLATION_CUBIC;
+            glm::vec4 a = track.values[k[1]], b = track.values[k[2]];
+            glm::vec4 ca = cubic ? track.controls[k[1]] : a, cb = cubic ? track.controls[k[2]] : b;
+            // b on a's side, and its control with it
+            if(glm::dot(a, b) < 0.0f)
+            {
+                b = -b;
+                cb = -cb;
+            }
+            const glm::vec4 *keys[4] = { &a, &b, &ca, &cb };
+            for(int j = 0; j < 4; j++)
+                for(int c = 0; c < 4; c++)
+                    q[j][c].push_back((*keys[j])[c]);
+            t.push_back(s);
+            h.push_back(cubic ? 2.0f * s * (1.0f - s) : 0.0f);
+            target.push_back(dense);
+        }
+
+        void evaluate()
+        {
+            unsigned int n = target.size();
+            rx.resize(n); ry.resize(n); rz.resize(n); rw.resize(n);
+            unsigned int i = 0;
+            for(; i + 4 <= n; i += 4)
+            {
+                Float4 a[4], b[4], ca[4], cb[4], p[4], r[4], out[4];
+                for(int c = 0; c < 4; c++)
+                {
+                    a[c] = loadFloat4(&q[0][c][i]); b[c] = loadFloat4(&q[1][c][i]);
+                    ca[c] = loadFloat4(&q[2][c][i]); cb[c] = loadFloat4(&q[3][c][i]);
+                }
+                Float4 s = loadFloat4(&t[i]);
+                slerp(a, b, s, p);
+                slerp(ca, cb, s, r);
+                slerp(p, r, loadFloat4(&h[i]), out);
+                storeFloat4(&rx[i], out[0]); storeFloat4(&ry[i], out[1]); storeFloat4(&rz[i], out[2]); storeFloat4(&rw[i], out[3]);
+            }
+            for(; i < n; i++)
+            {
+                float a[4], b[4], ca[4], cb[4], p[4], r[4], out[4];
+                for(int c = 0; c < 4; c++)
+                {
+                    a[c] = q[0][c][i]; b[c] = q[1][c][i]; ca[c] = q[2][c][i]; cb[c] = q[3][c][i];
+                }
+                slerp(a, b, t[i], p);
+                slerp(ca, cb, t[i], r);
+                slerp(p, r, h[i], out);
+                rx[i] = out[0]; ry[i] = out[1]; rz[i] = out[2]; rw[i] = out[3];
+            }
+        }
+
+        // polynomial slerp along the shorter arc, of one sample (float) or four (Float4)
+        template<class T>
+        static void slerp(const T a[4], const T b[4], T s, T out[4])
+        {
+            static const float mu = 1.85298109240830f;
+            static const float u[8] = { 1.0f / (1 * 3), 1.0f / (2 * 5), 1.0f / (3 * 7), 1.0f / (4 * 9),
+                                        1.0f / (5 * 11), 1.0f / (6 * 13), 1.0f / (7 * 15), mu / (8 * 17) };
+            static const float v[8] = { 1.0f / 3, 2.0f / 5, 3.0f / 7, 4.0f / 9,
+                                        5.0f / 11, 6.0f / 13, 7.0f / 15, mu * 8 / 17 };
+            T x = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+            T sign = signOf(x);
+            x = x * sign;
+            T xm1 = x - 1.0f;
+            T d = 1.0f - s, sqrT = s * s, sqrD = d * d;
+            T cT = 1.0f, cD = 1.0f;
+            for(int j = 7; j >= 0; j--)
+            {
+                cT = 1.0f + (u[j] * sqrT - v[j]) * xm1 * cT;
+                cD = 1.0f + (u[j] * sqrD - v[j]) * xm1 * cD;
+            }
+            cT = cT * sign * s;
+            cD = cD * d;
+            for(int c = 0; c < 4; c++)
+                out[c] = cD * a[c] + cT * b[c];
+        }
+
+        static float signOf(float x) { return x >= 0.0f ? 1.0f : -1.0f; }
+        static Float4 signOf(Float4 x) { return select(x < Float4(0.0f), Float4(-1.0f), Float4(1.0f)); }
+
+        void scatter(TransformStore &transforms) const
+        {
+            for(unsigned int i = 0; i < target.size(); i++)
+                transforms.setRotation(target[i], glm::normalize(glm::quat(rw[i], rx[i], ry[i], rz[i])));
+        }
+    };
+
+    Vec3Batch vec3Batch;
+    QuatBatch quatBatch;
+
+    // the markers in (from, to], or [from, to] when `inclusive`
+    void fireEvents(unsigned int instance, const AnimationClip &clip, float from, float to, bool inclusive, vector<FiredClipEvent> *events)
+    {
+        for(unsigned int e = 0; e < clip.events.size(); e++)
+        {
+            float time = clip.events[e].time;
+            if((time > from || (inclusive && time == from)) && time <= to)
+            {
+                FiredClipEvent fired = { instance, &clip.events[e] };
+                events->push_back(fired);
+            }
+        }
+    }
+
+    void gather(ClipInstance &instance, const EntityStore &entities)
+    {
+        const AnimationClip &clip = *instance.clip;
+        for(unsigned int i = 0; i < clip.tracks.size(); i++)
+        {
+            const ClipTrack &track = clip.tracks[i];
+            int dense = entities.indexOf(instance.nodes[track.node]);
+            if(dense < 0)
+                continue;	// the node was deleted
+            unsigned int k[4];
+            float t = segment(track, instance.time, instance.cursor[i], k);
+            if(track.channel == CHANNEL_ROTATION)
+                quatBatch.add(track, k, t, dense, CHANNEL_ROTATION);
+            else
+                vec3Batch.add(track, k, t, dense, track.channel);
+        }
+        for(unsigned int i = 0; i < clip.paths.size(); i++)
+        {
+            const SplinePath &path = clip.paths[i].path;
+            int dense = entities.indexOf(instance.nodes[clip.paths[i].node]);
+            if(dense < 0)
+                continue;
+            unsigned int segment;
+            float s;
+            float progress = clip.duration > 0.0f ? instance.time / clip.duration : 1.0f;
+            path.locate(progress * path.length(), segment, s);
+            glm::vec3 coefficients[4];
+            path.coefficients(segment, coefficients);
+            vec3Batch.addPolynomial(coefficients, s, dense);
+        }
+    }
+
+    // finds the keys around `time` (k[1] <= time < k[2], with k[0] and k[3] their outer neighbours) starting
+    // from the last segment found, and returns the position in the segment
+    static float segment(const ClipTrack &track, float time, unsigned int &cursor, unsigned int k[4])
+    {
+        unsigned int last = track.times.size() - 1;
+        if(cursor > last || track.times[cursor] > time)
+            cursor = 0;
+        while(cursor < last && track.times[cursor + 1] <= time)
+            cursor++;
+        unsigned int next = cursor < last ? cursor + 1 : last;
+        k[0] = cursor > 0 ? cursor - 1 : cursor;
+        k[1] = cursor;
+        k[2] = next;
+        k[3] = next < last ? next + 1 : next;
+        float span = track.times[next] - track.times[cursor];
+        return span > 0.0f ? glm::clamp((time - track.times[cursor]) / span, 0.0f, 1.0f) : 0.0f;
+    }
+
+    static void weights(TrackInterpolation interpolation, float t, float c[4])
+    {
+        if(interpolation == INTERPOLATION_LINEAR)
+        {
+            c[0] = 0.0f;
+            c[1] = 1.0f - t;
+            c[2] = t;
+            c[3] = 0.0f;
+            return;
+        }
+        float t2 = t * t, t3 = t2 * t;
+        c[0] = 0.5f * (-t3 + 2.0f * t2 - t);
+        c[1] = 0.5f * (3.0f * t3 - 5.0f * t2 + 2.0f);
+        c[2] = 0.5f * (-3.0f * t3 + 4.0f * t2 + t);
+        c[3] = 0.5f * (t3 - t2);
+    }
+};
+#endif
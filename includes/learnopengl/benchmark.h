@@ -0,0 +1,379 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/alloc_tracker.h>
+#include <learnopengl/frame_arena.h>
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef __linux__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// A scripted operation of a benchmark run. It starts at `frame`; one shot operations have a duration of 0,
+// continuous ones such as translate/rotate/scale/shear are applied every frame for `duration` frames
+// (like holding the key down).
+struct BenchEvent {
+    int frame;
+    int duration;
+    string op;
+    vector<string> args;
+};
+
+// A camera pose reached at a given frame; poses in between are interpolated linearly.
+struct CameraKey {
+    int frame;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// interpolates a camera path, its keys sorted by frame, at a frame; returns false if it has no keys.
+inline bool cameraPathAt(const vector<CameraKey> &path, int frame, glm::vec3 &position, float &yaw, float &pitch)
+{
+    if(path.empty())
+        return false;
+    unsigned int next = 0;
+    while(next < path.size() && path[next].frame <= frame)
+        next++;
+    const CameraKey &a = path[next == 0 ? 0 : next - 1];
+    const CameraKey &b = path[next == path.size() ? next - 1 : next];
+    float t = b.frame > a.frame ? (float)(frame - a.frame) / (float)(b.frame - a.frame) : 0.0f;
+    t = glm::clamp(t, 0.0f, 1.0f);
+    position = glm::mix(a.position, b.position, t);
+    yaw = glm::mix(a.yaw, b.yaw, t);
+    pitch = glm::mix(a.pitch, b.pitch, t);
+    return true;
+}
+
+// A scene/benchmark description. The file is line based, '#' starts a comment:
+//
+//   frames 600                       number of frames to run
+//   timestep 0.0166667               fixed simulation step in seconds
+//   size 800x600                     framebuffer resolution
+//   camera <frame> x y z yaw pitch   camera path key
+//   at <frame> <op> [args...]        one shot operation (create <obj>, delete, select <i>, animation1, animation2)
+//   hold <frame> <frames> <op> [args...]
+//                                    continuous operation (translate <axis> <sign>, rotate <axis> <sign>,
+//                                    scale <sign>, shear <axis> <sign>)
+class BenchScript
+{
+public:
+    string path;
+    int frames;
+    float timestep;
+    unsigned int width, height;
+    vector<CameraKey> cameraPath;
+    vector<BenchEvent> events;
+
+    BenchScript() : frames(600), timestep(1.0f / 60.0f), width(800), height(600) {}
+
+    bool load(const string &path)
+    {
+        this->path = path;
+        ifstream file(path.c_str());
+        if(!file)
+        {
+            cout << "ERROR::BENCH:: Could not open benchmark script " << path << endl;
+            return false;
+        }
+        string line;
+        int lineNr = 0;
+        while(getline(file, line))
+        {
+            lineNr++;
+            line = line.substr(0, line.find('#'));
+            istringstream in(line);
+            string keyword;
+            if(!(in >> keyword))
+                continue;
+
+            bool ok = true;
+            if(keyword == "frames")
+                ok = (bool)(in >> frames);
+            else if(keyword == "timestep")
+                ok = (bool)(in >> timestep);
+            else if(keyword == "size")
+            {
+                string size;
+                ok = (in >> size) && sscanf(size.c_str(), "%ux%u", &width, &height) == 2;
+            }
+            else if(keyword == "camera")
+            {
+                CameraKey key;
+                ok = (bool)(in >> key.frame >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch);
+                cameraPath.push_back(key);
+            }
+            else if(keyword == "at" || keyword == "hold")
+            {
+                BenchEvent event;
+                event.duration = 0;
+                ok = (bool)(in >> event.frame);
+                if(ok && keyword == "hold")
+                    ok = (bool)(in >> event.duration);
+                ok = ok && (in >> event.op);
+                string arg;
+                while(in >> arg)
+                    event.args.push_back(arg);
+                events.push_back(event);
+            }
+            else
+                ok = false;
+
+            if(!ok)
+            {
+                cout << "ERROR::BENCH:: " << path << ":" << lineNr << ": could not parse '" << line << "'" << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // interpolates the camera path at a frame; returns false if the script has no camera path.
+    bool cameraAt(int frame, glm::vec3 &position, float &yaw, float &pitch) const
+    {
+        return cameraPathAt(cameraPath, frame, position, yaw, pitch);
+    }
+};
+
+// What gets measured for every presented frame.
+struct FrameSample {
+    double cpuTime;		// wall time between consecutive frames, in seconds
+    double submitTime;	// CPU time spent issuing GL calls
+    unsigned int drawCalls;
+    unsigned int stateChanges;
+    unsigned long long streamedBytes;	// written into the stream buffer
+    unsigned int streamStalls;
+    unsigned long long allocations;		// operator new calls from any thread, 0 without CG_ALLOC_TRACKING
+    unsigned long long allocatedBytes;
+};
+
+// resident and peak memory of the process in bytes, 0 where not supported.
+inline size_t residentMemory()
+{
+#ifdef __linux__
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if(file)
+    {
+        if(fscanf(file, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(file);
+    }
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+inline size_t peakMemory()
+{
+#ifdef __linux__
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024;
+#else
+    return 0;
+#endif
+}
+
+// Collects frame samples and writes them out as a JSON report.
+class BenchReport
+{
+public:
+    vector<FrameSample> samples;
+    // GPU pass timings arrive a few frames late (see GpuTimer), so they are kept apart from the frame samples
+    vector<string> gpuPasses;
+    vector< vector<double> > gpuTimes;
+    unsigned int gpuDroppedFrames;
+    // filled in at the end of a run when allocations are tracked (see alloc_tracker.h)
+    bool allocationsTracked;
+    unsigned long long allocationLimit;
+    unsigned int allocationFailures;	// frames over the limit
+    vector<AllocationSite> allocationZones;
+    vector<AllocationSite> allocationStacks;
+
+    BenchReport() : gpuDroppedFrames(0), allocationsTracked(false), allocationLimit(0), allocationFailures(0) {}
+
+    void add(const FrameSample &sample)
+    {
+        samples.push_back(sample);
+    }
+
+    void addGpuTime(const string &pass, double time)
+    {
+        unsigned int i = 0;
+        while(i < gpuPasses.size() && gpuPasses[i] != pass)
+            i++;
+        if(i == gpuPasses.size())
+        {
+            gpuPasses.push_back(pass);
+            gpuTimes.push_back(vector<double>());
+            gpuTimes.back().reserve(samples.capacity());
+        }
+        gpuTimes[i].push_back(time);
+    }
+
+    bool write(const string &path, const BenchScript &script) const
+    {
+        ostringstream json;
+        json.precision(6);
+        json << fixed;
+        json << "{\n";
+        json << "  \"script\": \"" << escaped(script.path) << "\",\n";
+        json << "  \"frames\": " << samples.size() << ",\n";
+        json << "  \"timestep\": " << script.timestep << ",\n";
+        json << "  \"resolution\": [" << script.width << ", " << script.height << "],\n";
+        writeTimes(json, "cpu_frame_ms", field(&FrameSample::cpuTime));
+        json << ",\n";
+        writeTimes(json, "cpu_submit_ms", field(&FrameSample::submitTime));
+        json << ",\n";
+        json << "  \"gpu_passes_ms\": {\n";
+        for(unsigned int i = 0; i < gpuPasses.size(); i++)
+        {
+            json << "  ";
+            writeTimes(json, gpuPasses[i].c_str(), gpuTimes[i]);
+            json << (i + 1 < gpuPasses.size() ? ",\n" : "\n");
+        }
+        json << "  },\n";
+        json << "  \"gpu_dropped_frames\": " << gpuDroppedFrames << ",\n";
+
+        unsigned long drawCalls = 0, stateChanges = 0, streamStalls = 0;
+        unsigned long long streamedBytes = 0;
+        for(unsigned int i = 0; i < samples.size(); i++)
+        {
+            drawCalls += samples[i].drawCalls;
+            stateChanges += samples[i].stateChanges;
+            streamedBytes += samples[i].streamedBytes;
+            streamStalls += samples[i].streamStalls;
+        }
+        double n = samples.empty() ? 1.0 : (double)samples.size();
+        json << "  \"draw_calls\": { \"total\": " << drawCalls << ", \"per_frame\": " << drawCalls / n << " },\n";
+        json << "  \"state_changes\": { \"total\": " << stateChanges << ", \"per_frame\": " << stateChanges / n << " },\n";
+        json << "  \"streaming\": { \"bytes_per_frame\": " << streamedBytes / n << ", \"stalls\": " << streamStalls << " },\n";
+        if(allocationsTracked)
+            writeAllocations(json, n);
+        vector<FrameArena*> arenas = FrameArena::all();
+        json << "  \"frame_arenas\": [";
+        for(unsigned int i = 0; i < arenas.size(); i++)
+            json << (i == 0 ? "\n" : ",\n") << "    { \"thread\": \"" << escaped(arenas[i]->name) << "\", \"high_water_bytes\": "
+                 << arenas[i]->highWaterMark() << ", \"capacity_bytes\": " << arenas[i]->capacity() << ", \"grew\": "
+                 << arenas[i]->growCount() << " }";
+        json << (arenas.empty() ? "],\n" : "\n  ],\n");
+        json << "  \"memory\": { \"resident_bytes\": " << residentMemory() << ", \"peak_bytes\": " << peakMemory() << " }\n";
+        json << "}\n";
+
+        if(path.empty())
+        {
+            cout << json.str();
+            return true;
+        }
+        ofstream file(path.c_str());
+        if(!file)
+        {
+            cout << "ERROR::BENCH:: Could not write report to " << path << endl;
+            return false;
+        }
+        file << json.str();
+        return true;
+    }
+
+private:
+    vector<double> field(double FrameSample::*member) const
+    {
+        vector<double> times;
+        for(unsigned int i = 0; i < samples.size(); i++)
+            times.push_back(samples[i].*member);
+        return times;
+    }
+
+    vector<double> field(unsigned long long FrameSample::*member) const
+    {
+        vector<double> values;
+        for(unsigned int i = 0; i < samples.size(); i++)
+            values.push_back((double)(samples[i].*member));
+        return values;
+    }
+
+    void writeAllocations(ostringstream &json, double frames) const
+    {
+        json << "  \"allocations\": {\n";
+        json << "  ";
+        writeTimes(json, "per_frame", field(&FrameSample::allocations), 1.0);
+        json << ",\n  ";
+        writeTimes(json, "bytes_per_frame", field(&FrameSample::allocatedBytes), 1.0);
+        json << ",\n";
+        json << "    \"limit\": " << allocationLimit << ", \"frames_over_limit\": " << allocationFailures << ",\n";
+        json << "    \"zones\": [";
+        for(unsigned int i = 0; i < allocationZones.size(); i++)
+        {
+            const AllocationSite &zone = allocationZones[i];
+            json << (i == 0 ? "\n" : ",\n") << "      { \"name\": \"" << escaped(zone.name) << "\", \"count\": " << zone.count
+                 << ", \"bytes\": " << zone.bytes << ", \"count_per_frame\": " << zone.count / frames
+                 << ", \"bytes_per_frame\": " << zone.bytes / frames << " }";
+        }
+        json << (allocationZones.empty() ? "],\n" : "\n    ],\n");
+        json << "    \"sampled_stacks\": [";
+        for(unsigned int i = 0; i < allocationStacks.size(); i++)
+        {
+            const AllocationSite &stack = allocationStacks[i];
+            json << (i == 0 ? "\n" : ",\n") << "      { \"samples\": " << stack.count << ", \"bytes\": " << stack.bytes
+                 << ", \"stack\": \"" << escaped(stack.name) << "\" }";
+        }
+        json << (allocationStacks.empty() ? "]\n" : "\n    ]\n");
+        json << "  },\n";
+    }
+
+    static string escaped(const string &text)
+    {
+        string out;
+        for(unsigned int i = 0; i < text.size(); i++)
+        {
+            if(text[i] == '"' || text[i] == '\\')
+                out += '\\';
+            out += (unsigned char)text[i] < 0x20 ? ' ' : text[i];
+        }
+        return out;
+    }
+
+    // writes mean and percentiles of a list of times in seconds, converted to milliseconds (or of other
+    // values with a different scale).
+    void writeTimes(ostringstream &json, const char *name, vector<double> times, double scale = 1000.0) const
+    {
+        for(unsigned int i = 0; i < times.size(); i++)
+            times[i] *= scale;
+        sort(times.begin(), times.end());
+
+        double sum = 0.0;
+        for(unsigned int i = 0; i < times.size(); i++)
+            sum += times[i];
+        json << "  \"" << name << "\": { \"samples\": " << times.size();
+        if(!times.empty())
+        {
+            json << ", \"mean\": " << sum / times.size()
+                 << ", \"min\": " << times.front()
+                 << ", \"p50\": " << percentile(times, 0.50)
+                 << ", \"p90\": " << percentile(times, 0.90)
+                 << ", \"p99\": " << percentile(times, 0.99)
+                 << ", \"max\": " << times.back();
+        }
+        json << " }";
+    }
+
+    static double percentile(const vector<double> &sorted, double p)
+    {
+        unsigned int index = (unsigned int)(p * (sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+};
+#endif
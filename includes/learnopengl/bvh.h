@@ -0,0 +1,355 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/job_system.h>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+using namespace std;
+
+// An axis aligned box; empty boxes are inverted, so growing them by anything gives that thing's box.
+struct BVHBounds {
+    glm::vec3 lower, upper;
+
+    BVHBounds() : lower(FLT_MAX), upper(-FLT_MAX) {}
+
+    void grow(const glm::vec3 &p) { lower = glm::min(lower, p); upper = glm::max(upper, p); }
+    void grow(const BVHBounds &b) { lower = glm::min(lower, b.lower); upper = glm::max(upper, b.upper); }
+
+    // half the surface area, which is all the SAH needs
+    float area() const
+    {
+        glm::vec3 d = glm::max(upper - lower, glm::vec3(0.0f));
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+};
+
+// 32 bytes, two to a cache line. Inner nodes have count 0 and their children at start and start + 1;
+// leaves have their triangles at indices[start, start + count).
+struct BVHNode {
+    glm::vec3 lower;
+    unsigned int start;
+    glm::vec3 upper;
+    unsigned int count;
+};
+
+// A bounding volume hierarchy over triangles, built top down with the surface area heuristic: every node
+// bins its triangles' centroids into BINS slots along each axis and splits where the expected cost of
+// tracing a ray through the two halves is lowest, or becomes a leaf when no split beats testing all its
+// triangles. With a job system the build is parallel: the few nodes at the top, which hold most of the
+// triangles, are binned by all the workers together, and the subtrees below them are built by one worker
+// each and appended to the node array when done.
+class TriangleBVH
+{
+public:
+    static const int BINS = 16;
+    static const unsigned int MAX_LEAF = 8;		// larger nodes always split, even when the SAH says otherwise
+
+    // the cost of a traversal step relative to a triangle test; higher values give fewer, larger leaves
+    float traversalCost;
+
+    vector<BVHNode> nodes;			// nodes[0] is the root
+    vector<unsigned int> indices;	// triangle indices in leaf order
+
+    TriangleBVH() : traversalCost(1.0f) {}
+
+    // builds over `triangles` triangles, whose corners are corners[3 * i] to corners[3 * i + 2]
+    void build(const glm::vec3 *corners, unsigned int triangles, JobSystem *jobs = NULL)
+    {
+        nodes.clear();
+        indices.resize(triangles);
+        references.resize(triangles);
+        JobSystem::Job prepare = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                Reference &r = references[i];
+                r.box = BVHBounds();
+                r.box.grow(corners[3 * i]);
+                r.box.grow(corners[3 * i + 1]);
+                r.box.grow(corners[3 * i + 2]);
+                r.centroid = (r.box.lower + r.box.upper) * 0.5f;
+                r.index = i;
+            }
+        };
+        forChunks(jobs, triangles, CHUNK, prepare);
+
+        BVHNode root = { glm::vec3(0.0f), 0, glm::vec3(0.0f), 0 };
+        nodes.push_back(root);
+        if(triangles == 0)
+            return;
+
+        // split the big nodes with parallel binning until there are enough subtrees to keep every worker busy
+        unsigned int threads = jobs ? jobs->threads() : 1;
+        unsigned int subtreeSize = threads > 1 ? max(triangles / (threads * 8), (unsigned int)SERIAL_SIZE) : triangles;
+        vector<Task> open(1), subtrees;
+        open[0].node = 0;
+        open[0].begin = 0;
+        open[0].end = triangles;
+        while(!open.empty())
+        {
+            Task task = open.back();
+            open.pop_back();
+            if(task.end - task.begin <= subtreeSize)
+            {
+                subtrees.push_back(task);
+                continue;
+            }
+            unsigned int middle;
+            if(!splitNode(nodes, task, jobs, middle))
+                continue;
+            Task left = { nodes[task.node].start, task.begin, middle }, right = { left.node + 1, middle, task.end };
+            open.push_back(left);
+            open.push_back(right);
+        }
+
+        vector< vector<BVHNode> > built(subtrees.size());
+        JobSystem::Job buildSubtrees = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+                buildSubtree(subtrees[i], built[i]);
+        };
+        forChunks(jobs, subtrees.size(), 1, buildSubtrees);
+
+        // a subtree's root goes where its task was; the rest is appended, renumbered
+        for(unsigned int i = 0; i < subtrees.size(); i++)
+        {
+            unsigned int base = nodes.size() - 1;
+            for(unsigned int j = 0; j < built[i].size(); j++)
+            {
+                BVHNode node = built[i][j];
+                if(node.count == 0)
+                    node.start += base;
+                if(j == 0)
+                    nodes[subtrees[i].node] = node;
+                else
+                    nodes.push_back(node);
+            }
+        }
+
+        JobSystem::Job order = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+                indices[i] = references[i].index;
+        };
+        forChunks(jobs, triangles, CHUNK, order);
+    }
+
+private:
+    static const unsigned int CHUNK = 4096;			// triangles per job when binning in parallel
+    static const unsigned int SERIAL_SIZE = 4096;	// subtrees smaller than this aren't worth splitting up
+
+    struct Task {
+        unsigned int node, begin, end;		// a node and the range of indices it covers
+    };
+
+    // a triangle's box, moved around with its index while the nodes are split, so binning reads them in order
+    struct Reference {
+        BVHBounds box;
+        glm::vec3 centroid;
+        unsigned int index;
+    };
+
+    struct Bin {
+        BVHBounds box;
+        unsigned int count;
+    };
+
+    // the bounds of a range of triangles and of their centroids, and their centroids binned along each axis
+    struct Binning {
+        BVHBounds box, centers;
+        Bin bins[3][BINS];
+        char padding[64];
+
+        void clearBins()
+        {
+            for(int axis = 0; axis < 3; axis++)
+                for(int b = 0; b < BINS; b++)
+                {
+                    bins[axis][b].box = BVHBounds();
+                    bins[axis][b].count = 0;
+                }
+        }
+    };
+
+    vector<Reference> references;
+    vector<Binning> perThread;
+
+    static void forChunks(JobSystem *jobs, unsigned int n, unsigned int chunk, const JobSystem::Job &f)
+    {
+        if(jobs)
+            jobs->parallelFor(n, chunk, f);
+        else if(n > 0)
+            f(0, n, 0);
+    }
+
+    void measure(unsigned int begin, unsigned int end, Binning &binning) const
+    {
+        for(unsigned int i = begin; i < end; i++)
+        {
+            binning.box.grow(references[i].box);
+            binning.centers.grow(references[i].centroid);
+        }
+    }
+
+    static int binOf(float c, float lower, float scale)
+    {
+        int b = (int)((c - lower) * scale);
+        return b < 0 ? 0 : b >= BINS ? BINS - 1 : b;
+    }
+
+    void bin(unsigned int begin, unsigned int end, const BVHBounds &centers, Binning &binning) const
+    {
+        // flat axes put everything in their first bin, which no split uses
+        glm::vec3 extent = centers.upper - centers.lower, scale;
+        for(int axis = 0; axis < 3; axis++)
+            scale[axis] = extent[axis] > 0.0f ? BINS / extent[axis] : 0.0f;
+        for(unsigned int i = begin; i < end; i++)
+        {
+            const glm::vec3 &c = references[i].centroid;
+            const BVHBounds &box = references[i].box;
+            for(int axis = 0; axis < 3; axis++)
+            {
+                Bin &b = binning.bins[axis][binOf(c[axis], centers.lower[axis], scale[axis])];
+                b.box.grow(box);
+                b.count++;
+            }
+        }
+    }
+
+    // picks the cheapest split of a binned node: returns false to make it a leaf, else the axis and the
+    // first bin of the right half, or axis -1 to split the range in the middle when the centroids can't
+    // be told apart
+    bool chooseSplit(const Binning &binning, unsigned int count, int &axis, int &split) const
+    {
+        float best = FLT_MAX;
+        axis = -1;
+        for(int a = 0; a < 3; a++)
+        {
+            const Bin *bins = binning.bins[a];
+            // areas and counts of all the left halves, then sweep the right halves against them
+            float leftCost[BINS];
+            BVHBounds box;
+            unsigned int n = 0;
+            for(int b = 0; b < BINS - 1; b++)
+            {
+                box.grow(bins[b].box);
+                n += bins[b].count;
+                leftCost[b] = n ? box.area() * n : FLT_MAX;
+            }
+            box = BVHBounds();
+            n = 0;
+            for(int b = BINS - 1; b > 0; b--)
+            {
+                box.grow(bins[b].box);
+                n += bins[b].count;
+                if(n == 0 || n == count || leftCost[b - 1] == FLT_MAX)
+                    continue;
+                float cost = leftCost[b - 1] + box.area() * n;
+                if(cost < best)
+                {
+                    best = cost;
+                    axis = a;
+                    split = b;
+                }
+            }
+        }
+        float area = binning.box.area();
+        if(axis >= 0 && (traversalCost * area + best < area * count || count > MAX_LEAF))
+            return true;
+        axis = -1;
+        return count > MAX_LEAF;
+    }
+
+    // bins one node, on all the workers if it is big, and partitions its indices for the split it chooses.
+    // Appends its children to `out` and returns where the right half starts, or makes it a leaf.
+    bool splitNode(vector<BVHNode> &out, const Task &task, JobSystem *jobs, unsigned int &middle)
+    {
+        unsigned int count = task.end - task.begin;
+        Binning binning;
+        binning.clearBins();
+        if(jobs && count > CHUNK)
+        {
+            perThread.resize(jobs->threads());
+            for(unsigned int t = 0; t < perThread.size(); t++)
+            {
+                perThread[t].box = BVHBounds();
+                perThread[t].centers = BVHBounds();
+                perThread[t].clearBins();
+            }
+            JobSystem::Job measureJob = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+                measure(task.begin + begin, task.begin + end, perThread[thread]);
+            };
+            jobs->parallelFor(count, CHUNK, measureJob);
+            for(unsigned int t = 0; t < perThread.size(); t++)
+            {
+                binning.box.grow(perThread[t].box);
+                binning.centers.grow(perThread[t].centers);
+            }
+            JobSystem::Job binJob = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+                bin(task.begin + begin, task.begin + end, binning.centers, perThread[thread]);
+            };
+            jobs->parallelFor(count, CHUNK, binJob);
+            for(unsigned int t = 0; t < perThread.size(); t++)
+                for(int axis = 0; axis < 3; axis++)
+                    for(int b = 0; b < BINS; b++)
+                    {
+                        binning.bins[axis][b].box.grow(perThread[t].bins[axis][b].box);
+                        binning.bins[axis][b].count += perThread[t].bins[axis][b].count;
+                    }
+        }
+        else
+        {
+            measure(task.begin, task.end, binning);
+            bin(task.begin, task.end, binning.centers, binning);
+        }
+
+        BVHNode &node = out[task.node];
+        node.lower = binning.box.lower;
+        node.upper = binning.box.upper;
+        int axis, split;
+        if(!chooseSplit(binning, count, axis, split))
+        {
+            node.start = task.begin;
+            node.count = count;
+            return false;
+        }
+        if(axis < 0)
+            middle = task.begin + count / 2;
+        else
+        {
+            float lower = binning.centers.lower[axis], scale = BINS / (binning.centers.upper[axis] - lower);
+            middle = partition(references.begin() + task.begin, references.begin() + task.end, [&](const Reference &r) {
+                return binOf(r.centroid[axis], lower, scale) < split;
+            }) - references.begin();
+        }
+        node.start = out.size();
+        node.count = 0;
+        BVHNode child = { glm::vec3(0.0f), 0, glm::vec3(0.0f), 0 };
+        out.push_back(child);
+        out.push_back(child);
+        return true;
+    }
+
+    // builds the subtree of a task on the calling thread into `out`, its root first
+    void buildSubtree(const Task &root, vector<BVHNode> &out)
+    {
+        BVHNode node = { glm::vec3(0.0f), 0, glm::vec3(0.0f), 0 };
+        out.assign(1, node);
+        vector<Task> stack(1);
+        stack[0] = root;
+        stack[0].node = 0;
+        while(!stack.empty())
+        {
+            Task task = stack.back();
+            stack.pop_back();
+            unsigned int middle;
+            if(!splitNode(out, task, NULL, middle))
+                continue;
+            Task left = { out[task.node].start, task.begin, middle }, right = { left.node + 1, middle, task.end };
+            stack.push_back(left);
+            stack.push_back(right);
+        }
+    }
+};
+#endif
@@ -102,6 +102,15 @@ public:
         updateCameraVectors();
     }
 
+    // Places the camera at a position looking along the given Euler angles. Used to drive the camera from scripts instead of input.
+    void SetPose(glm::vec3 position, float yaw, float pitch)
+    {
+        Position = position;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     // Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
@@ -0,0 +1,470 @@
+#ifndef COLLISION_WORLD_H
+#define COLLISION_WORLD_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/convex_hull.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/float4.h>
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+using namespace std;
+
+// two overlapping instances, by index, a < b
+struct CollisionPair {
+    unsigned int a, b;
+};
+
+struct CollisionStats {
+    unsigned int instances;
+    unsigned int cells;			// occupied grid cells
+    unsigned int oversized;		// instances too big for the grid
+    unsigned int candidates;	// pairs whose boxes overlap
+    unsigned int overlaps;		// of those, pairs whose hulls overlap
+    float cellSize;
+    double broadTime, narrowTime;	// seconds
+};
+
+// Finds the instances that overlap each other. Every object is registered with the convex hulls of its
+// meshes; update() then works on the world matrices of all the instances in two phases:
+//
+// broadphase: a spatial hash. Each instance gets the world space box of its hulls and is entered in every
+// cell of a uniform grid its box touches, the cells being twice the average box size so that is a few. The
+// entries are radix sorted by the hash of their cell, and the boxes of every run of equal hashes are tested
+// against each other four at a time with SSE, the runs split among the workers. A pair sharing several
+// cells is only reported by the cell holding the lower corner of the boxes' intersection. Instances
+// spanning too many cells stay out of the grid and are tested against all the boxes instead.
+//
+// narrow phase: the candidate pairs are tested hull against hull with GJK, also on the workers.
+class CollisionWorld
+{
+public:
+    static const unsigned int MAX_CELLS = 8;	// an instance in more cells than this is tested on its own
+
+    vector<CollisionPair> pairs;		// overlapping after the last update, sorted
+    CollisionStats stats;
+
+    CollisionWorld()
+    {
+        CollisionStats none = { 0, 0, 0, 0, 0, 0.0f, 0.0, 0.0 };
+        stats = none;
+    }
+
+    // registers the hulls of the next object, in the order instances number them
+    void addObject(const vector<ConvexHull> &hulls)
+    {
+        Shape shape;
+        shape.hulls = hulls;
+        shape.lower = glm::vec3(FLT_MAX);
+        shape.upper = glm::vec3(-FLT_MAX);
+        for(unsigned int i = 0; i < hulls.size(); i++)
+        {
+            shape.lower = glm::min(shape.lower, hulls[i].lower);
+            shape.upper = glm::max(shape.upper, hulls[i].upper);
+        }
+        shapes.push_back(shape);
+    }
+
+    // finds the overlapping pairs among the instances of objects `models` at world matrices `world`; a
+    // negative object is no instance
+    void update(const vector<int> &models, const vector<glm::mat4> &world, JobSystem *jobs = NULL)
+    {
+        unsigned int n = models.size();
+        unsigned int threads = jobs ? jobs->threads() : 1;
+        stats.instances = n;
+        double start = now();
+
+        // the boxes by instance, one array per bound, padded so four can always be read
+        for(int k = 0; k < 6; k++)
+            bounds[k].resize(n + 4);
+        perThread.resize(threads);
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            perThread[t].pairs.clear();
+            perThread[t].oversized.clear();
+            perThread[t].size = 0.0;
+            perThread[t].boxes = 0;
+        }
+        JobSystem::Job bound = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                glm::vec3 lower, upper;
+                box(models[i], world[i], lower, upper);
+                for(int k = 0; k < 3; k++)
+                {
+                    bounds[k][i] = lower[k];
+                    bounds[k + 3][i] = upper[k];
+                }
+                if(lower.x <= upper.x)
+                {
+                    glm::vec3 size = upper - lower;
+                    perThread[thread].size += max(size.x, max(size.y, size.z));
+                    perThread[thread].boxes++;
+                }
+            }
+        };
+        forChunks(jobs, n, CHUNK, bound);
+        pad(bounds, n);
+        double size = 0.0;
+        unsigned int boxes = 0;
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            size += perThread[t].size;
+            boxes += perThread[t].boxes;
+        }
+        cellSize = boxes > 0 && size > 0.0 ? (float)(2.0 * size / boxes) : 1.0f;
+        stats.cellSize = cellSize;
+
+        // the grid entries: count them per instance, then write them where the prefix sum puts them
+        first.resize(n + 1);
+        JobSystem::Job count = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                Cell lower, upper;
+                first[i + 1] = 0;
+                if(bounds[0][i] > bounds[3][i])
+                    continue;
+                cellRange(i, lower, upper);
+                long long cells = ((long long)upper.x - lower.x + 1) * ((long long)upper.y - lower.y + 1) * ((long long)upper.z - lower.z + 1);
+                if(cells > MAX_CELLS)
+                    perThread[thread].oversized.push_back(i);
+                else
+                    first[i + 1] = cells;
+            }
+        };
+        forChunks(jobs, n, CHUNK, count);
+        first[0] = 0;
+        for(unsigned int i = 0; i < n; i++)
+            first[i + 1] += first[i];
+        unsigned int m = first[n];
+        entries.resize(m);
+        JobSystem::Job enter = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                if(first[i + 1] == first[i])
+                    continue;
+                Cell lower, upper;
+                cellRange(i, lower, upper);
+                Entry *e = &entries[first[i]];
+                for(int z = lower.z; z <= upper.z; z++)
+                    for(int y = lower.y; y <= upper.y; y++)
+                        for(int x = lower.x; x <= upper.x; x++, e++)
+                        {
+                            e->cell.x = x;
+                            e->cell.y = y;
+                            e->cell.z = z;
+                            e->key = hash(e->cell);
+                            e->instance = i;
+                        }
+            }
+        };
+        forChunks(jobs, n, CHUNK, enter);
+        radixSort();
+
+        // runs of equal keys, and the boxes of the entries in sorted order
+        runs.clear();
+        for(unsigned int e = 0; e < m; e++)
+            if(e == 0 || entries[e].key != entries[e - 1].key)
+                runs.push_back(e);
+        runs.push_back(m);
+        stats.cells = runs.size() - 1;
+        for(int k = 0; k < 6; k++)
+            entryBounds[k].resize(m + 4);
+        JobSystem::Job gather = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int e = begin; e < end; e++)
+                for(int k = 0; k < 6; k++)
+                    entryBounds[k][e] = bounds[k][entries[e].instance];
+        };
+        forChunks(jobs, m, CHUNK, gather);
+        pad(entryBounds, m);
+
+        JobSystem::Job sweep = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+            for(unsigned int r = begin; r < end; r++)
+                testRun(runs[r], runs[r + 1], perThread[thread].pairs);
+        };
+        forChunks(jobs, runs.size() - 1, RUN_CHUNK, sweep);
+
+        oversized.clear();
+        for(unsigned int t = 0; t < threads; t++)
+            oversized.insert(oversized.end(), perThread[t].oversized.begin(), perThread[t].oversized.end());
+        sort(oversized.begin(), oversized.end());
+        stats.oversized = oversized.size();
+        JobSystem::Job big = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+            for(unsigned int o = begin; o < end; o++)
+                testOversized(oversized[o], perThread[thread].found, perThread[thread].pairs);
+        };
+        forChunks(jobs, oversized.size(), 1, big);
+
+        candidates.clear();
+        for(unsigned int t = 0; t < threads; t++)
+            candidates.insert(candidates.end(), perThread[t].pairs.begin(), perThread[t].pairs.end());
+        stats.candidates = candidates.size();
+        double broadEnd = now();
+        stats.broadTime = broadEnd - start;
+
+        hits.resize(candidates.size());
+        JobSystem::Job narrow = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int c = begin; c < end; c++)
+            {
+                const CollisionPair &p = candidates[c];
+                hits[c] = overlaps(models[p.a], world[p.a], models[p.b], world[p.b]);
+            }
+        };
+        forChunks(jobs, candidates.size(), NARROW_CHUNK, narrow);
+        pairs.clear();
+        for(unsigned int c = 0; c < candidates.size(); c++)
+            if(hits[c])
+                pairs.push_back(candidates[c]);
+        sort(pairs.begin(), pairs.end(), [](const CollisionPair &x, const CollisionPair &y) {
+            return x.a != y.a ? x.a < y.a : x.b < y.b;
+        });
+        stats.overlaps = pairs.size();
+        stats.narrowTime = now() - broadEnd;
+    }
+
+    // whether an instance of `objA` at `a` overlaps one of `objB` at `b`: any hull of one against any of the other
+    bool overlaps(int objA, const glm::mat4 &a, int objB, const glm::mat4 &b) const
+    {
+        if(objA < 0 || objB < 0 || objA >= (int)shapes.size() || objB >= (int)shapes.size())
+            return false;
+        const vector<ConvexHull> &hullsA = shapes[objA].hulls, &hullsB = shapes[objB].hulls;
+        for(unsigned int i = 0; i < hullsA.size(); i++)
+        {
+            glm::vec3 lowerA, upperA;
+            transformBox(hullsA[i].lower, hullsA[i].upper, a, lowerA, upperA);
+            for(unsigned int j = 0; j < hullsB.size(); j++)
+            {
+                glm::vec3 lowerB, upperB;
+                transformBox(hullsB[j].lower, hullsB[j].upper, b, lowerB, upperB);
+                if(glm::any(glm::lessThan(upperA, lowerB)) || glm::any(glm::lessThan(upperB, lowerA)))
+                    continue;
+                if(ConvexHull::intersect(hullsA[i], a, hullsB[j], b))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // the instances of the last update whose boxes overlap the box of an instance of `obj` at `matrix`
+    void query(int obj, const glm::mat4 &matrix, vector<unsigned int> &out) const
+    {
+        out.clear();
+        glm::vec3 lower, upper;
+        box(obj, matrix, lower, upper);
+        if(lower.x > upper.x)
+            return;
+        overlapping(lower, upper, out);
+    }
+
+private:
+    static const unsigned int CHUNK = 4096;			// instances or entries per job
+    static const unsigned int RUN_CHUNK = 256;
+    static const unsigned int NARROW_CHUNK = 64;
+
+    struct Shape {
+        vector<ConvexHull> hulls;
+        glm::vec3 lower, upper;		// box of all the hulls
+    };
+
+    struct Cell {
+        int x, y, z;
+    };
+
+    struct Entry {
+        unsigned int key;			// hash of the cell
+        unsigned int instance;
+        Cell cell;
+    };
+
+    // what each worker collects, apart from the others'
+    struct ThreadState {
+        vector<CollisionPair> pairs;
+        vector<unsigned int> oversized;
+        vector<unsigned int> found;		// scratch of testOversized()
+        double size;				// sum of the largest side of the boxes
+        unsigned int boxes;
+        char padding[64];
+    };
+
+    vector<Shape> shapes;
+    vector<float> bounds[6];			// by instance: lower x, y, z then upper x, y, z
+    float cellSize;
+    vector<unsigned int> first;			// the first entry of each instance
+    vector<Entry> entries, scratch;
+    vector<unsigned int> offsets;		// of the radix sort's buckets
+    vector<unsigned int> runs;			// where each run of equal keys starts, then the end
+    vector<float> entryBounds[6];		// the bounds of the entries, in sorted order
+    vector<unsigned int> oversized;
+    vector<ThreadState> perThread;
+    vector<CollisionPair> candidates;
+    vector<unsigned char> hits;
+
+    static double now()
+    {
+        return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void forChunks(JobSystem *jobs, unsigned int n, unsigned int chunk, const JobSystem::Job &f)
+    {
+        if(jobs)
+            jobs->parallelFor(n, chunk, f);
+        else if(n > 0)
+            f(0, n, 0);
+    }
+
+    // empty boxes past the end, which overlap nothing
+    static void pad(vector<float> *b, unsigned int n)
+    {
+        for(unsigned int i = n; i < n + 4; i++)
+            for(int k = 0; k < 6; k++)
+                b[k][i] = k < 3 ? FLT_MAX : -FLT_MAX;
+    }
+
+    static unsigned int hash(const Cell &c)
+    {
+        return (unsigned int)c.x * 73856093u ^ (unsigned int)c.y * 19349663u ^ (unsigned int)c.z * 83492791u;
+    }
+
+    int cellOf(float v) const
+    {
+        float c = floor(v / cellSize);
+        return c < -1e9f ? -1000000000 : c > 1e9f ? 1000000000 : (int)c;
+    }
+
+    void cellRange(unsigned int i, Cell &lower, Cell &upper) const
+    {
+        lower.x = cellOf(bounds[0][i]);
+        lower.y = cellOf(bounds[1][i]);
+        lower.z = cellOf(bounds[2][i]);
+        upper.x = cellOf(bounds[3][i]);
+        upper.y = cellOf(bounds[4][i]);
+        upper.z = cellOf(bounds[5][i]);
+    }
+
+    static int lowestBit(int m)
+    {
+        int b = 0;
+        while(!(m & (1 << b)))
+            b++;
+        return b;
+    }
+
+    // the box around a model space box after an affine transform (Arvo's method)
+    static void transformBox(const glm::vec3 &lower, const glm::vec3 &upper, const glm::mat4 &m, glm::vec3 &outLower, glm::vec3 &outUpper)
+    {
+        glm::vec3 center = glm::vec3(m * glm::vec4((lower + upper) * 0.5f, 1.0f)), half = (upper - lower) * 0.5f, extent;
+        for(int r = 0; r < 3; r++)
+            extent[r] = fabs(m[0][r]) * half.x + fabs(m[1][r]) * half.y + fabs(m[2][r]) * half.z;
+        outLower = center - extent;
+        outUpper = center + extent;
+    }
+
+    // the world box of an instance; empty (inverted) without an object, which keeps it out of every pair
+    void box(int obj, const glm::mat4 &m, glm::vec3 &lower, glm::vec3 &upper) const
+    {
+        if(obj < 0 || obj >= (int)shapes.size() || shapes[obj].hulls.empty())
+        {
+            lower = glm::vec3(FLT_MAX);
+            upper = glm::vec3(-FLT_MAX);
+            return;
+        }
+        transformBox(shapes[obj].lower, shapes[obj].upper, m, lower, upper);
+    }
+
+    // sorts the entries by key, 16 bits at a time
+    void radixSort()
+    {
+        scratch.resize(entries.size());
+        for(int shift = 0; shift < 32; shift += 16)
+        {
+            offsets.assign(65537, 0);
+            for(unsigned int e = 0; e < entries.size(); e++)
+                offsets[((entries[e].key >> shift) & 0xFFFF) + 1]++;
+            for(unsigned int b = 0; b < 65536; b++)
+                offsets[b + 1] += offsets[b];
+            for(unsigned int e = 0; e < entries.size(); e++)
+                scratch[offsets[(entries[e].key >> shift) & 0xFFFF]++] = entries[e];
+            entries.swap(scratch);
+        }
+    }
+
+    // the pairs among the entries [begin, end), which share a key. Entries of other cells with the same hash
+    // may be in there too; a pair only counts in the one cell of both that holds its lower corner.
+    void testRun(unsigned int begin, unsigned int end, vector<CollisionPair> &out) const
+    {
+        for(unsigned int e = begin; e + 1 < end; e++)
+        {
+            Float4 x0(entryBounds[0][e]), y0(entryBounds[1][e]), z0(entryBounds[2][e]);
+            Float4 x1(entryBounds[3][e]), y1(entryBounds[4][e]), z1(entryBounds[5][e]);
+            for(unsigned int t = e + 1; t < end; t += 4)
+            {
+                Float4 mask = (loadFloat4(&entryBounds[0][t]) <= x1) & (x0 <= loadFloat4(&entryBounds[3][t])) &
+                              (loadFloat4(&entryBounds[1][t]) <= y1) & (y0 <= loadFloat4(&entryBounds[4][t])) &
+                              (loadFloat4(&entryBounds[2][t]) <= z1) & (z0 <= loadFloat4(&entryBounds[5][t]));
+                for(int bitsLeft = bits(mask); bitsLeft; bitsLeft &= bitsLeft - 1)
+                {
+                    unsigned int u = t + lowestBit(bitsLeft);
+                    if(u < end && owns(entries[e], entries[u]))
+                    {
+                        unsigned int a = entries[e].instance, b = entries[u].instance;
+                        CollisionPair pair = { min(a, b), max(a, b) };
+                        out.push_back(pair);
+                    }
+                }
+            }
+        }
+    }
+
+    // whether the cell of two entries is both theirs and the one holding the lower corner of their boxes'
+    // intersection
+    bool owns(const Entry &a, const Entry &b) const
+    {
+        if(a.cell.x != b.cell.x || a.cell.y != b.cell.y || a.cell.z != b.cell.z)
+            return false;
+        unsigned int i = a.instance, j = b.instance;
+        return cellOf(max(bounds[0][i], bounds[0][j])) == a.cell.x && cellOf(max(bounds[1][i], bounds[1][j])) == a.cell.y &&
+               cellOf(max(bounds[2][i], bounds[2][j])) == a.cell.z;
+    }
+
+    // the pairs of an instance that is not in the grid with every other one; two such instances make their
+    // pair once, from the first
+    void testOversized(unsigned int i, vector<unsigned int> &found, vector<CollisionPair> &out) const
+    {
+        found.clear();
+        overlapping(glm::vec3(bounds[0][i], bounds[1][i], bounds[2][i]), glm::vec3(bounds[3][i], bounds[4][i], bounds[5][i]), found);
+        for(unsigned int f = 0; f < found.size(); f++)
+        {
+            unsigned int j = found[f];
+            if(j == i || (j < i && binary_search(oversized.begin(), oversized.end(), j)))
+                continue;
+            CollisionPair pair = { min(i, j), max(i, j) };
+            out.push_back(pair);
+        }
+    }
+
+    // the instances whose boxes overlap the box lower-upper, four at a time
+    void overlapping(const glm::vec3 &lower, const glm::vec3 &upper, vector<unsigned int> &out) const
+    {
+        if(bounds[0].empty())
+            return;
+        unsigned int n = bounds[0].size() - 4;
+        Float4 x0(lower.x), y0(lower.y), z0(lower.z), x1(upper.x), y1(upper.y), z1(upper.z);
+        for(unsigned int t = 0; t < n; t += 4)
+        {
+            Float4 mask = (loadFloat4(&bounds[0][t]) <= x1) & (x0 <= loadFloat4(&bounds[3][t])) &
+                          (loadFloat4(&bounds[1][t]) <= y1) & (y0 <= loadFloat4(&bounds[4][t])) &
+                          (loadFloat4(&bounds[2][t]) <= z1) & (z0 <= loadFloat4(&bounds[5][t]));
+            for(int bitsLeft = bits(mask); bitsLeft; bitsLeft &= bitsLeft - 1)
+            {
+                unsigned int u = t + lowestBit(bitsLeft);
+                if(u < n)
+                    out.push_back(u);
+            }
+        }
+    }
+};
+#endif
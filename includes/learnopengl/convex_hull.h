@@ -0,0 +1,492 @@
+#ifndef CONVEX_HULL_H
+#define CONVEX_HULL_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cfloat>
+using namespace std;
+
+// The convex hull of a point cloud, built with quickhull: start from a tetrahedron of extreme points, then
+// repeatedly take the point farthest outside some face, remove every face that point sees and close the
+// hole with a fan of faces from the horizon to it. Points within a small tolerance of a face count as
+// inside, so near coplanar points are merged away and the hull may lie that much inside the cloud.
+//
+// Collision queries only need the vertices: intersect() runs GJK on the Minkowski difference of two hulls
+// under arbitrary affine transforms, which only ever asks each hull for its farthest vertex along a direction.
+// That vertex is found by walking the edges uphill from the previous answer, a few steps when the direction
+// changes little between GJK iterations.
+class ConvexHull
+{
+public:
+    vector<glm::vec3> vertices;		// the points on the hull
+    vector<unsigned int> faces;		// triangles, three vertex indices each, counterclockwise seen from outside
+    vector<unsigned int> neighbourStart, neighbours;	// the vertices sharing an edge with vertex i are
+                                                        // neighbours[neighbourStart[i], neighbourStart[i + 1])
+    glm::vec3 lower, upper;			// box of the vertices
+
+    ConvexHull() : lower(FLT_MAX), upper(-FLT_MAX), visit(0), epsilon(0.0f) {}
+
+    // builds the hull of `n` points, each `stride` bytes after the previous one. Flat or degenerate clouds
+    // keep all their points and no faces, which the queries handle the same way.
+    void build(const glm::vec3 *points, unsigned int n, size_t stride = sizeof(glm::vec3))
+    {
+        vertices.clear();
+        faces.clear();
+        neighbourStart.clear();
+        neighbours.clear();
+        lower = glm::vec3(FLT_MAX);
+        upper = glm::vec3(-FLT_MAX);
+        cloud.resize(n);
+        for(unsigned int i = 0; i < n; i++)
+        {
+            cloud[i] = *(const glm::vec3 *)((const char *)points + i * stride);
+            lower = glm::min(lower, cloud[i]);
+            upper = glm::max(upper, cloud[i]);
+        }
+        if(n == 0)
+            return;
+        glm::vec3 extent = upper - lower;
+        epsilon = max(extent.x, max(extent.y, extent.z)) * 1e-5f;
+
+        unsigned int simplex[4];
+        if(n < 4 || !initialSimplex(simplex))
+        {
+            vertices = cloud;
+            release();
+            return;
+        }
+        for(int f = 0; f < 4; f++)
+        {
+            static const int corners[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 1, 3, 2 }, { 2, 3, 0 } };
+            addFace(simplex[corners[f][0]], simplex[corners[f][1]], simplex[corners[f][2]]);
+        }
+        vector<unsigned int> all;
+        for(unsigned int i = 0; i < n; i++)
+            if(i != simplex[0] && i != simplex[1] && i != simplex[2] && i != simplex[3])
+                all.push_back(i);
+        vector<unsigned int> created(hull.size());
+        for(unsigned int f = 0; f < hull.size(); f++)
+            created[f] = f;
+        assign(all, created);
+
+        // new faces are appended, so one pass over the array reaches them all
+        for(unsigned int f = 0; f < hull.size(); f++)
+            if(!hull[f].removed && !hull[f].outside.empty())
+                addPoint(f);
+
+        vector<int> remap(n, -1);
+        for(unsigned int f = 0; f < hull.size(); f++)
+        {
+            if(hull[f].removed)
+                continue;
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int v = hull[f].v[k];
+                if(remap[v] < 0)
+                {
+                    remap[v] = vertices.size();
+                    vertices.push_back(cloud[v]);
+                }
+                faces.push_back(remap[v]);
+            }
+        }
+        lower = glm::vec3(FLT_MAX);
+        upper = glm::vec3(-FLT_MAX);
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            lower = glm::min(lower, vertices[i]);
+            upper = glm::max(upper, vertices[i]);
+        }
+
+        // every edge is in two faces, once each way, so each face edge gives its first vertex one neighbour
+        neighbourStart.assign(vertices.size() + 1, 0);
+        for(unsigned int f = 0; f < faces.size(); f++)
+            neighbourStart[faces[f] + 1]++;
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            neighbourStart[i + 1] += neighbourStart[i];
+        neighbours.resize(faces.size());
+        vector<unsigned int> fill(neighbourStart.begin(), neighbourStart.end() - 1);
+        for(unsigned int f = 0; f < faces.size(); f += 3)
+            for(int k = 0; k < 3; k++)
+                neighbours[fill[faces[f + k]]++] = faces[f + (k + 1) % 3];
+        release();
+    }
+
+    bool empty() const { return vertices.empty(); }
+
+    // the index of the vertex farthest along `direction`, searched from vertex `start`
+    unsigned int support(const glm::vec3 &direction, unsigned int start = 0) const
+    {
+        if(neighbours.empty())
+        {
+            // no faces to walk: try them all
+            unsigned int best = 0;
+            float farthest = -FLT_MAX;
+            for(unsigned int i = 0; i < vertices.size(); i++)
+            {
+                float d = glm::dot(vertices[i], direction);
+                if(d > farthest)
+                {
+                    farthest = d;
+                    best = i;
+                }
+            }
+            return best;
+        }
+        // on a convex hull a vertex no neighbour improves on is the farthest
+        unsigned int best = start;
+        float farthest = glm::dot(vertices[best], direction);
+        for(bool moved = true; moved; )
+        {
+            moved = false;
+            for(unsigned int k = neighbourStart[best], end = neighbourStart[best + 1]; k < end; k++)
+            {
+                float d = glm::dot(vertices[neighbours[k]], direction);
+                if(d > farthest)
+                {
+                    farthest = d;
+                    best = neighbours[k];
+                    moved = true;
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    // whether hull `a` placed by the affine matrix `ma` overlaps hull `b` placed by `mb`. Touching counts as
+    // overlapping, and so does a query that doesn't settle within the iteration limit.
+    static bool intersect(const ConvexHull &a, const glm::mat4 &ma, const ConvexHull &b, const glm::mat4 &mb)
+    {
+        if(a.empty() || b.empty())
+            return false;
+        Placed pa(a, ma), pb(b, mb);
+        glm::vec3 direction = pb.center - pa.center;
+        if(glm::dot(direction, direction) < 1e-12f)
+            direction = glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 simplex[4];
+        int count = 1;
+        simplex[0] = pa.support(direction) - pb.support(-direction);
+        direction = -simplex[0];
+        for(int iteration = 0; iteration < MAX_ITERATIONS; iteration++)
+        {
+            if(glm::dot(direction, direction) < 1e-20f)
+                return true;
+            glm::vec3 p = pa.support(direction) - pb.support(-direction);
+            if(glm::dot(p, direction) < 0.0f)
+                return false;
+            // the newest point goes first
+            for(int k = count; k > 0; k--)
+                simplex[k] = simplex[k - 1];
+            simplex[0] = p;
+            count++;
+            if(nearestSimplex(simplex, count, direction))
+                return true;
+        }
+        return true;
+    }
+
+private:
+    static const int MAX_ITERATIONS = 64;
+
+    struct Face {
+        unsigned int v[3];
+        glm::vec3 normal;
+        float offset;
+        vector<unsigned int> outside;	// points above this face and no other face assigned before it
+        bool removed;
+    };
+
+    // a hull as the world sees it: supports are looked up in model space, from the last one, and brought over
+    struct Placed {
+        const ConvexHull &hull;
+        const glm::mat4 &matrix;
+        glm::mat3 transposed;
+        glm::vec3 center;
+        unsigned int last;
+
+        Placed(const ConvexHull &hull, const glm::mat4 &matrix)
+            : hull(hull), matrix(matrix), transposed(glm::transpose(glm::mat3(matrix))),
+              center(glm::vec3(matrix * glm::vec4((hull.lower + hull.upper) * 0.5f, 1.0f))), last(0) {}
+
+        glm::vec3 support(const glm::vec3 &direction)
+        {
+            last = hull.support(transposed * direction, last);
+            return glm::vec3(matrix * glm::vec4(hull.vertices[last], 1.0f));
+        }
+    };
+
+    // the working state of build()
+    vector<glm::vec3> cloud;
+    vector<Face> hull;
+    unordered_map<unsigned long long, unsigned int> edges;	// directed edge to the face it belongs to
+    vector<unsigned int> stamp;		// the addPoint() call that last looked at a face
+    vector<unsigned char> visible;
+    unsigned int visit;
+    float epsilon;
+
+    void release()
+    {
+        vector<glm::vec3>().swap(cloud);
+        vector<Face>().swap(hull);
+        edges.clear();
+        vector<unsigned int>().swap(stamp);
+        vector<unsigned char>().swap(visible);
+    }
+
+    static unsigned long long edgeKey(unsigned int a, unsigned int b) { return (unsigned long long)a << 32 | b; }
+
+    float distance(const Face &f, const glm::vec3 &p) const { return glm::dot(f.normal, p) - f.offset; }
+
+    // the two points farthest apart among the extremes along the axes, the point farthest from their line,
+    // and the point farthest from the plane of the three; fails if the cloud is flat
+    bool initialSimplex(unsigned int simplex[4]) const
+    {
+        unsigned int extremes[6] = { 0, 0, 0, 0, 0, 0 };
+        for(unsigned int i = 0; i < cloud.size(); i++)
+            for(int axis = 0; axis < 3; axis++)
+            {
+                if(cloud[i][axis] < cloud[extremes[2 * axis]][axis])
+                    extremes[2 * axis] = i;
+                if(cloud[i][axis] > cloud[extremes[2 * axis + 1]][axis])
+                    extremes[2 * axis + 1] = i;
+            }
+        float best = -1.0f;
+        for(int i = 0; i < 6; i++)
+            for(int j = i + 1; j < 6; j++)
+            {
+                glm::vec3 d = cloud[extremes[j]] - cloud[extremes[i]];
+                if(glm::dot(d, d) > best)
+                {
+                    best = glm::dot(d, d);
+                    simplex[0] = extremes[i];
+                    simplex[1] = extremes[j];
+                }
+            }
+        if(best <= epsilon * epsilon)
+            return false;
+
+        glm::vec3 a = cloud[simplex[0]], line = glm::normalize(cloud[simplex[1]] - a);
+        best = -1.0f;
+        for(unsigned int i = 0; i < cloud.size(); i++)
+        {
+            float d = glm::length(glm::cross(cloud[i] - a, line));
+            if(d > best)
+            {
+                best = d;
+                simplex[2] = i;
+            }
+        }
+        if(best <= epsilon)
+            return false;
+
+        glm::vec3 normal = glm::normalize(glm::cross(cloud[simplex[1]] - a, cloud[simplex[2]] - a));
+        best = -1.0f;
+        for(unsigned int i = 0; i < cloud.size(); i++)
+        {
+            float d = fabs(glm::dot(cloud[i] - a, normal));
+            if(d > best)
+            {
+                best = d;
+                simplex[3] = i;
+            }
+        }
+        if(best <= epsilon)
+            return false;
+        // faces are wound for the fourth point to be below the first
+        if(glm::dot(cloud[simplex[3]] - a, normal) > 0.0f)
+            swap(simplex[1], simplex[2]);
+        return true;
+    }
+
+    unsigned int addFace(unsigned int a, unsigned int b, unsigned int c)
+    {
+        Face f;
+        f.v[0] = a;
+        f.v[1] = b;
+        f.v[2] = c;
+        glm::vec3 n = glm::cross(cloud[b] - cloud[a], cloud[c] - cloud[a]);
+        float length = glm::length(n);
+        // a sliver sees nothing; its neighbours cover the points it would have
+        f.normal = length > 0.0f ? n / length : glm::vec3(0.0f);
+        f.offset = glm::dot(f.normal, cloud[a]);
+        f.removed = false;
+        unsigned int index = hull.size();
+        hull.push_back(f);
+        edges[edgeKey(a, b)] = index;
+        edges[edgeKey(b, c)] = index;
+        edges[edgeKey(c, a)] = index;
+        return index;
+    }
+
+    // gives each point to the face among `candidates` it is farthest above, or drops it as inside
+    void assign(const vector<unsigned int> &points, const vector<unsigned int> &candidates)
+    {
+        for(unsigned int i = 0; i < points.size(); i++)
+        {
+            float farthest = epsilon;
+            int best = -1;
+            for(unsigned int c = 0; c < candidates.size(); c++)
+            {
+                float d = distance(hull[candidates[c]], cloud[points[i]]);
+                if(d > farthest)
+                {
+                    farthest = d;
+                    best = candidates[c];
+                }
+            }
+            if(best >= 0)
+                hull[best].outside.push_back(points[i]);
+        }
+    }
+
+    // adds the farthest outside point of face `f` to the hull
+    void addPoint(unsigned int f)
+    {
+        unsigned int eye = hull[f].outside[0];
+        float farthest = -FLT_MAX;
+        for(unsigned int i = 0; i < hull[f].outside.size(); i++)
+        {
+            float d = distance(hull[f], cloud[hull[f].outside[i]]);
+            if(d > farthest)
+            {
+                farthest = d;
+                eye = hull[f].outside[i];
+            }
+        }
+        const glm::vec3 &p = cloud[eye];
+
+        // flood the faces the eye sees from `f`; an edge to a face it doesn't see is on the horizon
+        visit++;
+        stamp.resize(hull.size(), 0);
+        visible.resize(hull.size(), 0);
+        vector<unsigned int> seen(1, f), horizon;
+        stamp[f] = visit;
+        visible[f] = 1;
+        for(unsigned int s = 0; s < seen.size(); s++)
+        {
+            const Face &face = hull[seen[s]];
+            for(int k = 0; k < 3; k++)
+            {
+                unsigned int a = face.v[k], b = face.v[(k + 1) % 3];
+                unordered_map<unsigned long long, unsigned int>::const_iterator it = edges.find(edgeKey(b, a));
+                if(it == edges.end())
+                    continue;
+                unsigned int neighbour = it->second;
+                if(stamp[neighbour] != visit)
+                {
+                    stamp[neighbour] = visit;
+                    visible[neighbour] = !hull[neighbour].removed && distance(hull[neighbour], p) > epsilon;
+                    if(visible[neighbour])
+                        seen.push_back(neighbour);
+                }
+                if(!visible[neighbour])
+                {
+                    horizon.push_back(a);
+                    horizon.push_back(b);
+                }
+            }
+        }
+
+        vector<unsigned int> orphans;
+        for(unsigned int s = 0; s < seen.size(); s++)
+        {
+            Face &face = hull[seen[s]];
+            face.removed = true;
+            for(unsigned int i = 0; i < face.outside.size(); i++)
+                if(face.outside[i] != eye)
+                    orphans.push_back(face.outside[i]);
+            vector<unsigned int>().swap(face.outside);
+            for(int k = 0; k < 3; k++)
+                edges.erase(edgeKey(face.v[k], face.v[(k + 1) % 3]));
+        }
+        vector<unsigned int> created;
+        for(unsigned int h = 0; h < horizon.size(); h += 2)
+            created.push_back(addFace(horizon[h], horizon[h + 1], eye));
+        assign(orphans, created);
+    }
+
+    // GJK: reduces the simplex to the feature nearest the origin and points `direction` at the origin from
+    // it; true once the simplex encloses the origin. simplex[0] is the newest point.
+    static bool nearestSimplex(glm::vec3 *s, int &count, glm::vec3 &direction)
+    {
+        glm::vec3 a = s[0], ao = -a;
+        if(count == 2)
+            return nearestLine(s, count, direction);
+        if(count == 3)
+        {
+            glm::vec3 ab = s[1] - a, ac = s[2] - a, abc = glm::cross(ab, ac);
+            if(glm::dot(glm::cross(abc, ac), ao) > 0.0f)
+            {
+                if(glm::dot(ac, ao) > 0.0f)
+                {
+                    s[1] = s[2];
+                    count = 2;
+                    direction = glm::cross(glm::cross(ac, ao), ac);
+                    return degenerate(direction);
+                }
+                count = 2;
+                return nearestLine(s, count, direction);
+            }
+            if(glm::dot(glm::cross(ab, abc), ao) > 0.0f)
+            {
+                count = 2;
+                return nearestLine(s, count, direction);
+            }
+            float side = glm::dot(abc, ao);
+            if(side == 0.0f)
+                return true;
+            if(side > 0.0f)
+                direction = abc;
+            else
+            {
+                swap(s[1], s[2]);
+                direction = -abc;
+            }
+            return false;
+        }
+        // a tetrahedron: the origin is inside unless it is above one of the three faces through the newest point
+        glm::vec3 ab = s[1] - a, ac = s[2] - a, ad = s[3] - a;
+        glm::vec3 abc = glm::cross(ab, ac), acd = glm::cross(ac, ad), adb = glm::cross(ad, ab);
+        if(glm::dot(abc, ao) > 0.0f)
+        {
+            count = 3;
+            return nearestSimplex(s, count, direction);
+        }
+        if(glm::dot(acd, ao) > 0.0f)
+        {
+            s[1] = s[2];
+            s[2] = s[3];
+            count = 3;
+            return nearestSimplex(s, count, direction);
+        }
+        if(glm::dot(adb, ao) > 0.0f)
+        {
+            s[2] = s[1];
+            s[1] = s[3];
+            count = 3;
+            return nearestSimplex(s, count, direction);
+        }
+        return true;
+    }
+
+    static bool nearestLine(glm::vec3 *s, int &count, glm::vec3 &direction)
+    {
+        glm::vec3 ab = s[1] - s[0], ao = -s[0];
+        if(glm::dot(ab, ao) > 0.0f)
+        {
+            direction = glm::cross(glm::cross(ab, ao), ab);
+            return degenerate(direction);
+        }
+        count = 1;
+        direction = ao;
+        return false;
+    }
+
+    // the origin is on the segment when there is no direction off it
+    static bool degenerate(const glm::vec3 &direction) { return glm::dot(direction, direction) < 1e-20f; }
+};
+#endif
@@ -0,0 +1,176 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/job_system.h>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// Bounding sphere of an object in its own space.
+struct DrawBounds {
+    glm::vec3 center;
+    float radius;
+};
+
+// One draw for the GL thread to submit: which object and with what model matrix. The key orders the draws
+// by object first, so consecutive draws share textures and buffers, then front to back, then by instance.
+struct DrawCommand {
+    unsigned long long key;
+    unsigned int obj;
+    glm::mat4 model;
+};
+
+struct DrawListStats {
+    unsigned int visible;
+    unsigned int outside;		// culled by the view frustum
+    unsigned int tooSmall;		// culled by size on screen
+};
+
+// Builds the frame's draw commands from the instances on the worker threads. Every chunk of instances
+// is culled against the view frustum and by its size on screen, and what survives gets its sort key and
+// per-draw data packed into the command list of the thread running it. The lists are then merged and
+// sorted by key, ready for the GL thread, which only walks them and issues GL calls.
+class DrawListBuilder
+{
+public:
+    static const unsigned int CHUNK = 1024;
+
+    float minPixels;	// instances whose bounding sphere is smaller than this radius on screen are skipped
+
+    DrawListBuilder() : minPixels(0.5f) {}
+
+    void build(const vector<int> &models, const vector<glm::mat4> &world, const vector<DrawBounds> &bounds,
+               const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight, JobSystem *jobs,
+               vector<DrawCommand> &out, DrawListStats *stats = NULL)
+    {
+        glm::mat4 viewProjection = projection * view;
+        glm::vec4 planes[6];
+        for(int i = 0; i < 3; i++)
+        {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+            planes[2 * i] = w + row;
+            planes[2 * i + 1] = w - row;
+        }
+        for(int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+        // pixels per unit of radius at distance 1
+        float pixelScale = projection[1][1] * viewportHeight * 0.5f;
+        // the far plane's distance (of a perspective projection), to quantize depths
+        float farDistance = glm::max(projection[3][2] / (projection[2][2] + 1.0f), 1e-6f);
+
+        unsigned int threads = jobs ? jobs->threads() : 1;
+        perThread.resize(threads);
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            perThread[t].list.clear();
+            perThread[t].count = Counts();
+        }
+
+        JobSystem::Job job = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+            vector<DrawCommand> &list = perThread[thread].list;
+            Counts &count = perThread[thread].count;
+            for(unsigned int i = begin; i < end; i++)
+            {
+                int obj = models[i];
+                if(obj < 0)
+                    continue;
+                const glm::mat4 &m = world[i];
+                const DrawBounds &b = bounds[obj];
+                glm::vec3 center = glm::vec3(m * glm::vec4(b.center, 1.0f));
+                float scale = glm::max(glm::max(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1]))), glm::length(glm::vec3(m[2])));
+                float radius = b.radius * scale;
+
+                bool inside = true;
+                for(int p = 0; p < 6 && inside; p++)
+                    inside = glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -radius;
+                if(!inside)
+                {
+                    count.outside++;
+                    continue;
+                }
+                float depth = -(view * glm::vec4(center, 1.0f)).z;
+                if(depth > radius && radius * pixelScale < minPixels * depth)
+                {
+                    count.tooSmall++;
+                    continue;
+                }
+
+                DrawCommand command;
+                unsigned long long quantized = (unsigned long long)(glm::clamp(depth / farDistance, 0.0f, 1.0f) * 16777215.0f);
+                command.key = ((unsigned long long)obj << 48) | (quantized << 24) | (i & 0xffffff);
+                command.obj = obj;
+                command.model = m;
+                list.push_back(command);
+                count.visible++;
+            }
+        };
+        if(jobs)
+            jobs->parallelFor(models.size(), CHUNK, job);
+        else
+            job(0, models.size(), 0);
+
+        // every thread sorts its own list, then the sorted lists are merged one after the other through a
+        // scratch list kept between frames (inplace_merge would take a buffer from the heap every time)
+        JobSystem::Job sortList = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int t = begin; t < end; t++)
+                sort(perThread[t].list.begin(), perThread[t].list.end(), byKey);
+        };
+        if(jobs)
+            jobs->parallelFor(threads, 1, sortList);
+        else
+            sortList(0, threads, 0);
+        unsigned int total = 0;
+        for(unsigned int t = 0; t < threads; t++)
+            total += perThread[t].list.size();
+        out.resize(total);
+        unsigned int at = 0;
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            const vector<DrawCommand> &list = perThread[t].list;
+            if(at == 0)
+                copy(list.begin(), list.end(), out.begin());
+            else
+            {
+                merged.assign(out.begin(), out.begin() + at);
+                merge(merged.begin(), merged.end(), list.begin(), list.end(), out.begin(), byKey);
+            }
+            at += list.size();
+        }
+
+        if(stats)
+        {
+            DrawListStats s = { 0, 0, 0 };
+            for(unsigned int t = 0; t < threads; t++)
+            {
+                s.visible += perThread[t].count.visible;
+                s.outside += perThread[t].count.outside;
+                s.tooSmall += perThread[t].count.tooSmall;
+            }
+            *stats = s;
+        }
+    }
+
+private:
+    struct Counts {
+        unsigned int visible, outside, tooSmall;
+        Counts() : visible(0), outside(0), tooSmall(0) {}
+    };
+
+    // what each thread produces; the lists are kept between frames to reuse their storage, and the padding
+    // keeps threads from writing to the same cache line
+    struct ThreadList {
+        vector<DrawCommand> list;
+        Counts count;
+        char padding[64];
+    };
+    vector<ThreadList> perThread;
+    vector<DrawCommand> merged;
+
+    static bool byKey(const DrawCommand &a, const DrawCommand &b) { return a.key < b.key; }
+};
+#endif
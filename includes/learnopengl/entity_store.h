@@ -0,0 +1,123 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <vector>
+using namespace std;
+
+// A handle to an entity. The index picks a slot and the generation tells whether the slot still holds the
+// same entity: destroying an entity bumps its slot's generation, so old handles stop resolving instead of
+// silently pointing at whatever reuses the slot.
+struct Entity {
+    unsigned int index;
+    unsigned int generation;
+
+    bool operator==(const Entity &other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity &other) const { return !(*this == other); }
+};
+
+const Entity NO_ENTITY = { 0xffffffffu, 0 };
+
+// Slot map from entity handles to dense indices. Components live in plain arrays indexed by the dense index,
+// so iterating them is linear; destroy() keeps the arrays packed by moving the last entity into the hole,
+// and every component array does the same with swapRemove(). Create, destroy and lookup are O(1).
+class EntityStore
+{
+public:
+    EntityStore() : freeHead(NONE) {}
+
+    unsigned int size() const { return denseToSlot.size(); }
+
+    // creates an entity; its components go at dense index size() - 1.
+    Entity create()
+    {
+        unsigned int slot;
+        if(freeHead != NONE)
+        {
+            slot = freeHead;
+            freeHead = slots[slot].dense;
+        }
+        else
+        {
+            slot = slots.size();
+            Slot fresh = { 0, 0 };
+            slots.push_back(fresh);
+        }
+        slots[slot].dense = denseToSlot.size();
+        denseToSlot.push_back(slot);
+        Entity entity = { slot, slots[slot].generation };
+        return entity;
+    }
+
+    // destroys an entity and returns the dense index it had, or -1 for a stale handle. The caller must
+    // swapRemove() that index from every component array.
+    int destroy(Entity entity)
+    {
+        int dense = indexOf(entity);
+        if(dense < 0)
+            return -1;
+        unsigned int last = denseToSlot.back();
+        denseToSlot[dense] = last;
+        slots[last].dense = dense;
+        denseToSlot.pop_back();
+
+        Slot &slot = slots[entity.index];
+        slot.generation++;
+        slot.dense = freeHead;
+        freeHead = entity.index;
+        return dense;
+    }
+
+    bool alive(Entity entity) const { return indexOf(entity) >= 0; }
+
+    // the dense index of an entity, -1 if it no longer exists
+    int indexOf(Entity entity) const
+    {
+        if(entity.index >= slots.size() || slots[entity.index].generation != entity.generation)
+            return -1;
+        // a free slot's generation was bumped when it was freed, so it can't match a live handle
+        return slots[entity.index].dense;
+    }
+
+    // the entity at a dense index
+    Entity at(unsigned int dense) const
+    {
+        unsigned int slot = denseToSlot[dense];
+        Entity entity = { slot, slots[slot].generation };
+        return entity;
+    }
+
+    void clear()
+    {
+        // keep the generations so handles from before the clear stay dead
+        for(unsigned int i = 0; i < denseToSlot.size(); i++)
+        {
+            Slot &slot = slots[denseToSlot[i]];
+            slot.generation++;
+            slot.dense = freeHead;
+            freeHead = denseToSlot[i];
+        }
+        denseToSlot.clear();
+    }
+
+private:
+    static const unsigned int NONE = 0xffffffffu;
+
+    struct Slot {
+        unsigned int dense;			// dense index while alive, next free slot while free
+        unsigned int generation;
+    };
+
+    vector<Slot> slots;
+    vector<unsigned int> denseToSlot;
+    unsigned int freeHead;
+};
+
+// removes element i by moving the last element into its place, the same way EntityStore::destroy does.
+template <typename T>
+void swapRemove(vector<T> &v, unsigned int i)
+{
+    if(i + 1 < v.size())
+        v[i] = v.back();
+    v.pop_back();
+}
+#endif
@@ -0,0 +1,62 @@
+#ifndef FLOAT4_H
+#define FLOAT4_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Four floats worked on together: SSE registers, or plain loops without SSE. Comparisons give masks that
+// only select(), the logic operators and bits() look at.
+#ifdef __SSE2__
+struct Float4 {
+    __m128 v;
+
+    Float4() {}
+    Float4(__m128 v) : v(v) {}
+    Float4(float f) : v(_mm_set1_ps(f)) {}
+    Float4(float a, float b, float c, float d) : v(_mm_set_ps(d, c, b, a)) {}
+
+    float operator[](int i) const { float f[4]; _mm_storeu_ps(f, v); return f[i]; }
+};
+// four consecutive floats, aligned or not
+inline Float4 loadFloat4(const float *p) { return _mm_loadu_ps(p); }
+inline void storeFloat4(float *p, Float4 a) { _mm_storeu_ps(p, a.v); }
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+inline Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 operator<(Float4 a, Float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline Float4 operator<=(Float4 a, Float4 b) { return _mm_cmple_ps(a.v, b.v); }
+inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline int bits(Float4 mask) { return _mm_movemask_ps(mask.v); }
+#else
+struct Float4 {
+    float v[4];
+
+    Float4() {}
+    Float4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+    Float4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+
+    float operator[](int i) const { return v[i]; }
+};
+inline Float4 loadFloat4(const float *p) { return Float4(p[0], p[1], p[2], p[3]); }
+inline void storeFloat4(float *p, Float4 a) { for(int i = 0; i < 4; i++) p[i] = a.v[i]; }
+#define FLOAT4_OP(name, expr) \
+    inline Float4 name(Float4 a, Float4 b) { Float4 r; for(int i = 0; i < 4; i++) r.v[i] = (expr); return r; }
+FLOAT4_OP(operator+, a.v[i] + b.v[i])
+FLOAT4_OP(operator-, a.v[i] - b.v[i])
+FLOAT4_OP(operator*, a.v[i] * b.v[i])
+FLOAT4_OP(operator/, a.v[i] / b.v[i])
+FLOAT4_OP(min, b.v[i] < a.v[i] ? b.v[i] : a.v[i])
+FLOAT4_OP(max, b.v[i] > a.v[i] ? b.v[i] : a.v[i])
+FLOAT4_OP(operator<, a.v[i] < b.v[i] ? 1.0f : 0.0f)
+FLOAT4_OP(operator<=, a.v[i] <= b.v[i] ? 1.0f : 0.0f)
+FLOAT4_OP(operator&, a.v[i] != 0.0f && b.v[i] != 0.0f ? 1.0f : 0.0f)
+#undef FLOAT4_OP
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { Float4 r; for(int i = 0; i < 4; i++) r.v[i] = mask.v[i] != 0.0f ? a.v[i] : b.v[i]; return r; }
+inline int bits(Float4 mask) { int r = 0; for(int i = 0; i < 4; i++) r |= (mask.v[i] != 0.0f) << i; return r; }
+#endif
+#endif
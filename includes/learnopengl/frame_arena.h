@@ -0,0 +1,207 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <cstddef>
+#include <cstdio>
+using namespace std;
+
+// Scratch memory for the data a thread only needs during one frame: culling lists, interpolated matrices,
+// uniform names and the like. Every thread has an arena of its own (FrameArena::local()); allocating bumps a
+// pointer through its block and freeing does nothing, until the thread calls reset() at the end of its frame
+// and everything is free again at once. A frame that doesn't fit chains more blocks from the heap, and the
+// next reset() trades them for a single block as large as they were together, so once a scene has run for a
+// few frames the arena no longer touches the heap. The high-water mark tells how large the first block should
+// be (--frame-arena KB).
+//
+// An arena belongs to its thread: memory from it must not outlive the thread's frame, and a thread that
+// allocates from its arena has to reset it every frame, or it keeps growing.
+class FrameArena
+{
+public:
+    static const size_t ALIGNMENT = 16;
+
+    string name;	// shown in the statistics
+
+    // the calling thread's arena, created and registered the first time the thread asks for it
+    static FrameArena &local()
+    {
+        static thread_local FrameArena *arena = NULL;
+        if(!arena)
+        {
+            arena = new FrameArena(initialCapacity());
+            lock_guard<mutex> lock(registryMutex());
+            registry().push_back(arena);
+            char name[32];
+            snprintf(name, sizeof(name), "thread %u", (unsigned int)registry().size());
+            arena->name = name;
+        }
+        return *arena;
+    }
+
+    // every arena created so far; they are never freed, like the threads' profiler buffers
+    static vector<FrameArena*> all()
+    {
+        lock_guard<mutex> lock(registryMutex());
+        return registry();
+    }
+
+    // the size of the first block of the arenas created from now on
+    static size_t &initialCapacity()
+    {
+        static size_t capacity = 256 * 1024;
+        return capacity;
+    }
+
+    // `alignment` must be a power of two
+    void *allocate(size_t bytes, size_t alignment = ALIGNMENT)
+    {
+        size_t at = head ? aligned(head, offset, alignment) : 0;
+        if(head == NULL || at + bytes > head->size)
+        {
+            // a new block on top of the old ones, which stay valid until the reset
+            size_t size = head ? head->size * 2 : ALIGNMENT;
+            while(size < bytes + alignment)
+                size *= 2;
+            Block *block = (Block*)::operator new(sizeof(Block) + size);
+            block->next = head;
+            block->size = size;
+            head = block;
+            blockCount++;
+            reserved += size;
+            usedBefore += offset;
+            at = aligned(block, 0, alignment);
+        }
+        offset = at + bytes;
+        return data(head) + at;
+    }
+
+    // makes all of the frame's memory free again; more than one block is merged into a single larger one
+    void reset()
+    {
+        size_t used = usedBefore + offset;
+        if(used > highWater.load(memory_order_relaxed))
+            highWater.store(used, memory_order_relaxed);
+        if(blockCount > 1)
+        {
+            size_t size = reserved;
+            release();
+            Block *block = (Block*)::operator new(sizeof(Block) + size);
+            block->next = NULL;
+            block->size = size;
+            head = block;
+            blockCount = 1;
+            reserved = size;
+            grown.fetch_add(1, memory_order_relaxed);
+        }
+        capacityBytes.store(reserved, memory_order_relaxed);
+        offset = 0;
+        usedBefore = 0;
+    }
+
+    // the most a frame of this thread used, and what the arena holds now; safe to read from any thread
+    size_t highWaterMark() const { return highWater.load(memory_order_relaxed); }
+    size_t capacity() const { return capacityBytes.load(memory_order_relaxed); }
+    // how many frames didn't fit and made the arena grow
+    unsigned int growCount() const { return grown.load(memory_order_relaxed); }
+
+private:
+    struct Block {
+        Block *next;
+        size_t size;
+    };
+
+    Block *head;				// the block being filled, the older ones follow it
+    unsigned int blockCount;
+    size_t offset;				// into the head block
+    size_t usedBefore;			// by the frame in the blocks behind the head
+    size_t reserved;			// all blocks together
+    atomic<size_t> highWater, capacityBytes;
+    atomic<unsigned int> grown;
+
+    FrameArena(size_t capacity) : head(NULL), blockCount(0), offset(0), usedBefore(0), reserved(0), highWater(0),
+        capacityBytes(0), grown(0)
+    {
+        if(capacity > 0)
+        {
+            head = (Block*)::operator new(sizeof(Block) + capacity);
+            head->next = NULL;
+            head->size = capacity;
+            blockCount = 1;
+            reserved = capacity;
+            capacityBytes.store(capacity, memory_order_relaxed);
+        }
+    }
+
+    FrameArena(const FrameArena &);
+    FrameArena &operator=(const FrameArena &);
+
+    static char *data(Block *block)
+    {
+        return (char*)(block + 1);
+    }
+
+    static size_t aligned(Block *block, size_t offset, size_t alignment)
+    {
+        size_t address = (size_t)(data(block) + offset);
+        return offset + ((alignment - address % alignment) & (alignment - 1));
+    }
+
+    void release()
+    {
+        while(head)
+        {
+            Block *next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+
+    static vector<FrameArena*> &registry()
+    {
+        static vector<FrameArena*> arenas;
+        return arenas;
+    }
+
+    static mutex &registryMutex()
+    {
+        static mutex m;
+        return m;
+    }
+};
+
+// STL allocator on a frame arena, by default the calling thread's; deallocation is a no-op. Containers using
+// it are scratch of the frame that made them and must not be grown by other threads.
+template<class T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+    template<class U> struct rebind { typedef FrameAllocator<U> other; };
+
+    FrameArena *arena;
+
+    FrameAllocator() : arena(&FrameArena::local()) {}
+    FrameAllocator(FrameArena &arena) : arena(&arena) {}
+    template<class U> FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n)
+    {
+        return (T*)arena->allocate(n * sizeof(T), alignof(T) > FrameArena::ALIGNMENT ? alignof(T) : FrameArena::ALIGNMENT);
+    }
+
+    void deallocate(T *, size_t) {}
+};
+
+template<class T, class U>
+inline bool operator==(const FrameAllocator<T> &a, const FrameAllocator<U> &b) { return a.arena == b.arena; }
+template<class T, class U>
+inline bool operator!=(const FrameAllocator<T> &a, const FrameAllocator<U> &b) { return a.arena != b.arena; }
+
+template<class T> using FrameVector = vector<T, FrameAllocator<T> >;
+typedef basic_string<char, char_traits<char>, FrameAllocator<char> > FrameString;
+#endif
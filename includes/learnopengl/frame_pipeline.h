@@ -0,0 +1,112 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+// Hands frames from a producer thread to a consumer thread through three slots: the producer fills one
+// while the consumer reads another, and the third holds the frame published last, waiting to be taken.
+// A published frame is never touched by the producer again until the consumer moved on from it, so the
+// consumer can read it without locking. publish() waits while the previous frame wasn't taken yet, which
+// keeps the producer at most one frame ahead instead of doing work that would be thrown away.
+template <typename T>
+class FramePipeline
+{
+public:
+    FramePipeline() : writing(0), pending(-1), reading(-1), closed(false) {}
+
+    // the slot the producer fills next
+    T &writeSlot() { return slots[writing]; }
+
+    // hands the filled slot to the consumer; returns false once the pipeline was closed.
+    bool publish()
+    {
+        unique_lock<mutex> lock(m);
+        taken.wait(lock, [this] { return pending < 0 || closed; });
+        if(closed)
+            return false;
+        pending = writing;
+        for(writing = 0; writing == pending || writing == reading; writing++)
+            ;
+        lock.unlock();
+        ready.notify_one();
+        return true;
+    }
+
+    // waits for the next published frame and returns it, NULL once the pipeline was closed. The frame
+    // stays valid until the next call.
+    const T *acquire()
+    {
+        unique_lock<mutex> lock(m);
+        ready.wait(lock, [this] { return pending >= 0 || closed; });
+        if(closed)
+            return NULL;
+        reading = pending;
+        pending = -1;
+        lock.unlock();
+        taken.notify_one();
+        return &slots[reading];
+    }
+
+    // wakes both sides up and makes them return
+    void close()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            closed = true;
+        }
+        ready.notify_all();
+        taken.notify_all();
+    }
+
+private:
+    T slots[3];
+    int writing, pending, reading;		// slot indices, -1 for none
+    bool closed;
+    mutex m;
+    condition_variable ready, taken;
+};
+
+// Time from reading a frame's input to presenting it, in seconds: a rolling window for the recent frames
+// plus totals over the whole run.
+struct LatencyStats {
+    static const unsigned int WINDOW = 120;
+
+    double samples[WINDOW];
+    unsigned int count;		// number of samples ever taken
+    double total, worst;
+
+    LatencyStats() : count(0), total(0.0), worst(0.0) {}
+
+    void add(double latency)
+    {
+        samples[count % WINDOW] = latency;
+        count++;
+        total += latency;
+        if(latency > worst)
+            worst = latency;
+    }
+
+    unsigned int size() const { return count < WINDOW ? count : WINDOW; }
+
+    double average() const
+    {
+        double sum = 0.0;
+        for(unsigned int i = 0; i < size(); i++)
+            sum += samples[i];
+        return size() ? sum / size() : 0.0;
+    }
+
+    double maximum() const
+    {
+        double result = 0.0;
+        for(unsigned int i = 0; i < size(); i++)
+            if(samples[i] > result)
+                result = samples[i];
+        return result;
+    }
+
+    double overallAverage() const { return count ? total / count : 0.0; }
+};
+#endif
@@ -0,0 +1,194 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/frame_arena.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+// Rolling statistics of one timed pass, in seconds.
+struct GpuPassStats {
+    static const unsigned int WINDOW = 120;
+
+    string name;
+    double last;
+    double samples[WINDOW];
+    unsigned int count;		// number of samples ever taken
+
+    GpuPassStats(const string &name) : name(name), last(0.0), count(0) {}
+
+    void add(double time)
+    {
+        last = time;
+        samples[count % WINDOW] = time;
+        count++;
+    }
+
+    unsigned int size() const { return count < WINDOW ? count : WINDOW; }
+
+    double average() const
+    {
+        double sum = 0.0;
+        for(unsigned int i = 0; i < size(); i++)
+            sum += samples[i];
+        return size() ? sum / size() : 0.0;
+    }
+
+    double maximum() const
+    {
+        double result = 0.0;
+        for(unsigned int i = 0; i < size(); i++)
+            if(samples[i] > result)
+                result = samples[i];
+        return result;
+    }
+};
+
+// A finished measurement handed out by GpuTimer::nextFrame.
+struct GpuTiming {
+    unsigned int pass;
+    double time;
+};
+
+// Times render passes on the GPU without ever waiting for it. Every pass writes a GL_TIMESTAMP query at
+// its begin and end (so passes may nest); queries are kept in a ring of FRAMES frames, and a frame's results
+// are only read once GL_QUERY_RESULT_AVAILABLE says so, typically two or three frames later. A frame whose
+// results are still pending when its slot comes around again is dropped rather than waited on.
+class GpuTimer
+{
+public:
+    static const unsigned int FRAMES = 4;
+    static const unsigned int MAX_PASSES = 8;
+    static const unsigned int NO_PASS = ~0u;	// handed out once all passes are taken, begin() and end() ignore it
+
+    vector<GpuPassStats> passes;
+    unsigned int droppedFrames;
+
+    GpuTimer() : droppedFrames(0), frame(0), initialized(false), warnedFull(false) {}
+
+    // creates the query objects; needs a current context.
+    void init()
+    {
+        glGenQueries(FRAMES * MAX_PASSES * 2, &queries[0][0][0]);
+        memset(written, 0, sizeof(written));
+        memset(pending, 0, sizeof(pending));
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if(initialized)
+            glDeleteQueries(FRAMES * MAX_PASSES * 2, &queries[0][0][0]);
+        initialized = false;
+    }
+
+    // returns the id of a named pass, registering it the first time.
+    unsigned int pass(const string &name)
+    {
+        for(unsigned int i = 0; i < passes.size(); i++)
+            if(passes[i].name == name)
+                return i;
+        if(passes.size() == MAX_PASSES)
+        {
+            if(!warnedFull)
+                cout << "ERROR::GPU_TIMER:: More than " << MAX_PASSES << " passes, " << name << " is not timed" << endl;
+            warnedFull = true;
+            return NO_PASS;
+        }
+        passes.push_back(GpuPassStats(name));
+        return passes.size() - 1;
+    }
+
+    void begin(unsigned int pass)
+    {
+        if(!initialized || pass >= MAX_PASSES)
+            return;
+        glQueryCounter(queries[slot()][pass][0], GL_TIMESTAMP);
+    }
+
+    void end(unsigned int pass)
+    {
+        if(!initialized || pass >= MAX_PASSES)
+            return;
+        glQueryCounter(queries[slot()][pass][1], GL_TIMESTAMP);
+        written[slot()][pass] = true;
+    }
+
+    // closes the current frame, then reads back every older frame whose queries have all completed.
+    // The new results are appended to `results` (if given) in addition to the rolling statistics.
+    void nextFrame(FrameVector<GpuTiming> *results = NULL)
+    {
+        if(!initialized)
+            return;
+        pending[slot()] = true;
+        frame++;
+
+        // oldest first, so results come out in submission order
+        for(unsigned int age = FRAMES; age > 0; age--)
+        {
+            unsigned int s = (frame - age) % FRAMES;
+            if(frame < age || !pending[s])
+                continue;
+            if(!available(s))
+                break;
+            read(s, results);
+        }
+        // the slot we're about to reuse is still in flight: give up on it instead of stalling
+        if(pending[slot()])
+        {
+            droppedFrames++;
+            pending[slot()] = false;
+            memset(written[slot()], 0, sizeof(written[slot()]));
+        }
+    }
+
+private:
+    unsigned int queries[FRAMES][MAX_PASSES][2];
+    bool written[FRAMES][MAX_PASSES];
+    bool pending[FRAMES];
+    unsigned int frame;
+    bool initialized;
+    bool warnedFull;			// about a pass that didn't fit
+
+    unsigned int slot() const { return frame % FRAMES; }
+
+    bool available(unsigned int s) const
+    {
+        for(unsigned int p = 0; p < passes.size(); p++)
+        {
+            if(!written[s][p])
+                continue;
+            GLint done = 0;
+            glGetQueryObjectiv(queries[s][p][1], GL_QUERY_RESULT_AVAILABLE, &done);
+            if(!done)
+                return false;
+        }
+        return true;
+    }
+
+    void read(unsigned int s, FrameVector<GpuTiming> *results)
+    {
+        for(unsigned int p = 0; p < passes.size(); p++)
+        {
+            if(!written[s][p])
+                continue;
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[s][p][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[s][p][1], GL_QUERY_RESULT, &end);
+            GpuTiming timing;
+            timing.pass = p;
+            timing.time = (end - begin) * 1e-9;
+            passes[p].add(timing.time);
+            if(results)
+                results->push_back(timing);
+            written[s][p] = false;
+        }
+        pending[s] = false;
+    }
+};
+#endif
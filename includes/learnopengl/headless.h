@@ -0,0 +1,173 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+// keep the X11 headers (and their macros) out, we never talk to a display server
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <iostream>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// An OpenGL 3.3 core context without a window or display. The context is created surfaceless through EGL
+// (Mesa's software rasterizer is enough) and everything is drawn into an offscreen framebuffer, so the same
+// Model/Mesh/Shader code paths as the windowed app can run on machines without a GPU or display.
+class HeadlessContext
+{
+public:
+    unsigned int width, height;
+    unsigned int FBO;
+
+    HeadlessContext() : width(0), height(0), FBO(0), display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), colorRBO(0), depthRBO(0) {}
+
+    // creates the context, makes it current, loads the GL functions and sets up a framebuffer of the given size.
+    // ------------------------------------------------------------------------
+    bool create(unsigned int width, unsigned int height)
+    {
+        this->width = width;
+        this->height = height;
+
+        // prefer the surfaceless platform so no display server is ever touched
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if(getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if(display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            std::cout << "ERROR::HEADLESS:: Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        if(!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "ERROR::HEADLESS:: EGL has no desktop OpenGL support" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint nConfigs = 0;
+        eglChooseConfig(display, configAttribs, &config, 1, &nConfigs);
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, nConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+        if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::HEADLESS:: Failed to create a surfaceless OpenGL 3.3 context" << std::endl;
+            return false;
+        }
+
+        if(!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+
+        // there is no default framebuffer, so render into our own
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    // gives the framebuffer a new size, keeping the context and everything loaded into it.
+    // ------------------------------------------------------------------------
+    void resize(unsigned int width, unsigned int height)
+    {
+        if(width == this->width && height == this->height)
+            return;
+        this->width = width;
+        this->height = height;
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glViewport(0, 0, width, height);
+    }
+
+    // reads the current frame back and writes it as a binary PPM image.
+    // ------------------------------------------------------------------------
+    bool saveFrame(const std::string &path) const
+    {
+        std::vector<unsigned char> pixels(width * height * 3);
+        readPixels(&pixels[0]);
+
+        FILE *file = fopen(path.c_str(), "wb");
+        if(!file)
+        {
+            std::cout << "ERROR::HEADLESS:: Could not write frame to " << path << std::endl;
+            return false;
+        }
+        fprintf(file, "P6\n%u %u\n255\n", width, height);
+        // GL rows start at the bottom, image rows at the top
+        for(int y = height - 1; y >= 0; y--)
+            fwrite(&pixels[y * width * 3], 1, width * 3, file);
+        fclose(file);
+        return true;
+    }
+
+    // reads the framebuffer as tightly packed RGB rows, bottom row first.
+    void readPixels(unsigned char *rgb) const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, rgb);
+    }
+
+    void destroy()
+    {
+        if(FBO)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteRenderbuffers(1, &colorRBO);
+            glDeleteRenderbuffers(1, &depthRBO);
+            FBO = 0;
+        }
+        if(display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if(context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+            context = EGL_NO_CONTEXT;
+        }
+    }
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+    unsigned int colorRBO, depthRBO;
+};
+#endif
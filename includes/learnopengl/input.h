@@ -0,0 +1,137 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+using namespace std;
+
+enum InputCommandType {
+    INPUT_PRESSED,
+    INPUT_RELEASED
+};
+
+// A change of an action's state, queued when it happens and consumed by the next frame.
+struct InputCommand {
+    int action;
+    InputCommandType type;
+};
+
+// Event driven keyboard and mouse button input. Keys and buttons are mapped to application defined actions;
+// GLFW's key and mouse button callbacks turn presses/releases into queued commands, and once per frame
+// beginFrame() consumes the queue and updates which actions are held, were pressed (rising edge) or were
+// released (falling edge). Nothing ever polls or waits for a key.
+class Input
+{
+public:
+    Input(int nActions = 0) { resize(nActions); }
+
+    void resize(int nActions)
+    {
+        held.assign(nActions, false);
+        down.assign(nActions, false);
+        pressedEdge.assign(nActions, false);
+        releasedEdge.assign(nActions, false);
+    }
+
+    // maps a GLFW key to an action; a key can drive several actions and an action can have several keys.
+    void bind(int key, int action)
+    {
+        bindings.insert(make_pair(key, action));
+    }
+
+    // maps a GLFW mouse button to an action, like bind() does keys.
+    void bindMouseButton(int button, int action)
+    {
+        buttonBindings.insert(make_pair(button, action));
+    }
+
+    // installs the key and mouse button callbacks on a window; the window's user pointer is used to find this object.
+    void attach(GLFWwindow *window)
+    {
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    }
+
+    // queues a command as if it came from a key, e.g. for scripted input.
+    void push(int action, InputCommandType type)
+    {
+        InputCommand command;
+        command.action = action;
+        command.type = type;
+        queue.push_back(command);
+    }
+
+    // consumes the commands queued since the previous frame and updates the action states.
+    void beginFrame()
+    {
+        frameCommands.swap(queue);
+        queue.clear();
+        for(unsigned int i = 0; i < held.size(); i++)
+        {
+            pressedEdge[i] = false;
+            releasedEdge[i] = false;
+        }
+        for(unsigned int i = 0; i < frameCommands.size(); i++)
+        {
+            int action = frameCommands[i].action;
+            if(action < 0 || action >= (int)held.size())
+                continue;
+            if(frameCommands[i].type == INPUT_PRESSED)
+            {
+                if(!down[action])
+                    pressedEdge[action] = true;
+                down[action] = true;
+            }
+            else
+            {
+                if(down[action])
+                    releasedEdge[action] = true;
+                down[action] = false;
+            }
+        }
+        // a tap that starts and ends within one frame still counts as held for that frame
+        for(unsigned int i = 0; i < held.size(); i++)
+            held[i] = down[i] || pressedEdge[i];
+    }
+
+    bool isHeld(int action) const { return held[action]; }
+    bool wasPressed(int action) const { return pressedEdge[action]; }
+    bool wasReleased(int action) const { return releasedEdge[action]; }
+
+    // the commands consumed by the current frame, in the order they happened
+    const vector<InputCommand> &commands() const { return frameCommands; }
+
+private:
+    multimap<int, int> bindings;
+    multimap<int, int> buttonBindings;
+    vector<InputCommand> queue;
+    vector<InputCommand> frameCommands;
+    vector<bool> held, down, pressedEdge, releasedEdge;
+
+    void onEvent(const multimap<int, int> &map, int key, int keyAction)
+    {
+        if(keyAction == GLFW_REPEAT)
+            return;
+        pair<multimap<int, int>::const_iterator, multimap<int, int>::const_iterator> range = map.equal_range(key);
+        for(multimap<int, int>::const_iterator it = range.first; it != range.second; ++it)
+            push(it->second, keyAction == GLFW_PRESS ? INPUT_PRESSED : INPUT_RELEASED);
+    }
+
+    static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+    {
+        Input *input = (Input*)glfwGetWindowUserPointer(window);
+        if(input)
+            input->onEvent(input->bindings, key, action);
+    }
+
+    static void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods)
+    {
+        Input *input = (Input*)glfwGetWindowUserPointer(window);
+        if(input)
+            input->onEvent(input->buttonBindings, button, action);
+    }
+};
+#endif
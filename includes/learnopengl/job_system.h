@@ -0,0 +1,177 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
+#include <cstddef>
+using namespace std;
+
+// A fixed pool of worker threads for data parallel loops. parallelFor() splits a range into chunks that the
+// workers and the calling thread take from a shared counter until none are left, and returns when the whole
+// range is done, so callers see it as an ordinary (faster) loop. Workers sleep between loops.
+class JobSystem
+{
+public:
+    // A job gets a chunk [begin, end) and the index of the thread running it, 0 being the caller. Jobs are
+    // made from lambdas every frame, so unlike std::function, which goes to the heap for any closure larger
+    // than two pointers, a Job keeps the closure inside itself; capturing by reference always fits.
+    class Job
+    {
+    public:
+        static const size_t CAPACITY = 128;
+
+        template<class F> Job(const F &f) : invoke(&call<F>), clone(&copy<F>), destroy(&drop<F>)
+        {
+            static_assert(sizeof(F) <= CAPACITY, "the job's closure is too large, capture by reference");
+            static_assert(alignof(F) <= alignof(max_align_t), "the job's closure is over-aligned");
+            new(storage) F(f);
+        }
+
+        Job(const Job &other) : invoke(other.invoke), clone(other.clone), destroy(other.destroy)
+        {
+            clone(other.storage, storage);
+        }
+
+        Job &operator=(const Job &other)
+        {
+            if(this != &other)
+            {
+                destroy(storage);
+                invoke = other.invoke;
+                clone = other.clone;
+                destroy = other.destroy;
+                clone(other.storage, storage);
+            }
+            return *this;
+        }
+
+        ~Job() { destroy(storage); }
+
+        void operator()(unsigned int begin, unsigned int end, unsigned int thread) const
+        {
+            invoke(storage, begin, end, thread);
+        }
+
+    private:
+        alignas(max_align_t) unsigned char storage[CAPACITY];
+        void (*invoke)(const void *f, unsigned int begin, unsigned int end, unsigned int thread);
+        void (*clone)(const void *from, void *to);
+        void (*destroy)(void *f);
+
+        template<class F> static void call(const void *f, unsigned int begin, unsigned int end, unsigned int thread)
+        {
+            (*(const F*)f)(begin, end, thread);
+        }
+        template<class F> static void copy(const void *from, void *to) { new(to) F(*(const F*)from); }
+        template<class F> static void drop(void *f) { ((F*)f)->~F(); }
+    };
+
+    // `threads` counts the caller too; 0 uses one per hardware thread.
+    JobSystem(unsigned int threads = 0) : job(NULL), count(0), grain(1), limit(0), active(0), generation(0), busy(0), quit(false)
+    {
+        if(threads == 0)
+            threads = thread::hardware_concurrency();
+        for(unsigned int i = 1; i < threads; i++)
+            workers.push_back(thread(&JobSystem::work, this, i));
+        limit = this->threads();
+    }
+
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            quit = true;
+        }
+        wake.notify_all();
+        for(unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned int threads() const { return workers.size() + 1; }
+
+    // lets the following loops run on at most `n` threads, the caller included, while another pool shares the
+    // cores; 0 gives them all back. Only the thread calling parallelFor() may change it.
+    void limitThreads(unsigned int n)
+    {
+        limit = n == 0 || n > threads() ? threads() : n;
+    }
+
+    // runs `f` over [0, n) in chunks of `chunk` items.
+    void parallelFor(unsigned int n, unsigned int chunk, const Job &f)
+    {
+        if(chunk == 0)
+            chunk = 1;
+        if(workers.empty() || n <= chunk || limit <= 1)
+        {
+            for(unsigned int begin = 0; begin < n; begin += chunk)
+                f(begin, begin + chunk < n ? begin + chunk : n, 0);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(m);
+            job = &f;
+            count = n;
+            grain = chunk;
+            active = limit;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        run(0);
+        unique_lock<mutex> lock(m);
+        done.wait(lock, [this] { return busy == 0; });
+        job = NULL;
+    }
+
+private:
+    vector<thread> workers;
+    mutex m;
+    condition_variable wake, done;
+    const Job *job;
+    unsigned int count, grain;
+    unsigned int limit;				// threads the next loops may use
+    unsigned int active;			// threads the current loop uses, workers past it sit it out
+    atomic<unsigned int> next;		// first item of the next chunk to hand out
+    unsigned int generation;		// bumped for every loop, so workers know there's new work
+    unsigned int busy;				// workers that didn't finish the current loop yet
+    bool quit;
+
+    void run(unsigned int index)
+    {
+        for(;;)
+        {
+            unsigned int begin = next.fetch_add(grain);
+            if(begin >= count)
+                return;
+            (*job)(begin, begin + grain < count ? begin + grain : count, index);
+        }
+    }
+
+    void work(unsigned int index)
+    {
+        unsigned int seen = 0;
+        for(;;)
+        {
+            {
+                unique_lock<mutex> lock(m);
+                wake.wait(lock, [this, seen] { return quit || generation != seen; });
+                if(quit)
+                    return;
+                seen = generation;
+            }
+            if(index < active)
+                run(index);
+            {
+                lock_guard<mutex> lock(m);
+                busy--;
+            }
+            done.notify_one();
+        }
+    }
+};
+#endif
@@ -7,12 +7,16 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/profiler.h>
+#include <learnopengl/frame_arena.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <cstdio>
 using namespace std;
 
 struct Vertex {
@@ -29,9 +33,16 @@ struct Vertex {
 };
 
 struct Texture {
-    unsigned int id;
+    unsigned int id;	// the GL_TEXTURE_2D_ARRAY this texture was packed into
     string type;
     string path;
+    // image properties, used to pack textures of the same size and format into one array
+    int width;
+    int height;
+    int nrComponents;
+    // layer inside the array and texture unit the array is bound to (see Model::packTextureArrays)
+    int layer;
+    unsigned int unit;
 };
 
 class Mesh {
@@ -43,53 +54,71 @@ public:
     unsigned int VAO;
 
     /*  Functions  */
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, takes over the contents of the vectors instead of copying them (pass them with std::move)
+    Mesh(vector<Vertex> &&vertices, vector<unsigned int> &&indices, vector<Texture> &&textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices.swap(vertices);
+        this->indices.swap(indices);
+        this->textures.swap(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader shader) 
+    // render the mesh. The texture arrays are expected to be bound already (see Model::bindTextureArrays),
+    // so all that is left per mesh is pointing the samplers at the right unit and layer. The uniform names
+    // are put together in the frame arena, which the drawing thread resets every frame.
+    void Draw(Shader shader) const
     {
-        // bind appropriate textures
+        PROFILE_ZONE("Mesh::Draw");
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        FrameString uniform;
+        uniform.reserve(32);
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
+            unsigned int number = 0;
+            const string &name = textures[i].type;
             if(name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
+				number = diffuseNr++;
 			else if(name == "texture_specular")
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
+				number = specularNr++;
             else if(name == "texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
+				number = normalNr++;
              else if(name == "texture_height")
-			    number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-													 // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			    number = heightNr++;
+
+            // now set the sampler to the unit its array is bound to and select the layer
+            char digits[16];
+            snprintf(digits, sizeof(digits), "%u", number);
+            uniform.assign(name.begin(), name.end());
+            if(number > 0)
+                uniform += digits;
+            glUniform1i(glGetUniformLocation(shader.ID, uniform.c_str()), textures[i].unit);
+            uniform += "_layer";
+            glUniform1f(glGetUniformLocation(shader.ID, uniform.c_str()), (float)textures[i].layer);
+            renderStats().uniformUpdates += 2;
         }
         
         // draw mesh
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
+        renderStats().drawCalls++;
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // uploads the indices again after their triangles were reordered (see MeshBVH::build)
+    void updateIndices()
+    {
+        if(indices.empty())
+            return;
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), &indices[0]);
+        glBindVertexArray(0);
     }
 
 private:
@@ -0,0 +1,340 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/job_system.h>
+
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+using namespace std;
+
+// The closest hit of a ray with a mesh.
+struct MeshHit {
+    float t;				// along the ray, in units of its direction; set it to the farthest t wanted before a query
+    unsigned int mesh;		// set by the Model queries
+    unsigned int triangle;	// its vertices are indices[3 * triangle] to indices[3 * triangle + 2]
+    glm::vec2 barycentric;	// weights of its second and third vertices
+};
+
+// The point of a mesh closest to a query point.
+struct MeshPoint {
+    glm::vec3 point;		// in world space
+    float distance;			// to the query point; set it to the largest distance wanted before a query
+    unsigned int mesh, triangle;
+};
+
+// A BVH over the triangles of one mesh, for exact ray and distance queries against what is drawn. Building
+// it reorders the mesh's triangles into leaf order (which doesn't change what is drawn), so its leaves are
+// ranges of the mesh's own index buffer and the tree costs nothing beyond its nodes. The queries take the
+// model matrix of an instance: rays are moved into the mesh's space, where t stays the same, and closest
+// points are measured in world space, so sheared and non-uniformly scaled instances get exact distances.
+class MeshBVH
+{
+public:
+    static const int STACK = 64;	// traversal stack entries
+
+    vector<BVHNode> nodes;
+    unsigned long long source;		// checksum() of the mesh it was built from
+
+    MeshBVH() : source(0) {}
+
+    // builds over `mesh` and reorders its triangles to match; the caller uploads the new indices
+    void build(Mesh &mesh, JobSystem *jobs = NULL)
+    {
+        source = checksum(mesh);
+        unsigned int triangles = mesh.indices.size() / 3;
+        vector<glm::vec3> corners(3 * triangles);
+        for(unsigned int i = 0; i < 3 * triangles; i++)
+            corners[i] = mesh.vertices[mesh.indices[i]].Position;
+        TriangleBVH bvh;
+        // larger leaves than the ray tracer's: queries are few, the trees stay around for every mesh
+        bvh.traversalCost = 2.0f;
+        bvh.build(triangles ? &corners[0] : NULL, triangles, jobs);
+        nodes.swap(bvh.nodes);
+
+        vector<unsigned int> ordered(mesh.indices.size());
+        for(unsigned int i = 0; i < triangles; i++)
+            for(int k = 0; k < 3; k++)
+                ordered[3 * i + k] = mesh.indices[3 * bvh.indices[i] + k];
+        copy(mesh.indices.begin() + 3 * triangles, mesh.indices.end(), ordered.begin() + 3 * triangles);
+        mesh.indices.swap(ordered);
+    }
+
+    // FNV-1a over the positions and indices, to tell whether a saved tree fits a mesh
+    static unsigned long long checksum(const Mesh &mesh)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for(unsigned int i = 0; i < mesh.vertices.size(); i++)
+            hash = fnv(hash, &mesh.vertices[i].Position, sizeof(glm::vec3));
+        if(!mesh.indices.empty())
+            hash = fnv(hash, &mesh.indices[0], mesh.indices.size() * sizeof(unsigned int));
+        return hash;
+    }
+
+    // saves the tree and the reordered indices of the mesh it was built for
+    bool write(FILE *file, const Mesh &mesh) const
+    {
+        unsigned int counts[2] = { (unsigned int)mesh.indices.size(), (unsigned int)nodes.size() };
+        return fwrite(&source, sizeof(source), 1, file) == 1 && fwrite(counts, sizeof(counts), 1, file) == 1 &&
+               (nodes.empty() || fwrite(&nodes[0], sizeof(BVHNode), nodes.size(), file) == nodes.size()) &&
+               (mesh.indices.empty() || fwrite(&mesh.indices[0], sizeof(unsigned int), mesh.indices.size(), file) == mesh.indices.size());
+    }
+
+    // loads a tree saved by write() and the mesh's indices reordered like its build did them, for the caller
+    // to swap in; returns false, changing nothing, when it was built from other data
+    bool read(FILE *file, const Mesh &mesh, vector<unsigned int> &indices)
+    {
+        unsigned long long sum;
+        unsigned int counts[2];
+        if(fread(&sum, sizeof(sum), 1, file) != 1 || fread(counts, sizeof(counts), 1, file) != 1)
+            return false;
+        if(sum != checksum(mesh) || counts[0] != mesh.indices.size() || counts[1] == 0)
+            return false;
+        vector<BVHNode> loaded(counts[1]);
+        vector<unsigned int> ordered(counts[0]);
+        if(fread(&loaded[0], sizeof(BVHNode), loaded.size(), file) != loaded.size())
+            return false;
+        if(!ordered.empty() && fread(&ordered[0], sizeof(unsigned int), ordered.size(), file) != ordered.size())
+            return false;
+        for(unsigned int i = 0; i < ordered.size(); i++)
+            if(ordered[i] >= mesh.vertices.size())
+                return false;
+        // the checksum only covers the mesh, so the tree itself is checked: children come after their parent
+        // and inside the array, and leaves inside the triangles (a mesh without any has a lone empty root)
+        unsigned long long triangles = ordered.size() / 3;
+        for(unsigned int i = 0; i < loaded.size() && triangles > 0; i++)
+        {
+            const BVHNode &node = loaded[i];
+            if(node.count == 0 ? node.start <= i || (unsigned long long)node.start + 1 >= loaded.size()
+                               : (unsigned long long)node.start + node.count > triangles)
+                return false;
+        }
+        nodes.swap(loaded);
+        indices.swap(ordered);
+        source = sum;
+        return true;
+    }
+
+    // bytes the tree adds to the mesh
+    size_t memory() const { return sizeof(MeshBVH) + nodes.capacity() * sizeof(BVHNode); }
+
+    // the closest hit of the ray origin + t * direction, in world space, with 0 <= t < hit.t, against the
+    // instance with model matrix `model`
+    bool intersect(const Mesh &mesh, const glm::mat4 &model, const glm::vec3 &origin, const glm::vec3 &direction, MeshHit &hit) const
+    {
+        return traverse(mesh, model, origin, direction, hit, false);
+    }
+
+    // whether the ray hits anything with 0 <= t < tMax; stops at the first hit found
+    bool occluded(const Mesh &mesh, const glm::mat4 &model, const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const
+    {
+        MeshHit hit;
+        hit.t = tMax;
+        return traverse(mesh, model, origin, direction, hit, true);
+    }
+
+    // the point of the instance closest to `point`, if closer than closest.distance
+    bool closestPoint(const Mesh &mesh, const glm::mat4 &model, const glm::vec3 &point, MeshPoint &closest) const
+    {
+        if(nodes.empty() || mesh.indices.size() < 3)
+            return false;
+        float best = closest.distance < sqrt(FLT_MAX) ? closest.distance * closest.distance : FLT_MAX;
+        bool found = false;
+        Entry stack[STACK];
+        int top = 0;
+        stack[top].node = 0;
+        stack[top++].distance = boxDistance(nodes[0], model, point);
+        while(top > 0)
+        {
+            Entry entry = stack[--top];
+            if(entry.distance >= best)
+                continue;
+            const BVHNode &node = nodes[entry.node];
+            if(node.count > 0)
+            {
+                for(unsigned int i = node.start; i < node.start + node.count; i++)
+                {
+                    glm::vec3 a = glm::vec3(model * glm::vec4(mesh.vertices[mesh.indices[3 * i]].Position, 1.0f));
+                    glm::vec3 b = glm::vec3(model * glm::vec4(mesh.vertices[mesh.indices[3 * i + 1]].Position, 1.0f));
+                    glm::vec3 c = glm::vec3(model * glm::vec4(mesh.vertices[mesh.indices[3 * i + 2]].Position, 1.0f));
+                    glm::vec3 q = closestOnTriangle(point, a, b, c);
+                    float d = glm::dot(q - point, q - point);
+                    if(d < best)
+                    {
+                        best = d;
+                        closest.point = q;
+                        closest.triangle = i;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            Entry first = { node.start, boxDistance(nodes[node.start], model, point) };
+            Entry second = { node.start + 1, boxDistance(nodes[node.start + 1], model, point) };
+            if(second.distance < first.distance)
+                swap(first, second);
+            // the stack holds one entry per level at most
+            if(second.distance < best && top < STACK)
+                stack[top++] = second;
+            if(first.distance < best && top < STACK)
+                stack[top++] = first;
+        }
+        if(found)
+            closest.distance = sqrt(best);
+        return found;
+    }
+
+private:
+    struct Entry {
+        unsigned int node;
+        float distance;		// where the ray enters the node, or the squared distance to it
+    };
+
+    static unsigned long long fnv(unsigned long long hash, const void *data, size_t bytes)
+    {
+        const unsigned char *p = (const unsigned char*)data;
+        for(size_t i = 0; i < bytes; i++)
+            hash = (hash ^ p[i]) * 1099511628211ULL;
+        return hash;
+    }
+
+    bool traverse(const Mesh &mesh, const glm::mat4 &model, const glm::vec3 &origin, const glm::vec3 &direction, MeshHit &hit, bool any) const
+    {
+        if(nodes.empty() || mesh.indices.size() < 3)
+            return false;
+        glm::mat4 inverse = glm::inverse(model);
+        glm::vec3 o = glm::vec3(inverse * glm::vec4(origin, 1.0f)), d = glm::mat3(inverse) * direction;
+        glm::vec3 r;
+        for(int axis = 0; axis < 3; axis++)
+            r[axis] = 1.0f / (fabs(d[axis]) > 1e-20f ? d[axis] : 1e-20f);
+
+        bool found = false;
+        Entry stack[STACK];
+        int top = 0;
+        float distance;
+        if(!enter(nodes[0], o, r, hit.t, distance))
+            return false;
+        stack[top].node = 0;
+        stack[top++].distance = distance;
+        while(top > 0)
+        {
+            Entry entry = stack[--top];
+            if(entry.distance >= hit.t)
+                continue;
+            const BVHNode &node = nodes[entry.node];
+            if(node.count > 0)
+            {
+                for(unsigned int i = node.start; i < node.start + node.count; i++)
+                    if(intersectTriangle(mesh, i, o, d, hit))
+                    {
+                        if(any)
+                            return true;
+                        found = true;
+                    }
+                continue;
+            }
+            // the child the ray enters first goes on top
+            Entry first = { node.start, 0.0f }, second = { node.start + 1, 0.0f };
+            bool firstHit = enter(nodes[first.node], o, r, hit.t, first.distance);
+            bool secondHit = enter(nodes[second.node], o, r, hit.t, second.distance);
+            if(firstHit && secondHit && second.distance < first.distance)
+                swap(first, second);
+            else if(!firstHit)
+            {
+                first = second;
+                firstHit = secondHit;
+                secondHit = false;
+            }
+            if(secondHit && top < STACK)
+                stack[top++] = second;
+            if(firstHit && top < STACK)
+                stack[top++] = first;
+        }
+        return found;
+    }
+
+    // the slab test, up to tMax; `entry` gets where the ray enters the box
+    static bool enter(const BVHNode &node, const glm::vec3 &o, const glm::vec3 &r, float tMax, float &entry)
+    {
+        glm::vec3 a = (node.lower - o) * r, b = (node.upper - o) * r;
+        glm::vec3 low = glm::min(a, b), high = glm::max(a, b);
+        entry = max(max(low.x, low.y), max(low.z, 0.0f));
+        return entry <= min(min(high.x, high.y), min(high.z, tMax));
+    }
+
+    // Möller-Trumbore, keeping the hit if it is closer than the one so far
+    static bool intersectTriangle(const Mesh &mesh, unsigned int triangle, const glm::vec3 &o, const glm::vec3 &d, MeshHit &hit)
+    {
+        const glm::vec3 &v0 = mesh.vertices[mesh.indices[3 * triangle]].Position;
+        glm::vec3 e1 = mesh.vertices[mesh.indices[3 * triangle + 1]].Position - v0;
+        glm::vec3 e2 = mesh.vertices[mesh.indices[3 * triangle + 2]].Position - v0;
+        glm::vec3 p = glm::cross(d, e2);
+        float det = glm::dot(e1, p);
+        if(det == 0.0f)
+            return false;
+        float inverse = 1.0f / det;
+        glm::vec3 s = o - v0;
+        float u = glm::dot(s, p) * inverse;
+        if(u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(d, q) * inverse;
+        if(v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(e2, q) * inverse;
+        if(t < 0.0f || t >= hit.t)
+            return false;
+        hit.t = t;
+        hit.triangle = triangle;
+        hit.barycentric = glm::vec2(u, v);
+        return true;
+    }
+
+    // squared distance from `point` to the world space box around a node of an instance
+    static float boxDistance(const BVHNode &node, const glm::mat4 &model, const glm::vec3 &point)
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4((node.lower + node.upper) * 0.5f, 1.0f));
+        glm::vec3 half = (node.upper - node.lower) * 0.5f, extent(0.0f);
+        for(int row = 0; row < 3; row++)
+            for(int column = 0; column < 3; column++)
+                extent[row] += fabs(model[column][row]) * half[column];
+        glm::vec3 outside = glm::max(glm::abs(point - center) - extent, glm::vec3(0.0f));
+        return glm::dot(outside, outside);
+    }
+
+    // the point of triangle abc closest to p, by the Voronoi region p falls in (Ericson, Real-Time Collision
+    // Detection, 5.1.5)
+    static glm::vec3 closestOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+    {
+        glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if(d1 <= 0.0f && d2 <= 0.0f)
+            return a;
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if(d3 >= 0.0f && d4 <= d3)
+            return b;
+        float vc = d1 * d4 - d3 * d2;
+        if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            return a + ab * (d1 / (d1 - d3));
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if(d6 >= 0.0f && d5 <= d6)
+            return c;
+        float vb = d5 * d2 - d1 * d6;
+        if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            return a + ac * (d2 / (d2 - d6));
+        float va = d3 * d6 - d5 * d4;
+        if(va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+};
+#endif
@@ -11,7 +11,11 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_bvh.h>
+#include <learnopengl/convex_hull.h>
+#include <learnopengl/job_system.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/profiler.h>
 
 #include <string>
 #include <fstream>
@@ -19,9 +23,12 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <cstring>
+#include <utility>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+GLenum textureFormat(int nrComponents);
 
 class Model 
 {
@@ -29,28 +36,167 @@ public:
     /*  Model Data */
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh> meshes;
+    vector<MeshBVH> bvhs;				// one per mesh once buildBVH() ran, for ray and distance queries
+    vector<ConvexHull> hulls;			// one per mesh, for collision queries
+    string path;
+    vector<unsigned int> textureArrays;	// one GL_TEXTURE_2D_ARRAY per distinct texture size/format, bound to unit i
     string directory;
     bool gammaCorrection;
+    // bounding sphere of all the meshes, in model space
+    glm::vec3 boundsCenter;
+    float boundsRadius;
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false) : gammaCorrection(gamma), boundsCenter(0.0f), boundsRadius(0.0f)
     {
         loadModel(path);
     }
 
     // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    void Draw(Shader shader) const
     {
+        bindTextureArrays();
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
+
+    // builds the BVHs of the meshes, on the workers, and uploads their reordered indices; needs the context.
+    // With `cache`, trees saved in path + ".bvh" are used when they were built from the same meshes, and the
+    // file is written otherwise. Returns whether the trees came from the cache.
+    bool buildBVH(JobSystem *jobs, bool cache)
+    {
+        PROFILE_ZONE("buildBVH");
+        string cachePath = path + ".bvh";
+        bvhs.assign(meshes.size(), MeshBVH());
+        if(cache && readBVH(cachePath))
+        {
+            for(unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].updateIndices();
+            return true;
+        }
+        bvhs.assign(meshes.size(), MeshBVH());
+        if(meshes.size() == 1)
+            bvhs[0].build(meshes[0], jobs);
+        else
+        {
+            JobSystem::Job job = [&](unsigned int begin, unsigned int end, unsigned int) {
+                for(unsigned int i = begin; i < end; i++)
+                    bvhs[i].build(meshes[i]);
+            };
+            if(jobs)
+                jobs->parallelFor(meshes.size(), 1, job);
+            else
+                job(0, meshes.size(), 0);
+        }
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].updateIndices();
+        if(cache)
+            writeBVH(cachePath);
+        return false;
+    }
+
+    // the closest hit of the ray origin + t * direction with 0 <= t < hit.t, in world space, against the instance
+    // with model matrix `model`
+    bool intersect(const glm::mat4 &model, const glm::vec3 &origin, const glm::vec3 &direction, MeshHit &hit) const
+    {
+        bool found = false;
+        for(unsigned int i = 0; i < bvhs.size(); i++)
+            if(bvhs[i].intersect(meshes[i], model, origin, direction, hit))
+            {
+                hit.mesh = i;
+                found = true;
+            }
+        return found;
+    }
+
+    bool occluded(const glm::mat4 &model, const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const
+    {
+        for(unsigned int i = 0; i < bvhs.size(); i++)
+            if(bvhs[i].occluded(meshes[i], model, origin, direction, tMax))
+                return true;
+        return false;
+    }
+
+    // the point of the instance closest to `point`, if closer than closest.distance
+    bool closestPoint(const glm::mat4 &model, const glm::vec3 &point, MeshPoint &closest) const
+    {
+        bool found = false;
+        for(unsigned int i = 0; i < bvhs.size(); i++)
+            if(bvhs[i].closestPoint(meshes[i], model, point, closest))
+            {
+                closest.mesh = i;
+                found = true;
+            }
+        return found;
+    }
+
+    // bytes of the BVHs and of the mesh data they index
+    size_t bvhMemory() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < bvhs.size(); i++)
+            bytes += bvhs[i].memory();
+        return bytes;
+    }
+
+    size_t meshMemory() const
+    {
+        size_t bytes = 0;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].vertices.size() * sizeof(Vertex) + meshes[i].indices.size() * sizeof(unsigned int);
+        return bytes;
+    }
+
+    // binds every texture array of the model to its unit; this is the only texture binding a model draw needs,
+    // and consecutive draws of the same model don't rebind anything at all.
+    void bindTextureArrays() const
+    {
+        for(unsigned int i = 0; i < textureArrays.size(); i++)
+            bindTexture(GL_TEXTURE_2D_ARRAY, i, textureArrays[i]);
+    }
     
 private:
     /*  Functions   */
+    // the BVH cache: a magic, the mesh count, then MeshBVH::write() for every mesh
+    bool readBVH(const string &cachePath)
+    {
+        FILE *file = fopen(cachePath.c_str(), "rb");
+        if(!file)
+            return false;
+        char magic[8];
+        unsigned int count;
+        bool valid = fread(magic, sizeof(magic), 1, file) == 1 && !memcmp(magic, "CGMBVH1", 8) &&
+                     fread(&count, sizeof(count), 1, file) == 1 && count == meshes.size();
+        // the meshes only change once every tree matched, so a stale file leaves them as loaded
+        vector< vector<unsigned int> > indices(meshes.size());
+        for(unsigned int i = 0; valid && i < meshes.size(); i++)
+            valid = bvhs[i].read(file, meshes[i], indices[i]);
+        fclose(file);
+        for(unsigned int i = 0; valid && i < meshes.size(); i++)
+            meshes[i].indices.swap(indices[i]);
+        return valid;
+    }
+
+    void writeBVH(const string &cachePath) const
+    {
+        FILE *file = fopen(cachePath.c_str(), "wb");
+        bool written = file != NULL;
+        unsigned int count = meshes.size();
+        if(file)
+            written = fwrite("CGMBVH1", 8, 1, file) == 1 && fwrite(&count, sizeof(count), 1, file) == 1;
+        for(unsigned int i = 0; written && i < meshes.size(); i++)
+            written = bvhs[i].write(file, meshes[i]);
+        if(file)
+            fclose(file);
+        if(!written)
+            cout << "ERROR::MODEL:: Could not write the BVH cache " << cachePath << endl;
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        PROFILE_ZONE("loadModel");
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -61,10 +207,116 @@ private:
             return;
         }
         // retrieve the directory path of the filepath
+        this->path = path;
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
+        // process ASSIMP's root node recursively; nodes usually reference each mesh once
+        meshes.reserve(scene->mNumMeshes);
         processNode(scene->mRootNode, scene);
+        computeBounds();
+        computeHulls();
+
+        // upload the textures the meshes referenced
+        packTextureArrays();
+    }
+
+    // a sphere around the box that holds every vertex
+    void computeBounds()
+    {
+        glm::vec3 low(1e30f), high(-1e30f);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            for(unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+            {
+                low = glm::min(low, meshes[i].vertices[j].Position);
+                high = glm::max(high, meshes[i].vertices[j].Position);
+            }
+        if(low.x > high.x)
+            return;
+        boundsCenter = (low + high) * 0.5f;
+        boundsRadius = 0.0f;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            for(unsigned int j = 0; j < meshes[i].vertices.size(); j++)
+                boundsRadius = glm::max(boundsRadius, glm::length(meshes[i].vertices[j].Position - boundsCenter));
+    }
+
+    void computeHulls()
+    {
+        hulls.resize(meshes.size());
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            if(!meshes[i].vertices.empty())
+                hulls[i].build(&meshes[i].vertices[0].Position, meshes[i].vertices.size(), sizeof(Vertex));
+    }
+
+    // groups the loaded textures by size and format and uploads each group as the layers of one GL_TEXTURE_2D_ARRAY,
+    // then points the meshes' textures at their array unit and layer.
+    void packTextureArrays()
+    {
+        PROFILE_ZONE("packTextureArrays");
+        vector<Texture*> groups; // first texture of each group, its index is the group's texture unit
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+        {
+            Texture &texture = textures_loaded[i];
+            unsigned int group = 0;
+            while(group < groups.size() && !(groups[group]->width == texture.width && groups[group]->height == texture.height && groups[group]->nrComponents == texture.nrComponents))
+                group++;
+            if(group == groups.size())
+                groups.push_back(&texture);
+            texture.unit = group;
+        }
+
+        textureArrays.resize(groups.size());
+        if(!groups.empty())
+            glGenTextures(groups.size(), &textureArrays[0]);
+        for(unsigned int group = 0; group < groups.size(); group++)
+        {
+            GLenum format = textureFormat(groups[group]->nrComponents);
+            int layers = 0;
+            for(unsigned int i = 0; i < textures_loaded.size(); i++)
+                if(textures_loaded[i].unit == group)
+                    textures_loaded[i].layer = layers++;
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrays[group]);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, groups[group]->width, groups[group]->height, layers, 0, format, GL_UNSIGNED_BYTE, NULL);
+            for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            {
+                Texture &texture = textures_loaded[i];
+                if(texture.unit != group)
+                    continue;
+                texture.id = textureArrays[group];
+                string filename = directory + '/' + texture.path;
+                int width, height, nrComponents;
+                unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+                if(data)
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, texture.layer, width, height, 1, format, GL_UNSIGNED_BYTE, data);
+                else
+                    std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+                stbi_image_free(data);
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        // we bound textures directly, so the bind cache no longer reflects the GL state
+        invalidateTextureBindings();
+
+        // the meshes hold copies of the textures, update them with the packing results
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            for(unsigned int j = 0; j < meshes[i].textures.size(); j++)
+            {
+                for(unsigned int k = 0; k < textures_loaded.size(); k++)
+                {
+                    if(textures_loaded[k].path == meshes[i].textures[j].path)
+                    {
+                        meshes[i].textures[j] = textures_loaded[k];
+                        break;
+                    }
+                }
+            }
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -88,57 +340,39 @@ private:
 
     Mesh processMesh(aiMesh *mesh, const aiScene *scene)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
+        PROFILE_ZONE("processMesh");
+        // data to fill, sized from the counts ASSIMP gives up front
+        vector<Vertex> vertices(mesh->mNumVertices);
+        vector<unsigned int> indices(countIndices(mesh));
         vector<Texture> textures;
 
-        // Walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+        // Walk through each of the mesh's vertices once, with one memcpy per stream into the presized vertex
+        // (aiVector3D is three floats like glm::vec3). A stream the file doesn't have stays zero (the texture
+        // coordinates and with them the tangents may be missing).
+        static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "ASSIMP built with double precision");
+        const aiVector3D *positions = mesh->mVertices, *normals = mesh->mNormals, *texCoords = mesh->mTextureCoords[0];
+        const aiVector3D *tangents = mesh->mTangents, *bitangents = mesh->mBitangents;
+        Vertex *vertex = vertices.empty() ? NULL : &vertices[0];
+        for(unsigned int i = 0; i < mesh->mNumVertices; i++, vertex++)
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            // tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
-            vertices.push_back(vertex);
+            memcpy(&vertex->Position[0], &positions[i].x, sizeof(glm::vec3));
+            if(normals)
+                memcpy(&vertex->Normal[0], &normals[i].x, sizeof(glm::vec3));
+            // a vertex can contain up to 8 different texture coordinates, we always take the first set (0).
+            if(texCoords)
+                memcpy(&vertex->TexCoords[0], &texCoords[i].x, sizeof(glm::vec2));
+            if(tangents)
+                memcpy(&vertex->Tangent[0], &tangents[i].x, sizeof(glm::vec3));
+            if(bitangents)
+                memcpy(&vertex->Bitangent[0], &bitangents[i].x, sizeof(glm::vec3));
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // now walk through each of the mesh's faces (a face is a mesh its triangle) and copy the corresponding vertex indices.
+        unsigned int *index = indices.empty() ? NULL : &indices[0];
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            const aiFace &face = mesh->mFaces[i];
+            memcpy(index, face.mIndices, face.mNumIndices * sizeof(unsigned int));
+            index += face.mNumIndices;
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
@@ -163,7 +397,18 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures));
+    }
+
+    // how many indices the faces of a mesh hold: three per face once triangulated, unless it also has points or lines
+    static unsigned int countIndices(const aiMesh *mesh)
+    {
+        if(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+            return mesh->mNumFaces * 3;
+        unsigned int count = 0;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+            count += mesh->mFaces[i].mNumIndices;
+        return count;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -187,11 +432,20 @@ private:
                 }
             }
             if(!skip)
-            {   // if texture hasn't been loaded already, load it
+            {   // if texture hasn't been seen already, record it; the pixels are uploaded later by packTextureArrays
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = 0;
                 texture.type = typeName;
                 texture.path = str.C_Str();
+                string filename = this->directory + '/' + texture.path;
+                if(!stbi_info(filename.c_str(), &texture.width, &texture.height, &texture.nrComponents))
+                {
+                    std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+                    texture.width = texture.height = 1;
+                    texture.nrComponents = 3;
+                }
+                texture.layer = 0;
+                texture.unit = 0;
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
             }
@@ -203,6 +457,7 @@ private:
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
+    PROFILE_ZONE("TextureFromFile");
     string filename = string(path);
     filename = directory + '/' + filename;
 
@@ -213,13 +468,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
     if (data)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        GLenum format = textureFormat(nrComponents);
 
         glBindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
@@ -240,4 +489,15 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
 
     return textureID;
 }
+
+GLenum textureFormat(int nrComponents)
+{
+    if (nrComponents == 1)
+        return GL_RED;
+    else if (nrComponents == 2)
+        return GL_RG;
+    else if (nrComponents == 4)
+        return GL_RGBA;
+    return GL_RGB;
+}
 #endif
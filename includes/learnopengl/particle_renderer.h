@@ -0,0 +1,66 @@
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/stream_buffer.h>
+
+#include <cstring>
+using namespace std;
+
+// Draws the particles of a ParticleSystem as point sprites. They are packed by ParticleSystem::pack() on the
+// thread that simulates them, one vertex per particle (position and age over life); every frame the vertices
+// are copied into a StreamBuffer and drawn with a single glDrawArrays(GL_POINTS). Points are sized by
+// distance and fade with age in the shaders.
+class ParticleRenderer
+{
+public:
+    float pointSize;	// size in pixels of a particle one unit away
+
+    ParticleRenderer(const char *vertexPath, const char *fragmentPath, StreamBuffer &stream)
+        : pointSize(12.0f), shader(vertexPath, fragmentPath), stream(stream)
+    {
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+    }
+
+    // draws `n` particles already packed by ParticleSystem::pack()
+    void draw(const float *packed, unsigned int n, const glm::mat4 &viewProjection)
+    {
+        if(n == 0)
+            return;
+        unsigned int offset;
+        void *vertices = stream.map(n * 4 * sizeof(float), 4 * sizeof(float), offset);
+        memcpy(vertices, packed, n * 4 * sizeof(float));
+        stream.unmap();
+        submit(offset, n, viewProjection);
+    }
+
+private:
+    Shader shader;
+    StreamBuffer &stream;
+    unsigned int VAO;
+
+    // draws the `n` vertices at `offset` in the stream buffer
+    void submit(unsigned int offset, unsigned int n, const glm::mat4 &viewProjection)
+    {
+        shader.use();
+        shader.setMat4("viewProjection", viewProjection);
+        shader.setFloat("pointSize", pointSize);
+        renderStats().uniformUpdates += 2;
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glBindVertexArray(VAO);
+        // the vertices move around the stream buffer, which may even be replaced when it grows
+        glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(size_t)offset);
+        glDrawArrays(GL_POINTS, 0, n);
+        glBindVertexArray(0);
+        renderStats().drawCalls++;
+    }
+};
+#endif
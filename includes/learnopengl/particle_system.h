@@ -0,0 +1,207 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/job_system.h>
+#include <learnopengl/float4.h>
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+using namespace std;
+
+// Debris particles stored as separate arrays per component (structure of arrays), so the integrator loads
+// four particles' worth of each attribute at once and advances them together with Float4 (SSE when
+// available), leaving a scalar tail for the last few of a chunk. Work is split in chunks
+// over a JobSystem: bursts fill their new particles chunk by chunk, and update() integrates velocity,
+// gravity, drag and age per chunk, compacts the survivors inside each chunk, then closes the gaps between
+// chunks. Particle order isn't kept.
+class ParticleSystem
+{
+public:
+    static const unsigned int CHUNK = 16384;
+
+    vector<float> px, py, pz;		// position
+    vector<float> vx, vy, vz;		// velocity
+    vector<float> age, life;		// seconds lived and seconds to live
+
+    glm::vec3 gravity;
+    float drag;						// fraction of the velocity lost per second, as a rate
+    unsigned int maxParticles;		// bursts past this are cut short
+
+    ParticleSystem() : gravity(0.0f, -0.5f, 0.0f), drag(0.5f), maxParticles(1u << 21), count(0), seed(1) {}
+
+    unsigned int size() const { return count; }
+
+    void clear() { count = 0; }
+
+    // emits `n` particles from `origin` in random directions, with speeds up to `speed` and lives between
+    // half and all of `lifetime`.
+    void burst(const glm::vec3 &origin, unsigned int n, float speed, float lifetime, JobSystem *jobs = NULL)
+    {
+        if(count + n > maxParticles)
+            n = maxParticles > count ? maxParticles - count : 0;
+        unsigned int first = count;
+        resize(count + n);
+        unsigned int burstSeed = seed++;
+        forChunks(jobs, n, [&](unsigned int begin, unsigned int end, unsigned int) {
+            // one generator per chunk, so the result doesn't depend on which thread ran it
+            unsigned int state = hash(burstSeed * 0x9e3779b9u + begin);
+            for(unsigned int i = first + begin; i < first + end; i++)
+            {
+                // a uniform direction from a random point on the cylinder, scaled by a random speed
+                float z = 2.0f * random(state) - 1.0f;
+                float a = 6.2831853f * random(state);
+                float r = sqrt(1.0f - z * z);
+                float v = speed * random(state);
+                px[i] = origin.x;
+                py[i] = origin.y;
+                pz[i] = origin.z;
+                vx[i] = r * cos(a) * v;
+                vy[i] = r * sin(a) * v;
+                vz[i] = z * v;
+                age[i] = 0.0f;
+                life[i] = lifetime * (0.5f + 0.5f * random(state));
+            }
+        });
+    }
+
+    // advances every particle by `dt` seconds and removes the ones that died.
+    void update(float dt, JobSystem *jobs = NULL)
+    {
+        unsigned int chunks = (count + CHUNK - 1) / CHUNK;
+        alive.assign(chunks, 0);
+        const float damp = exp(-drag * dt);
+        const float gx = gravity.x * dt, gy = gravity.y * dt, gz = gravity.z * dt;
+        forChunks(jobs, count, [&](unsigned int begin, unsigned int end, unsigned int) {
+            float *x = &px[0], *y = &py[0], *z = &pz[0];
+            float *u = &vx[0], *v = &vy[0], *w = &vz[0];
+            float *a = &age[0];
+            const Float4 damp4(damp), dt4(dt), gx4(gx), gy4(gy), gz4(gz);
+            unsigned int i = begin;
+            for(; i + 4 <= end; i += 4)
+            {
+                Float4 u4 = (loadFloat4(u + i) + gx4) * damp4;
+                Float4 v4 = (loadFloat4(v + i) + gy4) * damp4;
+                Float4 w4 = (loadFloat4(w + i) + gz4) * damp4;
+                storeFloat4(u + i, u4);
+                storeFloat4(v + i, v4);
+                storeFloat4(w + i, w4);
+                storeFloat4(x + i, loadFloat4(x + i) + u4 * dt4);
+                storeFloat4(y + i, loadFloat4(y + i) + v4 * dt4);
+                storeFloat4(z + i, loadFloat4(z + i) + w4 * dt4);
+                storeFloat4(a + i, loadFloat4(a + i) + dt4);
+            }
+            for(; i < end; i++)
+            {
+                u[i] = (u[i] + gx) * damp;
+                v[i] = (v[i] + gy) * damp;
+                w[i] = (w[i] + gz) * damp;
+                x[i] += u[i] * dt;
+                y[i] += v[i] * dt;
+                z[i] += w[i] * dt;
+                a[i] += dt;
+            }
+            alive[begin / CHUNK] = compact(begin, end);
+        });
+
+        // close the gaps between the chunks' survivors
+        unsigned int n = 0;
+        for(unsigned int c = 0; c < chunks; c++)
+        {
+            unsigned int from = c * CHUNK;
+            if(from != n)
+                move(n, from, alive[c]);
+            n += alive[c];
+        }
+        count = n;
+    }
+
+    // writes x, y, z and age / life of every particle into `out` (4 floats each), e.g. for a vertex buffer.
+    void pack(float *out, JobSystem *jobs = NULL) const
+    {
+        forChunks(jobs, count, [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                out[4 * i + 0] = px[i];
+                out[4 * i + 1] = py[i];
+                out[4 * i + 2] = pz[i];
+                out[4 * i + 3] = age[i] / life[i];
+            }
+        });
+    }
+
+private:
+    unsigned int count;
+    unsigned int seed;
+    vector<unsigned int> alive;		// survivors per chunk in the last update
+
+    template <typename F>
+    static void forChunks(JobSystem *jobs, unsigned int n, const F &f)
+    {
+        if(jobs)
+            jobs->parallelFor(n, CHUNK, f);
+        else
+            for(unsigned int begin = 0; begin < n; begin += CHUNK)
+                f(begin, begin + CHUNK < n ? begin + CHUNK : n, 0);
+    }
+
+    void resize(unsigned int n)
+    {
+        count = n;
+        if(px.size() >= n)
+            return;
+        // grow in steps so repeated bursts don't reallocate every time
+        unsigned int capacity = n + n / 2;
+        px.resize(capacity); py.resize(capacity); pz.resize(capacity);
+        vx.resize(capacity); vy.resize(capacity); vz.resize(capacity);
+        age.resize(capacity); life.resize(capacity);
+    }
+
+    // moves the live particles of [begin, end) to its start and returns how many there are
+    unsigned int compact(unsigned int begin, unsigned int end)
+    {
+        unsigned int n = begin;
+        for(unsigned int i = begin; i < end; i++)
+        {
+            if(age[i] >= life[i])
+                continue;
+            if(i != n)
+            {
+                px[n] = px[i]; py[n] = py[i]; pz[n] = pz[i];
+                vx[n] = vx[i]; vy[n] = vy[i]; vz[n] = vz[i];
+                age[n] = age[i]; life[n] = life[i];
+            }
+            n++;
+        }
+        return n - begin;
+    }
+
+    void move(unsigned int to, unsigned int from, unsigned int n)
+    {
+        vector<float> *arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &age, &life };
+        for(unsigned int k = 0; k < 8; k++)
+            memmove(&(*arrays[k])[to], &(*arrays[k])[from], n * sizeof(float));
+    }
+
+    static unsigned int hash(unsigned int x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x ? x : 1;
+    }
+
+    // xorshift, uniform in [0, 1)
+    static float random(unsigned int &state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+};
+#endif
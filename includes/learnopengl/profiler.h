@@ -0,0 +1,215 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// A small hierarchical CPU zone profiler. Zones are opened with PROFILE_ZONE("name") and closed at the end
+// of the enclosing scope; every thread writes its finished zones into its own ring buffer without locking,
+// and the buffers can be exported as Chrome trace-event JSON (chrome://tracing, Perfetto) on demand or
+// automatically when a frame takes longer than the hitch threshold.
+//
+// The profiler only exists when CG_PROFILE is defined; otherwise the macros expand to nothing, except that
+// zones still name the allocations made inside them when allocation tracking is on (see alloc_tracker.h).
+
+#ifdef CG_ALLOC_TRACKING
+#include <learnopengl/alloc_tracker.h>
+#endif
+
+#ifdef CG_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+struct ProfileEvent {
+    const char *name;	// must outlive the profiler, zones use string literals
+    long long start;	// nanoseconds since the profiler epoch
+    long long end;
+    unsigned int depth;
+};
+
+// Ring buffer of the finished zones of one thread. Only the owning thread writes; readers copy whatever
+// has been published through `head`, so the oldest events are overwritten once the ring is full. A reader
+// can't stop the writer, so it keeps only the events the writer could not have reached while it copied.
+struct ProfileThreadBuffer {
+    static const unsigned int CAPACITY = 1 << 16;
+    ProfileEvent events[CAPACITY];
+    std::atomic<unsigned long long> head;
+    unsigned int depth;
+    unsigned int threadId;
+
+    ProfileThreadBuffer(unsigned int threadId) : head(0), depth(0), threadId(threadId) {}
+};
+
+class Profiler
+{
+public:
+    double hitchThreshold;	// seconds; frames slower than this get their trace exported, 0 disables it
+
+    static Profiler &instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch()).count();
+    }
+
+    // the calling thread's buffer, created and registered the first time a thread opens a zone
+    ProfileThreadBuffer &threadBuffer()
+    {
+        static thread_local ProfileThreadBuffer *buffer = NULL;
+        if(!buffer)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffer = new ProfileThreadBuffer(buffers.size());
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    void record(ProfileThreadBuffer &buffer, const char *name, long long start, long long end, unsigned int depth)
+    {
+        unsigned long long head = buffer.head.load(std::memory_order_relaxed);
+        ProfileEvent &event = buffer.events[head % ProfileThreadBuffer::CAPACITY];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        event.depth = depth;
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // marks the end of a frame; exports the recorded zones if the frame was a hitch. Returns whether it did,
+    // the caller should then not count the time the export took towards the next frame.
+    bool endFrame(double frameTime)
+    {
+        frameNr++;
+        if(hitchThreshold > 0.0 && frameTime > hitchThreshold && frameNr > 1)
+        {
+            std::ostringstream path;
+            path << "hitch_" << frameNr << ".json";
+            std::cout << "PROFILER:: frame " << frameNr << " took " << frameTime * 1000.0 << " ms, writing " << path.str() << std::endl;
+            exportTrace(path.str());
+            return true;
+        }
+        return false;
+    }
+
+    // writes every zone still held in the ring buffers as Chrome trace-event JSON.
+    bool exportTrace(const std::string &path)
+    {
+        std::ofstream file(path.c_str());
+        if(!file)
+        {
+            std::cout << "ERROR::PROFILER:: Could not write trace to " << path << std::endl;
+            return false;
+        }
+        std::vector<ProfileThreadBuffer*> threads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            threads = buffers;
+        }
+
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        std::vector<ProfileEvent> events;
+        for(unsigned int t = 0; t < threads.size(); t++)
+        {
+            ProfileThreadBuffer &buffer = *threads[t];
+            unsigned long long head = buffer.head.load(std::memory_order_acquire);
+            unsigned long long begin = head > ProfileThreadBuffer::CAPACITY ? head - ProfileThreadBuffer::CAPACITY : 0;
+            events.clear();
+            for(unsigned long long i = begin; i < head; i++)
+                events.push_back(buffer.events[i % ProfileThreadBuffer::CAPACITY]);
+            // the writer may have gone on meanwhile: event i is intact only if it hasn't started on i + CAPACITY,
+            // the slot it shares; the one being written is the published head
+            std::atomic_thread_fence(std::memory_order_acquire);
+            unsigned long long written = buffer.head.load(std::memory_order_relaxed);
+            unsigned long long intact = written + 1 > ProfileThreadBuffer::CAPACITY ? written + 1 - ProfileThreadBuffer::CAPACITY : 0;
+            for(unsigned long long i = std::max(begin, intact); i < head; i++)
+            {
+                const ProfileEvent &event = events[i - begin];
+                file << (first ? "" : ",\n")
+                     << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer.threadId
+                     << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0
+                     << ",\"args\":{\"depth\":" << event.depth << "}}";
+                first = false;
+            }
+        }
+        file << "\n]}\n";
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<ProfileThreadBuffer*> buffers;	// never freed, threads may still write into them at exit
+    unsigned long long frameNr;
+
+    Profiler() : hitchThreshold(0.0), frameNr(0) {}
+
+    static std::chrono::steady_clock::time_point epoch()
+    {
+        static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return start;
+    }
+};
+
+// RAII zone: records the time between construction and destruction under `name`.
+class ProfileZone
+{
+public:
+    ProfileZone(const char *name) : name(name), buffer(Profiler::instance().threadBuffer())
+#ifdef CG_ALLOC_TRACKING
+        , allocZone(name)
+#endif
+    {
+        depth = buffer.depth++;
+        start = Profiler::now();
+    }
+
+    ~ProfileZone()
+    {
+        long long end = Profiler::now();
+        buffer.depth--;
+        Profiler::instance().record(buffer, name, start, end, depth);
+    }
+
+private:
+    const char *name;
+    ProfileThreadBuffer &buffer;
+    long long start;
+    unsigned int depth;
+#ifdef CG_ALLOC_TRACKING
+    AllocZone allocZone;
+#endif
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FRAME_END(frameTime) Profiler::instance().endFrame(frameTime)
+#define PROFILE_SET_HITCH_THRESHOLD(seconds) (Profiler::instance().hitchThreshold = (seconds))
+#define PROFILE_EXPORT(path) Profiler::instance().exportTrace(path)
+
+#else
+
+#ifdef CG_ALLOC_TRACKING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) AllocZone PROFILE_CONCAT(allocZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+#define PROFILE_FRAME_END(frameTime) false
+#define PROFILE_SET_HITCH_THRESHOLD(seconds)
+#define PROFILE_EXPORT(path)
+
+#endif
+#endif
@@ -0,0 +1,458 @@
+#ifndef RAY_TRACER_H
+#define RAY_TRACER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/texture_image.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/float4.h>
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cfloat>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+using namespace std;
+
+struct RayTracerStats {
+    unsigned int triangles;		// in the BVH
+    unsigned int nodes;
+    unsigned long long rays;	// traced by the last render()
+    double buildTime, renderTime;	// seconds
+
+    double raysPerSecond() const { return renderTime > 0.0 ? rays / renderTime : 0.0; }
+};
+
+// Renders reference images of the scene on the CPU by ray tracing, for look development and regression
+// tests, giving the image cg_ufpel.fs would give (textured, unlit) without its rasterization artifacts:
+// every pixel averages samples x samples rays, and every ray samples the texture with the level of detail
+// of its own footprint (a ray cone), using the same texture images as the software rasterizer.
+//
+// build() transforms every instance's triangles to world space and puts them in a TriangleBVH, built on
+// the workers. render() splits the image in TILE x TILE tiles, one job each, and traces packets of four
+// rays (2x2 pixels, same sample) through the BVH together with SSE, visiting the children nearest to the
+// packet first.
+class RayTracer
+{
+public:
+    static const int TILE = 16;
+    static const int STACK = 256;	// traversal stack entries
+
+    glm::vec4 clearColor;
+    int samples;		// per pixel side
+    RayTracerStats stats;
+
+    // the diffuse textures come from `textures`, which may be shared with other renderers
+    RayTracer(TextureLibrary &textures) : clearColor(0.05f, 0.05f, 0.05f, 1.0f), samples(2), textures(textures), width(0), height(0)
+    {
+        RayTracerStats none = { 0, 0, 0, 0.0, 0.0 };
+        stats = none;
+    }
+
+    // registers the meshes of the next object, in the order `models` numbers them. They are read in place,
+    // so they must outlive the tracer; their diffuse textures are loaded on the first build().
+    void addObject(const vector<Mesh> &meshes, const string &directory)
+    {
+        vector<MeshSource> object;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            MeshSource source;
+            source.mesh = &meshes[i];
+            source.image = NULL;
+            for(unsigned int j = 0; j < meshes[i].textures.size() && source.path.empty(); j++)
+                if(meshes[i].textures[j].type == "texture_diffuse")
+                    source.path = directory + '/' + meshes[i].textures[j].path;
+            object.push_back(source);
+        }
+        objects.push_back(object);
+    }
+
+    // puts the triangles of every instance in the BVH: instance i shows object models[i] (none if negative)
+    // with model matrix world[i]
+    void build(const vector<int> &models, const vector<glm::mat4> &world, JobSystem *jobs = NULL)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(unsigned int i = 0; i < objects.size(); i++)
+            for(unsigned int j = 0; j < objects[i].size(); j++)
+                if(!objects[i][j].image && !objects[i][j].path.empty())
+                    objects[i][j].image = textures.get(objects[i][j].path);
+
+        // where each instance's triangles start
+        vector<unsigned int> first(models.size() + 1, 0);
+        for(unsigned int i = 0; i < models.size(); i++)
+        {
+            unsigned int n = 0;
+            if(models[i] >= 0 && (unsigned int)models[i] < objects.size())
+                for(unsigned int m = 0; m < objects[models[i]].size(); m++)
+                    n += objects[models[i]][m].mesh->indices.size() / 3;
+            first[i + 1] = first[i] + n;
+        }
+        unsigned int count = first.back();
+        corners.resize(3 * count);
+        unordered.resize(count);
+        JobSystem::Job transform = [&](unsigned int begin, unsigned int end, unsigned int) {
+            vector<glm::vec3> positions;
+            for(unsigned int i = begin; i < end; i++)
+                if(first[i + 1] > first[i])
+                    addInstance(objects[models[i]], world[i], first[i], positions);
+        };
+        forChunks(jobs, models.size(), 16, transform);
+        bvh.build(count ? &corners[0] : NULL, count, jobs);
+
+        // the triangles in leaf order, so the leaves read them one after the other
+        triangles.resize(count);
+        shading.resize(count);
+        JobSystem::Job reorder = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                unsigned int t = bvh.indices[i];
+                const glm::vec3 *p = &corners[3 * t];
+                Triangle &triangle = triangles[i];
+                triangle.v0 = p[0];
+                triangle.e1 = p[1] - p[0];
+                triangle.e2 = p[2] - p[0];
+                shading[i] = unordered[t];
+            }
+        };
+        forChunks(jobs, count, 4096, reorder);
+
+        stats.triangles = count;
+        stats.nodes = bvh.nodes.size();
+        stats.buildTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // traces the image of the scene last built as seen through `view` and `projection`
+    void render(const glm::mat4 &view, const glm::mat4 &projection, int imageWidth, int imageHeight, JobSystem *jobs = NULL)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        width = imageWidth;
+        height = imageHeight;
+        image.resize(width * height);
+        inverseViewProjection = glm::inverse(projection * view);
+        eye = glm::vec3(glm::inverse(view)[3]);
+        // the angle a sample covers; projection[1][1] is 1 / tan(fov / 2)
+        spread = 2.0f / (projection[1][1] * height * max(samples, 1));
+
+        int tilesX = (width + TILE - 1) / TILE, tilesY = (height + TILE - 1) / TILE;
+        atomic<unsigned long long> rays(0);
+        JobSystem::Job job = [&](unsigned int begin, unsigned int end, unsigned int) {
+            unsigned long long traced = 0;
+            for(unsigned int t = begin; t < end; t++)
+                traced += renderTile((t % tilesX) * TILE, (t / tilesX) * TILE);
+            rays += traced;
+        };
+        forChunks(jobs, tilesX * tilesY, 1, job);
+
+        stats.rays = rays;
+        stats.renderTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // the image, RGBA8 rows top first like an image file
+    const unsigned int *pixels() const { return image.empty() ? NULL : &image[0]; }
+
+    // writes the image as a binary PPM
+    bool save(const string &path) const
+    {
+        FILE *file = fopen(path.c_str(), "wb");
+        if(!file)
+        {
+            cout << "ERROR::RAY_TRACER:: Could not write image to " << path << endl;
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        vector<unsigned char> row(width * 3);
+        for(int y = 0; y < height; y++)
+        {
+            for(int x = 0; x < width; x++)
+            {
+                unsigned int c = image[y * width + x];
+                row[3 * x] = c & 255;
+                row[3 * x + 1] = c >> 8 & 255;
+                row[3 * x + 2] = c >> 16 & 255;
+            }
+            fwrite(&row[0], 1, row.size(), file);
+        }
+        fclose(file);
+        return true;
+    }
+
+private:
+    struct MeshSource {
+        const Mesh *mesh;
+        string path;				// of the diffuse texture, empty for none
+        const TextureImage *image;
+    };
+
+    // what intersection reads, kept apart from what only shading needs
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+    };
+
+    struct Shading {
+        glm::vec2 uv0, uv1, uv2;
+        float lodBias;		// half the log2 of texels per unit of area, the triangle's part of the ray cone lod
+        const TextureImage *image;
+    };
+
+    // four rays from the near plane, t running from 0 there to 1 on the far plane
+    struct RayPacket {
+        Float4 ox, oy, oz, dx, dy, dz;
+        Float4 rx, ry, rz;		// 1 / d
+        Float4 t, u, v;			// of the closest hit so far
+        int hit[4];				// its triangle, -1 for none
+    };
+
+    vector< vector<MeshSource> > objects;
+    TextureLibrary &textures;
+
+    vector<glm::vec3> corners;		// built from, in instance order
+    vector<Shading> unordered;
+    TriangleBVH bvh;
+    vector<Triangle> triangles;		// traced, in leaf order
+    vector<Shading> shading;
+
+    int width, height;
+    vector<unsigned int> image;
+    glm::mat4 inverseViewProjection;
+    glm::vec3 eye;
+    float spread;
+
+    static void forChunks(JobSystem *jobs, unsigned int n, unsigned int chunk, const JobSystem::Job &f)
+    {
+        if(jobs)
+            jobs->parallelFor(n, chunk, f);
+        else if(n > 0)
+            f(0, n, 0);
+    }
+
+    void addInstance(const vector<MeshSource> &object, const glm::mat4 &model, unsigned int t, vector<glm::vec3> &positions)
+    {
+        for(unsigned int m = 0; m < object.size(); m++)
+        {
+            const Mesh &mesh = *object[m].mesh;
+            const TextureImage *texture = object[m].image && !object[m].image->empty() ? object[m].image : NULL;
+            positions.resize(mesh.vertices.size());
+            for(unsigned int i = 0; i < mesh.vertices.size(); i++)
+                positions[i] = glm::vec3(model * glm::vec4(mesh.vertices[i].Position, 1.0f));
+            for(unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3, t++)
+            {
+                const Vertex &a = mesh.vertices[mesh.indices[i]], &b = mesh.vertices[mesh.indices[i + 1]], &c = mesh.vertices[mesh.indices[i + 2]];
+                glm::vec3 *p = &corners[3 * t];
+                p[0] = positions[mesh.indices[i]];
+                p[1] = positions[mesh.indices[i + 1]];
+                p[2] = positions[mesh.indices[i + 2]];
+                Shading &s = unordered[t];
+                s.uv0 = a.TexCoords;
+                s.uv1 = b.TexCoords;
+                s.uv2 = c.TexCoords;
+                s.image = texture;
+                s.lodBias = 0.0f;
+                if(texture)
+                {
+                    glm::vec2 du = b.TexCoords - a.TexCoords, dv = c.TexCoords - a.TexCoords;
+                    float texels = fabs(du.x * dv.y - du.y * dv.x) * texture->width() * texture->height();
+                    float area = glm::length(glm::cross(p[1] - p[0], p[2] - p[0]));
+                    s.lodBias = texels > 0.0f && area > 0.0f ? 0.5f * log2(texels / area) : 0.0f;
+                }
+            }
+        }
+    }
+
+    // traces all the samples of a tile and returns how many rays that took
+    unsigned long long renderTile(int x0, int y0)
+    {
+        int x1 = min(x0 + TILE, width), y1 = min(y0 + TILE, height);
+        int n = max(samples, 1);
+        float weight = 1.0f / (n * n);
+        unsigned long long rays = 0;
+        for(int y = y0; y < y1; y += 2)
+            for(int x = x0; x < x1; x += 2)
+            {
+                glm::vec4 sum[4] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+                for(int sy = 0; sy < n; sy++)
+                    for(int sx = 0; sx < n; sx++)
+                    {
+                        float ox = (sx + 0.5f) / n, oy = (sy + 0.5f) / n;
+                        RayPacket packet;
+                        generate(packet, Float4(x + ox, x + 1 + ox, x + ox, x + 1 + ox), Float4(y + oy, y + oy, y + 1 + oy, y + 1 + oy));
+                        trace(packet);
+                        for(int lane = 0; lane < 4; lane++)
+                            sum[lane] += shade(packet, lane);
+                        rays += 4;
+                    }
+                for(int lane = 0; lane < 4; lane++)
+                {
+                    int px = x + (lane & 1), py = y + (lane >> 1);
+                    if(px < x1 && py < y1)
+                        image[py * width + px] = pack(sum[lane] * weight);
+                }
+            }
+        return rays;
+    }
+
+    // the rays through four points of the image, in pixels from its top left corner
+    void generate(RayPacket &packet, Float4 px, Float4 py) const
+    {
+        float o[3][4], d[3][4];
+        for(int lane = 0; lane < 4; lane++)
+        {
+            float x = 2.0f * px[lane] / width - 1.0f, y = 1.0f - 2.0f * py[lane] / height;
+            glm::vec4 front = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+            glm::vec4 back = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+            glm::vec3 from = glm::vec3(front) / front.w, direction = glm::vec3(back) / back.w - from;
+            for(int axis = 0; axis < 3; axis++)
+            {
+                o[axis][lane] = from[axis];
+                // keeps 1 / d finite, which the slab test needs
+                d[axis][lane] = fabs(direction[axis]) > 1e-20f ? direction[axis] : 1e-20f;
+            }
+            packet.hit[lane] = -1;
+        }
+        packet.ox = Float4(o[0][0], o[0][1], o[0][2], o[0][3]);
+        packet.oy = Float4(o[1][0], o[1][1], o[1][2], o[1][3]);
+        packet.oz = Float4(o[2][0], o[2][1], o[2][2], o[2][3]);
+        packet.dx = Float4(d[0][0], d[0][1], d[0][2], d[0][3]);
+        packet.dy = Float4(d[1][0], d[1][1], d[1][2], d[1][3]);
+        packet.dz = Float4(d[2][0], d[2][1], d[2][2], d[2][3]);
+        packet.rx = Float4(1.0f) / packet.dx;
+        packet.ry = Float4(1.0f) / packet.dy;
+        packet.rz = Float4(1.0f) / packet.dz;
+        packet.t = Float4(1.0f);
+        packet.u = packet.v = Float4(0.0f);
+    }
+
+    // the slab test of the four rays against a node's box, up to their closest hits so far: returns the
+    // lanes that hit it and, in `entry`, where the first of them enters it
+    static int enter(const BVHNode &node, const RayPacket &packet, float &entry)
+    {
+        Float4 ax = (Float4(node.lower.x) - packet.ox) * packet.rx, bx = (Float4(node.upper.x) - packet.ox) * packet.rx;
+        Float4 ay = (Float4(node.lower.y) - packet.oy) * packet.ry, by = (Float4(node.upper.y) - packet.oy) * packet.ry;
+        Float4 az = (Float4(node.lower.z) - packet.oz) * packet.rz, bz = (Float4(node.upper.z) - packet.oz) * packet.rz;
+        Float4 in = max(max(min(ax, bx), min(ay, by)), max(min(az, bz), Float4(0.0f)));
+        Float4 out = min(min(max(ax, bx), max(ay, by)), min(max(az, bz), packet.t));
+        int hit = bits(in <= out);
+        entry = FLT_MAX;
+        for(int lane = 0; lane < 4; lane++)
+            if(hit >> lane & 1)
+                entry = std::min(entry, in[lane]);
+        return hit;
+    }
+
+    void trace(RayPacket &packet) const
+    {
+        if(triangles.empty())
+            return;
+        struct Entry {
+            unsigned int node;
+            float distance;
+        } stack[STACK];
+        int top = 0;
+        float distance;
+        if(!enter(bvh.nodes[0], packet, distance))
+            return;
+        stack[top].node = 0;
+        stack[top++].distance = distance;
+        while(top > 0)
+        {
+            Entry entry = stack[--top];
+            // skip nodes behind the hits found since they were pushed
+            float farthest = max(max(packet.t[0], packet.t[1]), max(packet.t[2], packet.t[3]));
+            if(entry.distance > farthest)
+                continue;
+            const BVHNode &node = bvh.nodes[entry.node];
+            if(node.count > 0)
+            {
+                for(unsigned int i = node.start; i < node.start + node.count; i++)
+                    intersect(i, packet);
+                continue;
+            }
+            float nearDistance, farDistance;
+            unsigned int nearChild = node.start, farChild = node.start + 1;
+            int nearHit = enter(bvh.nodes[nearChild], packet, nearDistance);
+            int farHit = enter(bvh.nodes[farChild], packet, farDistance);
+            if(farHit && nearHit && farDistance < nearDistance)
+            {
+                swap(nearChild, farChild);
+                swap(nearDistance, farDistance);
+            }
+            else if(!nearHit)
+            {
+                nearChild = farChild;
+                nearDistance = farDistance;
+                nearHit = farHit;
+                farHit = 0;
+            }
+            // the stack holds one entry per level at most, and no build gets near STACK levels
+            if(farHit && top < STACK)
+            {
+                stack[top].node = farChild;
+                stack[top++].distance = farDistance;
+            }
+            if(nearHit && top < STACK)
+            {
+                stack[top].node = nearChild;
+                stack[top++].distance = nearDistance;
+            }
+        }
+    }
+
+    // Möller-Trumbore for the four rays against one triangle, keeping the hits closer than the ones so far
+    void intersect(unsigned int index, RayPacket &packet) const
+    {
+        const Triangle &tri = triangles[index];
+        Float4 e1x(tri.e1.x), e1y(tri.e1.y), e1z(tri.e1.z), e2x(tri.e2.x), e2y(tri.e2.y), e2z(tri.e2.z);
+        // p = d x e2
+        Float4 px = packet.dy * e2z - packet.dz * e2y, py = packet.dz * e2x - packet.dx * e2z, pz = packet.dx * e2y - packet.dy * e2x;
+        Float4 inverse = Float4(1.0f) / (e1x * px + e1y * py + e1z * pz);
+        Float4 sx = packet.ox - Float4(tri.v0.x), sy = packet.oy - Float4(tri.v0.y), sz = packet.oz - Float4(tri.v0.z);
+        Float4 u = (sx * px + sy * py + sz * pz) * inverse;
+        // q = s x e1
+        Float4 qx = sy * e1z - sz * e1y, qy = sz * e1x - sx * e1z, qz = sx * e1y - sy * e1x;
+        Float4 v = (packet.dx * qx + packet.dy * qy + packet.dz * qz) * inverse;
+        Float4 t = (e2x * qx + e2y * qy + e2z * qz) * inverse;
+        Float4 zero(0.0f);
+        // NaNs from parallel rays fail every comparison
+        Float4 hit = (zero <= u) & (zero <= v) & (u + v <= Float4(1.0f)) & (zero <= t) & (t < packet.t);
+        int lanes = bits(hit);
+        if(!lanes)
+            return;
+        packet.t = select(hit, t, packet.t);
+        packet.u = select(hit, u, packet.u);
+        packet.v = select(hit, v, packet.v);
+        for(int lane = 0; lane < 4; lane++)
+            if(lanes >> lane & 1)
+                packet.hit[lane] = index;
+    }
+
+    glm::vec4 shade(const RayPacket &packet, int lane) const
+    {
+        if(packet.hit[lane] < 0)
+            return clearColor;
+        const Shading &s = shading[packet.hit[lane]];
+        if(!s.image)
+            return glm::vec4(1.0f);
+        float u = packet.u[lane], v = packet.v[lane];
+        glm::vec2 uv = s.uv0 * (1.0f - u - v) + s.uv1 * u + s.uv2 * v;
+        // ray cone: the footprint's width grows with the distance and with how grazing the hit is
+        glm::vec3 d(packet.dx[lane], packet.dy[lane], packet.dz[lane]);
+        glm::vec3 o(packet.ox[lane], packet.oy[lane], packet.oz[lane]);
+        const Triangle &tri = triangles[packet.hit[lane]];
+        glm::vec3 normal = glm::normalize(glm::cross(tri.e1, tri.e2));
+        float cosine = max(fabs(glm::dot(normal, glm::normalize(d))), 1e-4f);
+        float width = spread * glm::length(o + d * packet.t[lane] - eye);
+        float lod = s.lodBias + log2(width) - log2(cosine);
+        return s.image->sample(uv, lod);
+    }
+
+    static unsigned int pack(const glm::vec4 &c)
+    {
+        glm::vec4 b = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (unsigned int)b.r | (unsigned int)b.g << 8 | (unsigned int)b.b << 16 | (unsigned int)b.a << 24;
+    }
+};
+#endif
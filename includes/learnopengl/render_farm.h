@@ -0,0 +1,465 @@
+#ifndef RENDER_FARM_H
+#define RENDER_FARM_H
+
+#include <glm/glm.hpp>
+#include <zlib.h>
+
+#include <learnopengl/benchmark.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+using namespace std;
+
+// One job of a farm: a saved scene seen along a camera path, rendered at a resolution over a range of frames.
+struct FarmJob {
+    string name, scene, out;
+    unsigned int width, height;
+    int first, last;				// frame range, inclusive
+    vector<CameraKey> cameraPath;
+
+    int frames() const { return last - first + 1; }
+
+    string framePath(int frame) const
+    {
+        char name[32];
+        sprintf(name, "/frame_%05d.png", frame);
+        return out + name;
+    }
+};
+
+// A few consecutive frames of a job, the unit of work handed to the workers.
+struct FarmTask {
+    int job, first, last;
+};
+
+// What a worker sends back for every frame it finished.
+struct FarmReport {
+    int pid, job, frame, ok;
+};
+
+// Batch offline rendering: --farm JOBS renders every job of a job list into a PNG sequence. The jobs are cut
+// into tasks of TASK_FRAMES frames and handed out to worker processes, a new task whenever a worker finishes
+// one, so all the cores stay busy to the end even when the jobs differ in size. The workers are the
+// application started again with --farm-worker JOBS; each has a headless context of its own and loads the
+// assets once for all the jobs it renders. They read their tasks from stdin and report every frame on fd 3,
+// which the farm turns into progress lines. When a worker dies, its unfinished frames go back in the queue.
+//
+// The job list is line based like the benchmark scripts, '#' starts a comment:
+//
+//   job <name>                       starts a job; the lines below, up to the next job, describe it
+//   scene <file>                     a scene written by the save key
+//   size 800x600                     resolution
+//   frames <first> <last>            frame range, inclusive
+//   camera <frame> x y z yaw pitch   camera path key, interpolated like in the benchmarks
+//   out <dir>                        where the frames go as frame_<n>.png; farm/<name> by default
+class RenderFarm
+{
+public:
+    static const int TASK_FRAMES = 8;
+    static const int TASK_FD = 0, REPORT_FD = 3;	// of the workers
+
+    string path;
+    vector<FarmJob> jobs;
+
+    bool load(const string &path)
+    {
+        this->path = path;
+        jobs.clear();
+        ifstream file(path.c_str());
+        if(!file)
+        {
+            cout << "ERROR::FARM:: Could not open job list " << path << endl;
+            return false;
+        }
+        string line;
+        int lineNr = 0;
+        while(getline(file, line))
+        {
+            lineNr++;
+            line = line.substr(0, line.find('#'));
+            istringstream in(line);
+            string keyword;
+            if(!(in >> keyword))
+                continue;
+
+            bool ok = keyword == "job" || !jobs.empty();
+            FarmJob *job = jobs.empty() ? NULL : &jobs.back();
+            if(!ok)
+                ;
+            else if(keyword == "job")
+            {
+                FarmJob next;
+                next.width = 800;
+                next.height = 600;
+                next.first = next.last = 0;
+                ok = (bool)(in >> next.name);
+                next.out = "farm/" + next.name;
+                jobs.push_back(next);
+            }
+            else if(keyword == "scene")
+                ok = (bool)(in >> job->scene);
+            else if(keyword == "out")
+                ok = (bool)(in >> job->out);
+            else if(keyword == "size")
+            {
+                string size;
+                ok = (in >> size) && sscanf(size.c_str(), "%ux%u", &job->width, &job->height) == 2 && job->width > 0 && job->height > 0;
+            }
+            else if(keyword == "frames")
+                ok = (in >> job->first >> job->last) && job->first >= 0 && job->last >= job->first;
+            else if(keyword == "camera")
+            {
+                CameraKey key;
+                ok = (bool)(in >> key.frame >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch);
+                job->cameraPath.push_back(key);
+            }
+            else
+                ok = false;
+
+            if(!ok)
+            {
+                cout << "ERROR::FARM:: " << path << ":" << lineNr << ": could not parse '" << line << "'" << endl;
+                return false;
+            }
+        }
+        for(unsigned int i = 0; i < jobs.size(); i++)
+            if(jobs[i].scene.empty())
+            {
+                cout << "ERROR::FARM:: " << path << ": job " << jobs[i].name << " has no scene" << endl;
+                return false;
+            }
+        return true;
+    }
+
+    // renders all the jobs on `workers` processes started from the executable `exe`, printing the progress.
+    // Returns true when every frame was written.
+    bool run(unsigned int workers, const string &exe)
+    {
+        deque<FarmTask> queue;
+        vector<int> left(jobs.size()), failed(jobs.size(), 0);
+        int total = 0;
+        for(unsigned int j = 0; j < jobs.size(); j++)
+        {
+            if(!makeDirectories(jobs[j].out))
+                return false;
+            for(int f = jobs[j].first; f <= jobs[j].last; f += TASK_FRAMES)
+            {
+                FarmTask task = { (int)j, f, min(f + TASK_FRAMES - 1, jobs[j].last) };
+                queue.push_back(task);
+            }
+            left[j] = jobs[j].frames();
+            total += left[j];
+        }
+        workers = max(1u, min(workers, (unsigned int)queue.size()));
+        printf(" Farm: %u jobs, %d frames in %u tasks on %u workers\n", (unsigned int)jobs.size(), total,
+               (unsigned int)queue.size(), workers);
+        if(queue.empty())
+            return true;
+
+        // a worker that died must not take the farm with it when it is handed its next task
+        signal(SIGPIPE, SIG_IGN);
+        int reports[2];
+        if(!openPipe(reports))
+            return false;
+        vector<Worker> pool(workers);
+        unsigned int alive = 0;
+        for(unsigned int i = 0; i < workers; i++)
+        {
+            int tasks[2];
+            if(!openPipe(tasks))
+                break;
+            pid_t pid = fork();
+            if(pid == 0)
+            {
+                // every other descriptor of the farm is close-on-exec, so the worker only keeps these two
+                dup2(tasks[0], TASK_FD);
+                dup2(reports[1], REPORT_FD);
+                fcntl(TASK_FD, F_SETFD, 0);
+                fcntl(REPORT_FD, F_SETFD, 0);
+                execl(exe.c_str(), exe.c_str(), "--farm-worker", path.c_str(), (char *)NULL);
+                _exit(127);
+            }
+            close(tasks[0]);
+            if(pid < 0)
+            {
+                close(tasks[1]);
+                break;
+            }
+            pool[alive].pid = pid;
+            pool[alive].tasks = tasks[1];
+            pool[alive].busy = false;
+            alive++;
+        }
+        pool.resize(alive);
+        close(reports[1]);
+        if(alive == 0)
+        {
+            cout << "ERROR::FARM:: Could not start the workers: " << strerror(errno) << endl;
+            close(reports[0]);
+            return false;
+        }
+        for(unsigned int i = 0; i < pool.size(); i++)
+            assign(pool[i], queue);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        int done = 0, errors = 0;
+        while(done < total && alive > 0)
+        {
+            struct pollfd fd = { reports[0], POLLIN, 0 };
+            poll(&fd, 1, 500);
+
+            // reap first and read after, so the last reports of a worker that died are in before its frames are
+            // given back
+            vector<pid_t> dead;
+            pid_t pid;
+            int status;
+            while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+                dead.push_back(pid);
+
+            FarmReport report;
+            while(poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN) && readAll(reports[0], &report, sizeof(report)))
+            {
+                Worker *w = find(pool, report.pid);
+                if(!w || report.job < 0 || report.job >= (int)jobs.size())
+                    continue;
+                const FarmJob &job = jobs[report.job];
+                done++;
+                left[report.job]--;
+                if(!report.ok)
+                {
+                    failed[report.job]++;
+                    errors++;
+                }
+                w->next = report.frame + 1;
+                double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                printf("\r [%3d%%] %d/%d frames, %.1f frames/s, %.0f s left   ", 100 * done / total, done, total,
+                       done / elapsed, (total - done) * elapsed / done);
+                if(left[report.job] == 0)
+                {
+                    if(failed[report.job])
+                        printf("\n ERROR::FARM:: Job %s: %d of %d frames could not be written\n", job.name.c_str(),
+                               failed[report.job], job.frames());
+                    else
+                        printf("\n Job %s done: %d frames of %ux%u in %s\n", job.name.c_str(), job.frames(), job.width,
+                               job.height, job.out.c_str());
+                }
+                fflush(stdout);
+                if(w->busy && w->next > w->task.last)
+                    assign(*w, queue);
+            }
+
+            for(unsigned int i = 0; i < dead.size(); i++)
+            {
+                Worker *w = find(pool, dead[i]);
+                if(!w || w->pid < 0)
+                    continue;
+                if(w->busy)
+                {
+                    printf("\n ERROR::FARM:: Worker %d stopped during job %s, its frames %d to %d go to the others\n",
+                           (int)w->pid, jobs[w->task.job].name.c_str(), w->next, w->task.last);
+                    FarmTask rest = { w->task.job, w->next, w->task.last };
+                    queue.push_front(rest);
+                }
+                if(w->tasks >= 0)
+                    close(w->tasks);
+                w->tasks = -1;
+                w->pid = -1;
+                w->busy = false;
+                alive--;
+                // idle workers pick the frames up
+                for(unsigned int k = 0; k < pool.size(); k++)
+                    if(pool[k].pid >= 0 && !pool[k].busy)
+                        assign(pool[k], queue);
+            }
+        }
+        printf("\n");
+
+        // closing the task pipes tells the workers to quit
+        for(unsigned int i = 0; i < pool.size(); i++)
+            if(pool[i].tasks >= 0)
+                close(pool[i].tasks);
+        for(unsigned int i = 0; i < pool.size(); i++)
+            if(pool[i].pid >= 0)
+                waitpid(pool[i].pid, NULL, 0);
+        close(reports[0]);
+
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(done < total)
+            cout << "ERROR::FARM:: All workers stopped, " << total - done << " frames were not rendered" << endl;
+        printf(" Farm: %d frames in %.1f s, %.2f frames/s, %d failed\n", done, elapsed, done / elapsed, errors + total - done);
+        return done == total && errors == 0;
+    }
+
+    // worker side: waits for the next task; false once the farm has none left
+    static bool nextTask(FarmTask &task)
+    {
+        return readAll(TASK_FD, &task, sizeof(task));
+    }
+
+    // worker side: tells the farm that a frame of a task is done
+    static void report(const FarmTask &task, int frame, bool ok)
+    {
+        // smaller than PIPE_BUF, so the reports of the workers never interleave
+        FarmReport report = { (int)getpid(), task.job, frame, ok };
+        ssize_t written = write(REPORT_FD, &report, sizeof(report));
+        (void)written;
+    }
+
+    // writes 8 bit RGB pixels as a PNG; `bottomUp` when the rows start at the bottom, as GL reads them
+    static bool writePNG(const string &path, unsigned int width, unsigned int height, const unsigned char *rgb, bool bottomUp)
+    {
+        // every row starts with its filter; "up" stores the difference to the row above, which deflates better
+        size_t stride = width * 3;
+        vector<unsigned char> raw((stride + 1) * height);
+        for(unsigned int y = 0; y < height; y++)
+        {
+            const unsigned char *row = rgb + (bottomUp ? height - 1 - y : y) * stride;
+            const unsigned char *above = y == 0 ? NULL : rgb + (bottomUp ? height - y : y - 1) * stride;
+            unsigned char *out = &raw[y * (stride + 1)];
+            out[0] = 2;
+            for(size_t x = 0; x < stride; x++)
+                out[1 + x] = row[x] - (above ? above[x] : 0);
+        }
+        uLongf size = compressBound(raw.size());
+        vector<unsigned char> data(size);
+        if(compress2(&data[0], &size, &raw[0], raw.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+            return false;
+
+        FILE *file = fopen(path.c_str(), "wb");
+        if(!file)
+        {
+            cout << "ERROR::FARM:: Could not write " << path << endl;
+            return false;
+        }
+        static const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+        unsigned char header[13];
+        putBigEndian(header, width);
+        putBigEndian(header + 4, height);
+        header[8] = 8;		// bits per channel
+        header[9] = 2;		// RGB
+        header[10] = header[11] = header[12] = 0;
+        fwrite(signature, 1, 8, file);
+        writeChunk(file, "IHDR", header, 13);
+        writeChunk(file, "IDAT", &data[0], size);
+        writeChunk(file, "IEND", NULL, 0);
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
+    }
+
+    // creates a directory and its parents, like mkdir -p
+    static bool makeDirectories(const string &path)
+    {
+        for(size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+        {
+            string dir = path.substr(0, slash);
+            if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                cout << "ERROR::FARM:: Could not create " << dir << ": " << strerror(errno) << endl;
+                return false;
+            }
+            if(slash == string::npos)
+                return true;
+        }
+    }
+
+private:
+    struct Worker {
+        pid_t pid;			// -1 once it is gone
+        int tasks;			// write end of its task pipe, -1 once closed
+        bool busy;
+        FarmTask task;
+        int next;			// first frame of the task it hasn't reported yet
+    };
+
+    // hands the next task to a worker; with none left it idles until the end, in case a worker dies and its
+    // frames come back
+    static void assign(Worker &w, deque<FarmTask> &queue)
+    {
+        w.busy = false;
+        if(queue.empty() || w.tasks < 0)
+            return;
+        w.task = queue.front();
+        queue.pop_front();
+        w.next = w.task.first;
+        w.busy = true;
+        if(write(w.tasks, &w.task, sizeof(w.task)) != (ssize_t)sizeof(w.task))
+        {
+            // it died; the frames come back when it is reaped
+            close(w.tasks);
+            w.tasks = -1;
+        }
+    }
+
+    static Worker *find(vector<Worker> &pool, pid_t pid)
+    {
+        for(unsigned int i = 0; i < pool.size(); i++)
+            if(pool[i].pid == pid)
+                return &pool[i];
+        return NULL;
+    }
+
+    static bool openPipe(int fds[2])
+    {
+        if(pipe(fds) != 0)
+            return false;
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return true;
+    }
+
+    static bool readAll(int fd, void *data, size_t size)
+    {
+        char *p = (char *)data;
+        while(size > 0)
+        {
+            ssize_t n = read(fd, p, size);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                return false;
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static void putBigEndian(unsigned char *out, unsigned int value)
+    {
+        out[0] = value >> 24;
+        out[1] = value >> 16;
+        out[2] = value >> 8;
+        out[3] = value;
+    }
+
+    static void writeChunk(FILE *file, const char *type, const unsigned char *data, unsigned int size)
+    {
+        unsigned char length[4], crc[4];
+        putBigEndian(length, size);
+        uLong sum = crc32(0, (const Bytef *)type, 4);
+        if(size > 0)
+            sum = crc32(sum, data, size);
+        putBigEndian(crc, sum);
+        fwrite(length, 1, 4, file);
+        fwrite(type, 1, 4, file);
+        if(size > 0)
+            fwrite(data, 1, size, file);
+        fwrite(crc, 1, 4, file);
+    }
+};
+#endif
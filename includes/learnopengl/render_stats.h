@@ -0,0 +1,69 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <glad/glad.h>
+
+// Counters for the GL work submitted each frame. Reset once per frame by the render loop and read back
+// by whoever wants to report them (state printout, benchmark report, ...).
+struct RenderStats {
+    unsigned int drawCalls;
+    unsigned int textureBinds;
+    unsigned int redundantBinds;	// binds skipped because the texture was already bound to that unit
+    unsigned int uniformUpdates;
+    double submitTime;				// CPU time spent issuing GL calls for the frame, in seconds
+    unsigned long long streamedBytes;	// written into the stream buffer
+    unsigned int streamStalls;		// times the stream buffer had to wait for the GPU
+
+    RenderStats() { reset(); }
+
+    void reset()
+    {
+        drawCalls = 0;
+        textureBinds = 0;
+        redundantBinds = 0;
+        uniformUpdates = 0;
+        submitTime = 0.0;
+        streamedBytes = 0;
+        streamStalls = 0;
+    }
+};
+
+inline RenderStats &renderStats()
+{
+    static RenderStats stats;
+    return stats;
+}
+
+// binds a texture to a texture unit, skipping the call if it is already bound there.
+// ---------------------------------------------------------------------------------
+const unsigned int MAX_TRACKED_TEXTURE_UNITS = 16;
+
+inline unsigned int *boundTextures()
+{
+    static unsigned int bound[MAX_TRACKED_TEXTURE_UNITS] = { 0 };
+    return bound;
+}
+
+inline void bindTexture(GLenum target, unsigned int unit, unsigned int id)
+{
+    unsigned int *bound = boundTextures();
+    if(unit < MAX_TRACKED_TEXTURE_UNITS && bound[unit] == id)
+    {
+        renderStats().redundantBinds++;
+        return;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, id);
+    if(unit < MAX_TRACKED_TEXTURE_UNITS)
+        bound[unit] = id;
+    renderStats().textureBinds++;
+}
+
+// forget the cached bindings, e.g. after textures were bound behind our back or a context was recreated.
+inline void invalidateTextureBindings()
+{
+    unsigned int *bound = boundTextures();
+    for(unsigned int i = 0; i < MAX_TRACKED_TEXTURE_UNITS; i++)
+        bound[i] = 0;
+}
+#endif
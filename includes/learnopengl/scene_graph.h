@@ -0,0 +1,220 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/entity_store.h>
+
+#include <vector>
+#include <cstring>
+using namespace std;
+
+// Parent/child relations between the instances of a scene. Nodes are identified by the same index as their
+// instance; the graph itself keeps them flattened in breadth-first order (every parent before its children),
+// so world matrices are computed in a single linear pass in which a node only needs its parent's result.
+// A node whose local matrix didn't change since the last pass, under a parent that didn't change either, is
+// skipped, so only dirty subtrees are recomputed. Children are kept in intrusive sibling lists, so
+// reparenting and removing only touch the nodes involved; the flattened order is rebuilt in O(n) by the
+// next update().
+class SceneGraph
+{
+public:
+    SceneGraph() : firstRoot(-1), orderDirty(true) {}
+
+    unsigned int size() const { return parent.size(); }
+
+    // appends a node and returns its index.
+    unsigned int add(int parentNode = -1)
+    {
+        parent.push_back(-1);
+        firstChild.push_back(-1);
+        nextSibling.push_back(-1);
+        prevSibling.push_back(-1);
+        worldByNode.push_back(glm::mat4());
+        link(size() - 1, parentNode);
+        orderDirty = true;
+        return size() - 1;
+    }
+
+    // replaces the graph with one node per entry of `parents` (-1 for a root), linked in one pass instead of
+    // a setParent() each; fails, leaving the graph empty, if the parents make a cycle.
+    bool assign(const vector<int> &parents)
+    {
+        clear();
+        unsigned int n = parents.size();
+        parent.assign(n, -1);
+        firstChild.assign(n, -1);
+        nextSibling.assign(n, -1);
+        prevSibling.assign(n, -1);
+        worldByNode.resize(n);
+        // linked back to front, so siblings keep the order of their indices
+        for(unsigned int i = n; i-- > 0;)
+            link(i, parents[i]);
+        // a node on a cycle can't be reached from any root
+        rebuild();
+        if(order.size() != n)
+        {
+            clear();
+            return false;
+        }
+        return true;
+    }
+
+    // removes a node by moving the last node into its place (see EntityStore::destroy); its children move
+    // up to its parent.
+    void swapRemove(unsigned int node)
+    {
+        int up = parent[node];
+        while(firstChild[node] >= 0)
+        {
+            int child = firstChild[node];
+            unlink(child);
+            link(child, up);
+        }
+        unlink(node);
+
+        unsigned int last = size() - 1;
+        if(node != last)
+        {
+            // the last node takes over the index: fix everything that points at it
+            for(int c = firstChild[last]; c >= 0; c = nextSibling[c])
+                parent[c] = node;
+            if(prevSibling[last] >= 0)
+                nextSibling[prevSibling[last]] = node;
+            else
+                head(parent[last]) = node;
+            if(nextSibling[last] >= 0)
+                prevSibling[nextSibling[last]] = node;
+        }
+        ::swapRemove(parent, node);
+        ::swapRemove(firstChild, node);
+        ::swapRemove(nextSibling, node);
+        ::swapRemove(prevSibling, node);
+        ::swapRemove(worldByNode, node);
+        orderDirty = true;
+    }
+
+    void clear()
+    {
+        parent.clear();
+        firstChild.clear();
+        nextSibling.clear();
+        prevSibling.clear();
+        worldByNode.clear();
+        firstRoot = -1;
+        orderDirty = true;
+    }
+
+    int parentOf(unsigned int node) const { return parent[node]; }
+
+    vector<unsigned int> children(unsigned int node) const
+    {
+        vector<unsigned int> result;
+        for(int c = firstChild[node]; c >= 0; c = nextSibling[c])
+            result.push_back(c);
+        return result;
+    }
+
+    // makes `node` a child of `parentNode` (-1 for a root); fails if that would create a cycle.
+    bool setParent(unsigned int node, int parentNode)
+    {
+        for(int p = parentNode; p >= 0; p = parent[p])
+            if(p == (int)node)
+                return false;
+        unlink(node);
+        link(node, parentNode);
+        orderDirty = true;
+        return true;
+    }
+
+    // computes the world matrices from the nodes' local matrices; the result is indexed by node.
+    template<class Allocator>
+    const vector<glm::mat4> &update(const vector<glm::mat4, Allocator> &local)
+    {
+        bool all = orderDirty;
+        if(orderDirty)
+            rebuild();
+
+        for(unsigned int k = 0; k < order.size(); k++)
+        {
+            unsigned int node = order[k];
+            int p = orderParent[k];
+            bool changed = all || (p >= 0 && slotChanged[p]) || memcmp(&cachedLocal[k], &local[node], sizeof(glm::mat4)) != 0;
+            slotChanged[k] = changed;
+            if(!changed)
+                continue;
+            cachedLocal[k] = local[node];
+            worldBySlot[k] = p < 0 ? local[node] : worldBySlot[p] * local[node];
+            worldByNode[node] = worldBySlot[k];
+        }
+        return worldByNode;
+    }
+
+    const vector<glm::mat4> &world() const { return worldByNode; }
+
+private:
+    // by node
+    vector<int> parent;
+    vector<int> firstChild;
+    vector<int> nextSibling;
+    vector<int> prevSibling;
+    int firstRoot;
+
+    // flattened breadth-first arrays, by slot
+    vector<unsigned int> order;		// node in each slot
+    vector<int> orderParent;		// slot of the parent, always smaller than the node's own slot
+    vector<glm::mat4> cachedLocal;	// local matrix used by the last update
+    vector<glm::mat4> worldBySlot;
+    vector<unsigned char> slotChanged;
+
+    vector<glm::mat4> worldByNode;
+    bool orderDirty;
+
+    int &head(int parentNode) { return parentNode < 0 ? firstRoot : firstChild[parentNode]; }
+
+    void link(unsigned int node, int parentNode)
+    {
+        parent[node] = parentNode;
+        prevSibling[node] = -1;
+        nextSibling[node] = head(parentNode);
+        if(nextSibling[node] >= 0)
+            prevSibling[nextSibling[node]] = node;
+        head(parentNode) = node;
+    }
+
+    void unlink(unsigned int node)
+    {
+        if(prevSibling[node] >= 0)
+            nextSibling[prevSibling[node]] = nextSibling[node];
+        else
+            head(parent[node]) = nextSibling[node];
+        if(nextSibling[node] >= 0)
+            prevSibling[nextSibling[node]] = prevSibling[node];
+        prevSibling[node] = nextSibling[node] = -1;
+    }
+
+    void rebuild()
+    {
+        unsigned int n = size();
+        order.clear();
+        orderParent.clear();
+        for(int c = firstRoot; c >= 0; c = nextSibling[c])
+        {
+            order.push_back(c);
+            orderParent.push_back(-1);
+        }
+        for(unsigned int k = 0; k < order.size(); k++)
+        {
+            for(int c = firstChild[order[k]]; c >= 0; c = nextSibling[c])
+            {
+                order.push_back(c);
+                orderParent.push_back(k);
+            }
+        }
+        cachedLocal.resize(n);
+        worldBySlot.resize(n);
+        slotChanged.assign(n, 1);
+        orderDirty = false;
+    }
+};
+#endif
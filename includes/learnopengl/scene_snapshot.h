@@ -0,0 +1,505 @@
+#ifndef SCENE_SNAPSHOT_H
+#define SCENE_SNAPSHOT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/transform_store.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+using namespace std;
+
+// A read only view of a whole file: mapped where the system can, read into memory where it can't.
+class MappedFile
+{
+public:
+    const unsigned char *data;
+    size_t size;
+
+    MappedFile() : data(NULL), size(0) {}
+    ~MappedFile() { close(); }
+
+    bool open(const string &path)
+    {
+        close();
+#ifdef _WIN32
+        FILE *file = fopen(path.c_str(), "rb");
+        if(!file)
+            return false;
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        buffer.resize(length > 0 ? length : 0);
+        bool ok = length >= 0 && fread(buffer.empty() ? NULL : &buffer[0], 1, buffer.size(), file) == buffer.size();
+        fclose(file);
+        data = buffer.empty() ? NULL : &buffer[0];
+        size = buffer.size();
+        return ok;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        if(ok && info.st_size > 0)
+        {
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            flags |= MAP_POPULATE;	// it is all read right away, fault it in at once
+#endif
+            void *mapping = mmap(NULL, info.st_size, PROT_READ, flags, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if(ok)
+            {
+                data = (const unsigned char *)mapping;
+                size = info.st_size;
+            }
+        }
+        ::close(fd);
+        return ok;
+#endif
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        buffer.clear();
+#else
+        if(data)
+            munmap((void *)data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+#ifdef _WIN32
+    vector<unsigned char> buffer;
+#endif
+};
+
+// The camera of a snapshot.
+struct SnapshotCamera {
+    glm::vec3 position;
+    float yaw, pitch, zoom;
+};
+
+// The scene an user built, instances and camera, in a binary file that loads with a handful of copies out of
+// a mapping. The layout (little endian, every section 16 byte aligned so the arrays can be used in place):
+//
+//   header       SnapshotHeader: magic, version, counts, the log's extent and the camera
+//   assets       the paths of the models, each ended by a 0; instances refer to them by index
+//   objs         int[instances], the asset of each instance
+//   parents      int[instances], -1 for none
+//   positions    float[3 * instances]
+//   rotations    float[4 * instances], quaternions as x y z w
+//   scales       float[3 * instances]
+//   shears       float[6 * instances], xy xz yx yz zx zy
+//   log          SnapshotRecord[records]
+//
+// Saving again to the same file only appends a record for every instance that changed since (and for the
+// camera), then moves the end of the log in the header, so a crash in the middle leaves the previous state.
+// Loading replays the log over the arrays. Once the log outgrows the arrays, the next save rewrites the file.
+class SceneSnapshot
+{
+public:
+    static const unsigned int VERSION = 1;
+
+    struct SnapshotHeader {
+        char magic[8];
+        unsigned int version;
+        unsigned int headerSize;
+        unsigned int instances;
+        unsigned int assets;
+        unsigned int assetBytes;
+        unsigned int records;
+        unsigned long long logStart, logEnd;
+        SnapshotCamera camera;
+        unsigned int reserved[2];
+    };
+
+    enum RecordType { RECORD_INSTANCE = 1, RECORD_RESIZE = 2, RECORD_CAMERA = 3 };
+
+    // an instance at `index` (appended when it is the last index plus one), a new instance count in `index`,
+    // or the camera in the first floats of `data`
+    struct SnapshotRecord {
+        unsigned int type;
+        unsigned int index;
+        int obj, parent;
+        float data[16];		// position, rotation, scale, shear
+    };
+
+    // the scene, instances in the application's dense order
+    vector<string> assets;
+    vector<int> objs, parents;
+    vector<glm::vec3> position;
+    vector<glm::quat> rotation;
+    vector<glm::vec3> scale;
+    vector<Shear> shear;
+    SnapshotCamera camera;
+
+    // what the last save() did
+    bool appended;
+    unsigned int writtenRecords;
+    size_t writtenBytes;
+
+    SceneSnapshot() : appended(false), writtenRecords(0), writtenBytes(0), savedSize(0), base(SnapshotHeader())
+    {
+        SnapshotCamera none = { glm::vec3(0.0f), 0.0f, 0.0f, 0.0f };
+        camera = none;
+    }
+
+    unsigned int size() const { return objs.size(); }
+
+    // writes the scene to `path`: appended to the file when it is the one this snapshot last saved or loaded
+    // and nobody changed it since, else as a new file
+    bool save(const string &path)
+    {
+        appended = false;
+        writtenRecords = 0;
+        writtenBytes = 0;
+        if(path == savedPath && assets == saved.assets && fileSize(path) == (long long)savedSize)
+        {
+            vector<SnapshotRecord> records;
+            diff(records);
+            if((base.records + records.size()) * sizeof(SnapshotRecord) <= arraysSize(size(), assetBytes(assets)))
+                return append(path, records);
+        }
+        return write(path);
+    }
+
+    bool load(const string &path)
+    {
+        MappedFile file;
+        if(!file.open(path))
+        {
+            cout << "ERROR::SNAPSHOT:: Could not open " << path << endl;
+            return false;
+        }
+        if(file.size < sizeof(SnapshotHeader))
+            return fail(path, "too short for a snapshot");
+        const SnapshotHeader &header = *(const SnapshotHeader *)file.data;
+        if(memcmp(header.magic, magic(), sizeof(header.magic)) != 0)
+            return fail(path, "not a scene snapshot");
+        if(header.version != VERSION || header.headerSize < sizeof(header))
+            return fail(path, "written by another version");
+
+        Layout at = layout(header.headerSize, header.instances, header.assetBytes);
+        if(header.logStart != at.end || header.logEnd > file.size || header.logEnd < header.logStart
+           || header.logEnd - header.logStart != (unsigned long long)header.records * sizeof(SnapshotRecord))
+            return fail(path, "truncated or damaged");
+
+        // the asset paths, each ended by a 0
+        vector<string> names;
+        const char *text = (const char *)file.data + at.assets, *textEnd = text + header.assetBytes;
+        while(text < textEnd && names.size() < header.assets)
+        {
+            const char *end = (const char *)memchr(text, 0, textEnd - text);
+            if(!end)
+                break;
+            names.push_back(string(text, end));
+            text = end + 1;
+        }
+        if(names.size() != header.assets)
+            return fail(path, "damaged asset table");
+
+        unsigned int n = header.instances;
+        vector<int> o, p;
+        vector<glm::vec3> pos, scl;
+        vector<glm::quat> rot;
+        vector<Shear> shr;
+        copyArray(file.data + at.objs, n, o);
+        copyArray(file.data + at.parents, n, p);
+        copyArray(file.data + at.position, n, pos);
+        copyArray(file.data + at.rotation, n, rot);
+        copyArray(file.data + at.scale, n, scl);
+        copyArray(file.data + at.shear, n, shr);
+        SnapshotCamera cam = header.camera;
+
+        for(unsigned int k = 0; k < header.records; k++)
+        {
+            const SnapshotRecord &r = *(const SnapshotRecord *)(file.data + header.logStart + k * sizeof(SnapshotRecord));
+            if(r.type == RECORD_INSTANCE && r.index <= o.size())
+            {
+                if(r.index == o.size())
+                {
+                    o.push_back(0);
+                    p.push_back(-1);
+                    pos.push_back(glm::vec3(0.0f));
+                    rot.push_back(glm::quat());
+                    scl.push_back(glm::vec3(1.0f));
+                    shr.push_back(Shear());
+                }
+                o[r.index] = r.obj;
+                p[r.index] = r.parent;
+                const float *d = r.data;
+                pos[r.index] = glm::vec3(d[0], d[1], d[2]);
+                rot[r.index] = glm::quat(d[6], d[3], d[4], d[5]);
+                scl[r.index] = glm::vec3(d[7], d[8], d[9]);
+                Shear h = { d[10], d[11], d[12], d[13], d[14], d[15] };
+                shr[r.index] = h;
+            }
+            else if(r.type == RECORD_RESIZE && r.index <= o.size())
+            {
+                o.resize(r.index);
+                p.resize(r.index);
+                pos.resize(r.index);
+                rot.resize(r.index);
+                scl.resize(r.index);
+                shr.resize(r.index);
+            }
+            else if(r.type == RECORD_CAMERA)
+            {
+                cam.position = glm::vec3(r.data[0], r.data[1], r.data[2]);
+                cam.yaw = r.data[3];
+                cam.pitch = r.data[4];
+                cam.zoom = r.data[5];
+            }
+            else
+                return fail(path, "damaged change log");
+        }
+        for(unsigned int i = 0; i < o.size(); i++)
+            if(o[i] < 0 || o[i] >= (int)names.size() || p[i] < -1 || p[i] >= (int)o.size() || p[i] == (int)i)
+                return fail(path, "instance out of range");
+
+        assets.swap(names);
+        objs.swap(o);
+        parents.swap(p);
+        position.swap(pos);
+        rotation.swap(rot);
+        scale.swap(scl);
+        shear.swap(shr);
+        camera = cam;
+        remember(path, file.size);
+        base = header;
+        return true;
+    }
+
+private:
+    // the state as last saved or loaded, which the next save appends to, and the header of its file
+    struct State {
+        vector<string> assets;
+        vector<int> objs, parents;
+        vector<glm::vec3> position;
+        vector<glm::quat> rotation;
+        vector<glm::vec3> scale;
+        vector<Shear> shear;
+        SnapshotCamera camera;
+    } saved;
+    string savedPath;
+    unsigned long long savedSize;
+    SnapshotHeader base;
+
+    // where the sections go, from the start of the file
+    struct Layout {
+        unsigned long long assets, objs, parents, position, rotation, scale, shear, end;
+    };
+
+    static unsigned long long align(unsigned long long offset) { return (offset + 15) & ~15ULL; }
+
+    static Layout layout(unsigned int headerSize, unsigned int n, unsigned int assetBytes)
+    {
+        Layout at;
+        at.assets = align(headerSize);
+        at.objs = align(at.assets + assetBytes);
+        at.parents = align(at.objs + 4ULL * n);
+        at.position = align(at.parents + 4ULL * n);
+        at.rotation = align(at.position + 12ULL * n);
+        at.scale = align(at.rotation + 16ULL * n);
+        at.shear = align(at.scale + 12ULL * n);
+        at.end = align(at.shear + 24ULL * n);
+        return at;
+    }
+
+    static unsigned int assetBytes(const vector<string> &names)
+    {
+        unsigned int bytes = 0;
+        for(unsigned int i = 0; i < names.size(); i++)
+            bytes += names[i].size() + 1;
+        return bytes;
+    }
+
+    static unsigned long long arraysSize(unsigned int n, unsigned int assetBytes)
+    {
+        Layout at = layout(sizeof(SnapshotHeader), n, assetBytes);
+        return at.end - at.objs;
+    }
+
+    // the sections are aligned, so the arrays are read in place
+    template <typename T>
+    static void copyArray(const unsigned char *from, unsigned int n, vector<T> &to)
+    {
+        const T *first = (const T *)from;
+        to.assign(first, first + n);
+    }
+
+    template <typename T>
+    static void writeArray(FILE *file, unsigned long long offset, const vector<T> &from)
+    {
+        fseek(file, (long)offset, SEEK_SET);
+        if(!from.empty())
+            fwrite(&from[0], sizeof(T), from.size(), file);
+    }
+
+    static long long fileSize(const string &path)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if(!file)
+            return -1;
+        fseek(file, 0, SEEK_END);
+        long long size = ftell(file);
+        fclose(file);
+        return size;
+    }
+
+    static const char *magic() { return "CGSCENE"; }	// with its 0, the 8 bytes of SnapshotHeader::magic
+
+    bool fail(const string &path, const char *why) const
+    {
+        cout << "ERROR::SNAPSHOT:: " << path << ": " << why << endl;
+        return false;
+    }
+
+    void remember(const string &path, unsigned long long size)
+    {
+        saved.assets = assets;
+        saved.objs = objs;
+        saved.parents = parents;
+        saved.position = position;
+        saved.rotation = rotation;
+        saved.scale = scale;
+        saved.shear = shear;
+        saved.camera = camera;
+        savedPath = path;
+        savedSize = size;
+    }
+
+    SnapshotRecord instanceRecord(unsigned int i) const
+    {
+        const glm::vec3 &p = position[i], &s = scale[i];
+        const glm::quat &q = rotation[i];
+        const Shear &h = shear[i];
+        SnapshotRecord r = { RECORD_INSTANCE, i, objs[i], parents[i],
+                             { p.x, p.y, p.z, q.x, q.y, q.z, q.w, s.x, s.y, s.z, h.xy, h.xz, h.yx, h.yz, h.zx, h.zy } };
+        return r;
+    }
+
+    // the records that turn the saved state into the current one
+    void diff(vector<SnapshotRecord> &records) const
+    {
+        unsigned int n = size(), before = saved.objs.size();
+        for(unsigned int i = 0; i < n; i++)
+            if(i >= before || objs[i] != saved.objs[i] || parents[i] != saved.parents[i]
+               || memcmp(&position[i], &saved.position[i], sizeof(glm::vec3)) != 0
+               || memcmp(&rotation[i], &saved.rotation[i], sizeof(glm::quat)) != 0
+               || memcmp(&scale[i], &saved.scale[i], sizeof(glm::vec3)) != 0
+               || memcmp(&shear[i], &saved.shear[i], sizeof(Shear)) != 0)
+                records.push_back(instanceRecord(i));
+        if(n < before)
+        {
+            SnapshotRecord r = { RECORD_RESIZE, n, 0, 0, { 0.0f } };
+            records.push_back(r);
+        }
+        if(memcmp(&camera, &saved.camera, sizeof(camera)) != 0)
+        {
+            const SnapshotCamera &c = camera;
+            SnapshotRecord r = { RECORD_CAMERA, 0, 0, 0, { c.position.x, c.position.y, c.position.z, c.yaw, c.pitch, c.zoom } };
+            records.push_back(r);
+        }
+    }
+
+    // adds the records to the log, then commits them by moving the end of the log in the header
+    bool append(const string &path, const vector<SnapshotRecord> &records)
+    {
+        appended = true;
+        if(records.empty())
+            return true;
+        FILE *file = fopen(path.c_str(), "r+b");
+        if(!file)
+            return fail(path, "could not be opened for writing");
+        fseek(file, (long)base.logEnd, SEEK_SET);
+        fwrite(&records[0], sizeof(SnapshotRecord), records.size(), file);
+        bool ok = fflush(file) == 0;
+
+        // the rest of the header still describes the arrays, which stay as they are
+        SnapshotHeader h = base;
+        h.records += records.size();
+        h.logEnd += records.size() * sizeof(SnapshotRecord);
+        fseek(file, 0, SEEK_SET);
+        fwrite(&h, sizeof(h), 1, file);
+        ok = fflush(file) == 0 && ok && !ferror(file);
+        fclose(file);
+        if(!ok)
+            return fail(path, "could not be written");
+
+        // what was past the old end of the log, if anything, was overwritten or is still there
+        remember(path, max(savedSize, h.logEnd));
+        base = h;
+        writtenRecords = records.size();
+        writtenBytes = records.size() * sizeof(SnapshotRecord);
+        return true;
+    }
+
+    // writes the whole scene next to the file and moves it over, so the old one stays until the new one is complete
+    bool write(const string &path)
+    {
+        savedPath.clear();
+        Layout at = layout(sizeof(SnapshotHeader), size(), assetBytes(assets));
+        string temporary = path + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if(!file)
+            return fail(temporary, "could not be written");
+        SnapshotHeader h = SnapshotHeader();
+        memcpy(h.magic, magic(), sizeof(h.magic));
+        h.version = VERSION;
+        h.headerSize = sizeof(h);
+        h.instances = size();
+        h.assets = assets.size();
+        h.assetBytes = assetBytes(assets);
+        h.logStart = h.logEnd = at.end;
+        h.camera = camera;
+        fwrite(&h, sizeof(h), 1, file);
+        fseek(file, (long)at.assets, SEEK_SET);
+        for(unsigned int i = 0; i < assets.size(); i++)
+            fwrite(assets[i].c_str(), 1, assets[i].size() + 1, file);
+        writeArray(file, at.objs, objs);
+        writeArray(file, at.parents, parents);
+        writeArray(file, at.position, position);
+        writeArray(file, at.rotation, rotation);
+        writeArray(file, at.scale, scale);
+        writeArray(file, at.shear, shear);
+        // pad up to the log, so appending starts at the end of the file
+        if(ftell(file) < (long)at.end)
+        {
+            fseek(file, (long)at.end - 1, SEEK_SET);
+            fputc(0, file);
+        }
+        bool ok = fflush(file) == 0 && !ferror(file);
+        fclose(file);
+#ifdef _WIN32
+        remove(path.c_str());
+#endif
+        if(!ok || rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            remove(temporary.c_str());
+            return fail(path, "could not be written");
+        }
+        remember(path, at.end);
+        base = h;
+        writtenBytes = at.end;
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,455 @@
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/texture_image.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/draw_list.h>
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+struct SoftwareRasterizerStats {
+    unsigned int triangles;		// set up and binned
+    unsigned int culled;		// outside the view or without area
+    unsigned int binned;		// triangle / tile pairs
+};
+
+// Draws the frame's draw commands on the CPU, for machines without a GPU. It reads the same meshes, diffuse
+// textures, model matrices and camera as the GL path and produces the same image as cg_ufpel.fs, textured
+// and unlit. The screen is split in TILE x TILE tiles: first the workers transform, clip (near plane) and
+// set up the triangles of chunks of draw commands, binning each into the tiles its bounds touch; then every
+// tile is rasterized on its own, against its own depth tile, testing four pixels at a time with SSE edge
+// functions. Texture coordinates are interpolated perspective correct and sampled trilinearly with the
+// level of detail taken from their screen space derivatives. The colour buffer can be blitted into the
+// current GL framebuffer to show it.
+class SoftwareRasterizer
+{
+public:
+    static const int TILE = 64;
+    static const unsigned int CHUNK = 8;	// draw commands per geometry job
+
+    glm::vec4 clearColor;
+    SoftwareRasterizerStats stats;
+
+    // the diffuse textures come from `textures`, which may be shared with other renderers
+    SoftwareRasterizer(TextureLibrary &textures) : clearColor(0.05f, 0.05f, 0.05f, 1.0f), textures(textures), width(0), height(0),
+                                                   tilesX(0), tilesY(0), texture(0), framebuffer(0), textureWidth(0), textureHeight(0)
+    {
+        SoftwareRasterizerStats none = { 0, 0, 0 };
+        stats = none;
+    }
+
+    // registers the meshes of the next object, in the order draw commands number them. They are read in
+    // place, so they must outlive the rasterizer; their diffuse textures are loaded on the first render().
+    void addObject(const vector<Mesh> &meshes, const string &directory)
+    {
+        vector<MeshSource> object;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            MeshSource source;
+            source.mesh = &meshes[i];
+            source.image = NULL;
+            for(unsigned int j = 0; j < meshes[i].textures.size() && source.path.empty(); j++)
+                if(meshes[i].textures[j].type == "texture_diffuse")
+                    source.path = directory + '/' + meshes[i].textures[j].path;
+            object.push_back(source);
+        }
+        objects.push_back(object);
+    }
+
+    // the colour buffer, RGBA8 rows bottom first like a GL framebuffer
+    const unsigned int *pixels() const { return color.empty() ? NULL : &color[0]; }
+
+    void render(const vector<DrawCommand> &commands, const glm::mat4 &view, const glm::mat4 &projection,
+                int frameWidth, int frameHeight, JobSystem *jobs = NULL)
+    {
+        loadTextures();
+        resize(frameWidth, frameHeight);
+        unsigned int threads = jobs ? jobs->threads() : 1;
+        perThread.resize(threads);
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            ThreadData &data = perThread[t];
+            data.triangles.clear();
+            data.bins.resize(tilesX * tilesY);
+            for(unsigned int b = 0; b < data.bins.size(); b++)
+                data.bins[b].clear();
+            data.culled = 0;
+            data.binned = 0;
+        }
+
+        glm::mat4 viewProjection = projection * view;
+        JobSystem::Job geometry = [&](unsigned int begin, unsigned int end, unsigned int thread) {
+            for(unsigned int i = begin; i < end; i++)
+                setup(commands[i], viewProjection, perThread[thread]);
+        };
+        forChunks(jobs, commands.size(), CHUNK, geometry);
+
+        JobSystem::Job raster = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int t = begin; t < end; t++)
+                rasterTile(t);
+        };
+        forChunks(jobs, tilesX * tilesY, 1, raster);
+
+        SoftwareRasterizerStats s = { 0, 0, 0 };
+        for(unsigned int t = 0; t < threads; t++)
+        {
+            s.triangles += perThread[t].triangles.size();
+            s.culled += perThread[t].culled;
+            s.binned += perThread[t].binned;
+        }
+        stats = s;
+    }
+
+    // copies the colour buffer into the bound draw framebuffer; needs a current context.
+    void blit()
+    {
+        if(color.empty())
+            return;
+        if(!texture)
+        {
+            glGenTextures(1, &texture);
+            glGenFramebuffers(1, &framebuffer);
+        }
+        GLint drawFramebuffer, readFramebuffer, activeTexture;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+        // the texture caches of render_stats.h track the array targets, this one doesn't disturb them
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if(width != textureWidth || height != textureHeight)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            textureWidth = width;
+            textureHeight = height;
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &color[0]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(activeTexture);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    }
+
+private:
+    struct MeshSource {
+        const Mesh *mesh;
+        string path;				// of the diffuse texture, empty for none
+        const TextureImage *image;
+    };
+
+    struct ClipVertex {
+        glm::vec4 position;
+        glm::vec2 uv;
+    };
+
+    // a triangle ready for rasterization: its edge functions are scaled to give barycentric weights, and
+    // depth, 1/w, u/w and v/w are planes a * x + b * y + c over the screen. Both are relative to the first
+    // vertex, so small triangles far from the screen origin don't lose their precision to cancellation.
+    struct Triangle {
+        float originX, originY;
+        float edgeA[3], edgeB[3], edgeC[3];
+        glm::vec3 z, w, u, v;
+        int minX, minY, maxX, maxY;
+        const TextureImage *image;
+    };
+
+    struct ThreadData {
+        vector<glm::vec4> clip;				// the vertices of the mesh being set up
+        vector<Triangle> triangles;
+        vector< vector<unsigned int> > bins;	// per tile, indices into triangles
+        unsigned int culled, binned;
+        char padding[64];
+    };
+
+    vector< vector<MeshSource> > objects;
+    TextureLibrary &textures;
+    vector<ThreadData> perThread;
+
+    int width, height, tilesX, tilesY;
+    vector<unsigned int> color;
+    vector<float> depth;		// tile by tile, TILE * TILE floats each
+
+    unsigned int texture, framebuffer;
+    int textureWidth, textureHeight;
+
+    static void forChunks(JobSystem *jobs, unsigned int n, unsigned int chunk, const JobSystem::Job &f)
+    {
+        if(jobs)
+            jobs->parallelFor(n, chunk, f);
+        else if(n > 0)
+            f(0, n, 0);
+    }
+
+    void loadTextures()
+    {
+        for(unsigned int i = 0; i < objects.size(); i++)
+            for(unsigned int j = 0; j < objects[i].size(); j++)
+            {
+                MeshSource &source = objects[i][j];
+                if(!source.image && !source.path.empty())
+                    source.image = textures.get(source.path);
+            }
+    }
+
+    void resize(int frameWidth, int frameHeight)
+    {
+        if(frameWidth == width && frameHeight == height)
+            return;
+        width = frameWidth;
+        height = frameHeight;
+        tilesX = (width + TILE - 1) / TILE;
+        tilesY = (height + TILE - 1) / TILE;
+        color.resize(width * height);
+        depth.resize(tilesX * tilesY * TILE * TILE);
+    }
+
+    // transforms the meshes of a draw command, then clips, sets up and bins their triangles
+    void setup(const DrawCommand &command, const glm::mat4 &viewProjection, ThreadData &data)
+    {
+        if(command.obj >= objects.size())
+            return;
+        glm::mat4 mvp = viewProjection * command.model;
+        const vector<MeshSource> &object = objects[command.obj];
+        for(unsigned int m = 0; m < object.size(); m++)
+        {
+            const Mesh &mesh = *object[m].mesh;
+            data.clip.resize(mesh.vertices.size());
+            for(unsigned int i = 0; i < mesh.vertices.size(); i++)
+                data.clip[i] = mvp * glm::vec4(mesh.vertices[i].Position, 1.0f);
+
+            for(unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+            {
+                ClipVertex v[3];
+                for(int k = 0; k < 3; k++)
+                {
+                    v[k].position = data.clip[mesh.indices[i + k]];
+                    v[k].uv = mesh.vertices[mesh.indices[i + k]].TexCoords;
+                }
+                if(outside(v))
+                {
+                    data.culled++;
+                    continue;
+                }
+                if(v[0].position.z < -v[0].position.w || v[1].position.z < -v[1].position.w || v[2].position.z < -v[2].position.w)
+                    clipNear(v, object[m].image, data);
+                else
+                    add(v, object[m].image, data);
+            }
+        }
+    }
+
+    // whether all three vertices are outside the same clip plane
+    static bool outside(const ClipVertex *v)
+    {
+        for(int axis = 0; axis < 3; axis++)
+        {
+            if(v[0].position[axis] > v[0].position.w && v[1].position[axis] > v[1].position.w && v[2].position[axis] > v[2].position.w)
+                return true;
+            if(v[0].position[axis] < -v[0].position.w && v[1].position[axis] < -v[1].position.w && v[2].position[axis] < -v[2].position.w)
+                return true;
+        }
+        return false;
+    }
+
+    // cuts a triangle crossing the near plane (z = -w) and adds the part in front of it
+    void clipNear(const ClipVertex *v, const TextureImage *image, ThreadData &data)
+    {
+        ClipVertex polygon[4];
+        int n = 0;
+        for(int i = 0; i < 3; i++)
+        {
+            const ClipVertex &a = v[i], &b = v[(i + 1) % 3];
+            float da = a.position.z + a.position.w, db = b.position.z + b.position.w;
+            if(da >= 0.0f)
+                polygon[n++] = a;
+            if((da >= 0.0f) != (db >= 0.0f))
+            {
+                float t = da / (da - db);
+                polygon[n].position = glm::mix(a.position, b.position, t);
+                polygon[n].uv = glm::mix(a.uv, b.uv, t);
+                n++;
+            }
+        }
+        for(int i = 1; i + 1 < n; i++)
+        {
+            ClipVertex triangle[3] = { polygon[0], polygon[i], polygon[i + 1] };
+            add(triangle, image, data);
+        }
+    }
+
+    void add(const ClipVertex *v, const TextureImage *image, ThreadData &data)
+    {
+        glm::vec3 p[3];
+        float invW[3];
+        for(int k = 0; k < 3; k++)
+        {
+            invW[k] = 1.0f / v[k].position.w;
+            glm::vec3 ndc = glm::vec3(v[k].position) * invW[k];
+            p[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+        }
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        float lowX = min(min(p[0].x, p[1].x), p[2].x), highX = max(max(p[0].x, p[1].x), p[2].x);
+        float lowY = min(min(p[0].y, p[1].y), p[2].y), highY = max(max(p[0].y, p[1].y), p[2].y);
+        if(!(area != 0.0f) || highX < 0.0f || highY < 0.0f || lowX > width || lowY > height)
+        {
+            data.culled++;
+            return;
+        }
+
+        Triangle t;
+        t.originX = p[0].x;
+        t.originY = p[0].y;
+        for(int i = 0; i < 3; i++)
+        {
+            // the edge facing vertex i, giving i's barycentric weight, which is 1 at the origin vertex
+            const glm::vec3 &a = p[(i + 1) % 3], &b = p[(i + 2) % 3];
+            t.edgeA[i] = (a.y - b.y) / area;
+            t.edgeB[i] = (b.x - a.x) / area;
+            t.edgeC[i] = i == 0 ? 1.0f : 0.0f;
+        }
+        t.z = plane(t, p[0].z, p[1].z, p[2].z);
+        t.w = plane(t, invW[0], invW[1], invW[2]);
+        t.u = plane(t, v[0].uv.x * invW[0], v[1].uv.x * invW[1], v[2].uv.x * invW[2]);
+        t.v = plane(t, v[0].uv.y * invW[0], v[1].uv.y * invW[1], v[2].uv.y * invW[2]);
+        // clamped as floats, vertices near the eye plane can land far outside the int range
+        t.minX = (int)max(floor(lowX), 0.0f);
+        t.minY = (int)max(floor(lowY), 0.0f);
+        t.maxX = (int)min(ceil(highX), width - 1.0f);
+        t.maxY = (int)min(ceil(highY), height - 1.0f);
+        t.image = image;
+
+        unsigned int index = data.triangles.size();
+        data.triangles.push_back(t);
+        for(int ty = t.minY / TILE; ty <= t.maxY / TILE; ty++)
+            for(int tx = t.minX / TILE; tx <= t.maxX / TILE; tx++)
+            {
+                data.bins[ty * tilesX + tx].push_back(index);
+                data.binned++;
+            }
+    }
+
+    // the plane through three vertex values; the weights' gradients sum to zero, so only the differences to
+    // the origin vertex's value count
+    static glm::vec3 plane(const Triangle &t, float f0, float f1, float f2)
+    {
+        return glm::vec3(t.edgeA[1] * (f1 - f0) + t.edgeA[2] * (f2 - f0), t.edgeB[1] * (f1 - f0) + t.edgeB[2] * (f2 - f0), f0);
+    }
+
+    void rasterTile(unsigned int tile)
+    {
+        int x0 = (tile % tilesX) * TILE, y0 = (tile / tilesX) * TILE;
+        int x1 = min(x0 + TILE, width), y1 = min(y0 + TILE, height);
+        float *tileDepth = &depth[tile * TILE * TILE];
+        fill(tileDepth, tileDepth + TILE * TILE, 1.0f);
+        unsigned int clear = pack(clearColor);
+        for(int y = y0; y < y1; y++)
+            fill(&color[y * width + x0], &color[y * width + x1], clear);
+
+        // in submission order per thread; only equal depths could tell the orders apart
+        for(unsigned int t = 0; t < perThread.size(); t++)
+        {
+            const ThreadData &data = perThread[t];
+            const vector<unsigned int> &bin = data.bins[tile];
+            for(unsigned int i = 0; i < bin.size(); i++)
+                raster(data.triangles[bin[i]], x0, y0, x1, y1, tileDepth);
+        }
+    }
+
+    void raster(const Triangle &t, int x0, int y0, int x1, int y1, float *tileDepth)
+    {
+        // groups of four pixels start on a multiple of four, which the tiles do too
+        int startX = max(t.minX, x0) & ~3, endX = min(t.maxX, x1 - 1);
+        int startY = max(t.minY, y0), endY = min(t.maxY, y1 - 1);
+        for(int y = startY; y <= endY; y++)
+        {
+            float py = y + 0.5f - t.originY;
+            float *depthRow = tileDepth + (y - y0) * TILE - x0;
+            unsigned int *colorRow = &color[y * width];
+            for(int x = startX; x <= endX; x += 4)
+            {
+                int covered = cover(t, x, py, x1, depthRow + x);
+                for(int lane = 0; covered; lane++, covered >>= 1)
+                    if(covered & 1)
+                        colorRow[x + lane] = shade(t, x + lane + 0.5f - t.originX, py);
+            }
+        }
+    }
+
+    // tests the four pixels from x on row py (relative to the origin) against the edges and the depth buffer
+    // and writes the depth of the ones that pass, which it returns as a bit mask
+    static int cover(const Triangle &t, int x, float py, int x1, float *depthRow)
+    {
+#ifdef __SSE2__
+        __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f - t.originX), lanes);
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_cmplt_ps(_mm_add_ps(_mm_set1_ps((float)x), lanes), _mm_set1_ps((float)x1));
+        for(int i = 0; i < 3; i++)
+        {
+            __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[i]), px), _mm_set1_ps(t.edgeB[i] * py + t.edgeC[i]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(e, zero));
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.z.x), px), _mm_set1_ps(t.z.y * py + t.z.z));
+        __m128 old = _mm_loadu_ps(depthRow);
+        inside = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+        _mm_storeu_ps(depthRow, _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, old)));
+        return _mm_movemask_ps(inside);
+#else
+        int covered = 0;
+        for(int lane = 0; lane < 4; lane++)
+        {
+            float px = x + lane + 0.5f - t.originX;
+            bool inside = x + lane < x1;
+            for(int i = 0; i < 3; i++)
+                inside = inside && t.edgeA[i] * px + t.edgeB[i] * py + t.edgeC[i] >= 0.0f;
+            float z = t.z.x * px + t.z.y * py + t.z.z;
+            if(inside && z < depthRow[lane])
+            {
+                depthRow[lane] = z;
+                covered |= 1 << lane;
+            }
+        }
+        return covered;
+#endif
+    }
+
+    // the textured colour at pixel centre (px, py), relative to the origin
+    static unsigned int shade(const Triangle &t, float px, float py)
+    {
+        float w = t.w.x * px + t.w.y * py + t.w.z;
+        float u = (t.u.x * px + t.u.y * py + t.u.z) / w;
+        float v = (t.v.x * px + t.v.y * py + t.v.z) / w;
+        if(!t.image || t.image->empty())
+            return pack(glm::vec4(1.0f));
+        // derivatives of the perspective correct coordinates, in texels per pixel
+        float dudx = (t.u.x - u * t.w.x) / w * t.image->width(), dvdx = (t.v.x - v * t.w.x) / w * t.image->height();
+        float dudy = (t.u.y - u * t.w.y) / w * t.image->width(), dvdy = (t.v.y - v * t.w.y) / w * t.image->height();
+        float rho = sqrt(max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy));
+        float lod = rho > 1.0f ? log2(rho) : 0.0f;
+        return pack(t.image->sample(glm::vec2(u, v), lod));
+    }
+
+    static unsigned int pack(const glm::vec4 &c)
+    {
+        glm::vec4 b = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (unsigned int)b.r | (unsigned int)b.g << 8 | (unsigned int)b.b << 16 | (unsigned int)b.a << 24;
+    }
+};
+#endif
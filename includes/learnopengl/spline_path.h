@@ -0,0 +1,283 @@
+#ifndef SPLINE_PATH_H
+#define SPLINE_PATH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtx/spline.hpp>
+
+#include <learnopengl/float4.h>
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+enum SplineKind {
+    SPLINE_CATMULL_ROM,		// through every point
+    SPLINE_BEZIER,			// piecewise cubic Bézier: points 3k and 3k+3 are on the curve, the two between steer it
+    SPLINE_BSPLINE			// uniform cubic B-spline: smoothest, passes near the points but not through them
+};
+
+// A path along a spline, travelled by distance instead of by curve parameter, so followers move at constant
+// speed whatever the spacing of the points. Every segment is turned into power basis coefficients
+//
+//   p(s) = ((a * s + b) * s + c) * s + d,   s in [0, 1]
+//
+// (what glm::cubic evaluates), whatever kind of spline it came from, kept as separate x, y and z arrays so
+// several followers can be evaluated at once, and gets a table of its arc length
+// sampled at regular values of s; a distance is mapped to a segment by binary search over the segment
+// lengths and to s by interpolating the segment's table. Moving a point only rebuilds the segments it
+// influences, the segment lengths are then summed again.
+class SplinePath
+{
+public:
+    static const unsigned int LUT_SAMPLES = 32;	// arc length samples per segment
+
+    SplinePath(SplineKind kind = SPLINE_CATMULL_ROM) : kind(kind) { rebuildAll(); }
+
+    SplineKind getKind() const { return kind; }
+    const vector<glm::vec3> &getPoints() const { return points; }
+
+    void setKind(SplineKind k)
+    {
+        kind = k;
+        rebuildAll();
+    }
+
+    void setPoints(const vector<glm::vec3> &p)
+    {
+        points = p;
+        rebuildAll();
+    }
+
+    void addPoint(const glm::vec3 &p)
+    {
+        points.push_back(p);
+        rebuildAll();
+    }
+
+    // moves a point; only the segments that depend on it are rebuilt by the next update().
+    void setPoint(unsigned int i, const glm::vec3 &p)
+    {
+        points[i] = p;
+        int first = 0, last = 0;
+        if(kind == SPLINE_CATMULL_ROM) { first = (int)i - 2; last = i + 1; }
+        else if(kind == SPLINE_BEZIER) { first = ((int)i - 1) / 3; last = i / 3; }
+        else { first = (int)i - 3; last = i; }
+        for(int k = max(first, 0); k <= last && k < (int)segments(); k++)
+            dirty[k] = 1;
+        anyDirty = true;
+    }
+
+    unsigned int segments() const
+    {
+        unsigned int n = points.size();
+        if(kind == SPLINE_CATMULL_ROM)
+            return n >= 2 ? n - 1 : 0;
+        if(kind == SPLINE_BEZIER)
+            return n >= 4 ? (n - 1) / 3 : 0;
+        return n >= 4 ? n - 3 : 0;
+    }
+
+    // rebuilds the dirty segments and the running lengths.
+    void update()
+    {
+        if(!anyDirty)
+            return;
+        unsigned int n = segments();
+        for(unsigned int k = 0; k < n; k++)
+        {
+            if(!dirty[k])
+                continue;
+            buildSegment(k);
+            dirty[k] = 0;
+        }
+        start[0] = 0.0f;
+        for(unsigned int k = 0; k < n; k++)
+            start[k + 1] = start[k] + lut[k * (LUT_SAMPLES + 1) + LUT_SAMPLES];
+        anyDirty = false;
+    }
+
+    // the length of the path; the tables must be up to date (see update())
+    float length() const { return start.empty() ? 0.0f : start.back(); }
+
+    // maps a distance along the path (clamped to it) to a segment and the parameter in it.
+    void locate(float distance, unsigned int &segment, float &s) const
+    {
+        unsigned int n = segments();
+        if(n == 0)
+        {
+            segment = 0;
+            s = 0.0f;
+            return;
+        }
+        distance = glm::clamp(distance, 0.0f, length());
+        // the last segment that starts at or before the distance
+        segment = upper_bound(start.begin() + 1, start.begin() + n, distance) - start.begin() - 1;
+        const float *table = &lut[segment * (LUT_SAMPLES + 1)];
+        float d = distance - start[segment];
+        unsigned int j = upper_bound(table + 1, table + LUT_SAMPLES, d) - table - 1;
+        float span = table[j + 1] - table[j];
+        float f = span > 0.0f ? glm::clamp((d - table[j]) / span, 0.0f, 1.0f) : 0.0f;
+        s = (j + f) / LUT_SAMPLES;
+    }
+
+    // the power basis coefficients a, b, c, d of a segment
+    void coefficients(unsigned int segment, glm::vec3 c[4]) const
+    {
+        for(unsigned int j = 0; j < 4; j++)
+            c[j] = glm::vec3(coeffX[segment * 4 + j], coeffY[segment * 4 + j], coeffZ[segment * 4 + j]);
+    }
+
+    glm::vec3 at(float distance) const
+    {
+        if(segments() == 0)
+            return points.empty() ? glm::vec3(0.0f) : points[0];
+        unsigned int segment;
+        float s;
+        locate(distance, segment, s);
+        glm::vec3 c[4];
+        coefficients(segment, c);
+        return glm::cubic(c[0], c[1], c[2], c[3], s);
+    }
+
+    // positions of many followers at once: the segments and parameters are found first, then the polynomials
+    // are evaluated for four followers at a time with Float4, each lane loading its own segment's coefficients.
+    void evaluate(const vector<float> &distance, vector<glm::vec3> &out)
+    {
+        update();
+        unsigned int n = distance.size();
+        out.resize(n);
+        if(segments() == 0)
+        {
+            fill(out.begin(), out.end(), points.empty() ? glm::vec3(0.0f) : points[0]);
+            return;
+        }
+        batchSegment.resize(n);
+        batchS.resize(n);
+        for(unsigned int i = 0; i < n; i++)
+            locate(distance[i], batchSegment[i], batchS[i]);
+
+        const unsigned int *segment = &batchSegment[0];
+        const float *param = &batchS[0];
+        glm::vec3 *o = n ? &out[0] : NULL;
+        unsigned int i = 0;
+        for(; i + 4 <= n; i += 4)
+        {
+            const unsigned int k[4] = { segment[i] * 4, segment[i + 1] * 4, segment[i + 2] * 4, segment[i + 3] * 4 };
+            Float4 s = loadFloat4(param + i);
+            float x[4], y[4], z[4];
+            storeFloat4(x, horner(&coeffX[0], k, s));
+            storeFloat4(y, horner(&coeffY[0], k, s));
+            storeFloat4(z, horner(&coeffZ[0], k, s));
+            for(unsigned int j = 0; j < 4; j++)
+                o[i + j] = glm::vec3(x[j], y[j], z[j]);
+        }
+        for(; i < n; i++)
+        {
+            unsigned int k = segment[i] * 4;
+            float s = param[i];
+            o[i] = glm::vec3(((coeffX[k] * s + coeffX[k + 1]) * s + coeffX[k + 2]) * s + coeffX[k + 3],
+                             ((coeffY[k] * s + coeffY[k + 1]) * s + coeffY[k + 2]) * s + coeffY[k + 3],
+                             ((coeffZ[k] * s + coeffZ[k + 1]) * s + coeffZ[k + 2]) * s + coeffZ[k + 3]);
+        }
+    }
+
+private:
+    SplineKind kind;
+    vector<glm::vec3> points;
+    vector<float> coeffX, coeffY, coeffZ;	// a, b, c, d per segment, one array per component
+    vector<float> lut;				// LUT_SAMPLES + 1 running lengths per segment
+    vector<float> start;			// length before each segment, and the total at the end
+    vector<unsigned char> dirty;
+    bool anyDirty;
+
+    vector<unsigned int> batchSegment;
+    vector<float> batchS;
+
+    // one component of four followers' polynomials; k holds the index of each one's first coefficient
+    static Float4 horner(const float *c, const unsigned int k[4], Float4 s)
+    {
+        Float4 a(c[k[0]], c[k[1]], c[k[2]], c[k[3]]);
+        Float4 b(c[k[0] + 1], c[k[1] + 1], c[k[2] + 1], c[k[3] + 1]);
+        Float4 d(c[k[0] + 2], c[k[1] + 2], c[k[2] + 2], c[k[3] + 2]);
+        Float4 e(c[k[0] + 3], c[k[1] + 3], c[k[2] + 3], c[k[3] + 3]);
+        return ((a * s + b) * s + d) * s + e;
+    }
+
+    void rebuildAll()
+    {
+        unsigned int n = segments();
+        coeffX.resize(n * 4);
+        coeffY.resize(n * 4);
+        coeffZ.resize(n * 4);
+        lut.resize(n * (LUT_SAMPLES + 1));
+        start.resize(n + 1);
+        dirty.assign(n, 1);
+        anyDirty = true;
+    }
+
+    // the four points a segment depends on; Catmull-Rom repeats the end points past the ends
+    void segmentPoints(unsigned int k, glm::vec3 p[4]) const
+    {
+        int last = points.size() - 1;
+        for(int j = 0; j < 4; j++)
+        {
+            int i;
+            if(kind == SPLINE_CATMULL_ROM)
+                i = glm::clamp((int)k - 1 + j, 0, last);
+            else if(kind == SPLINE_BEZIER)
+                i = 3 * k + j;
+            else
+                i = k + j;
+            p[j] = points[i];
+        }
+    }
+
+    void buildSegment(unsigned int k)
+    {
+        glm::vec3 p[4], c[4];
+        segmentPoints(k, p);
+        if(kind == SPLINE_CATMULL_ROM)
+        {
+            c[0] = 0.5f * (-p[0] + 3.0f * p[1] - 3.0f * p[2] + p[3]);
+            c[1] = 0.5f * (2.0f * p[0] - 5.0f * p[1] + 4.0f * p[2] - p[3]);
+            c[2] = 0.5f * (p[2] - p[0]);
+            c[3] = p[1];
+        }
+        else if(kind == SPLINE_BEZIER)
+        {
+            c[0] = -p[0] + 3.0f * p[1] - 3.0f * p[2] + p[3];
+            c[1] = 3.0f * p[0] - 6.0f * p[1] + 3.0f * p[2];
+            c[2] = 3.0f * (p[1] - p[0]);
+            c[3] = p[0];
+        }
+        else
+        {
+            c[0] = (-p[0] + 3.0f * p[1] - 3.0f * p[2] + p[3]) / 6.0f;
+            c[1] = (3.0f * p[0] - 6.0f * p[1] + 3.0f * p[2]) / 6.0f;
+            c[2] = (p[2] - p[0]) / 2.0f;
+            c[3] = (p[0] + 4.0f * p[1] + p[2]) / 6.0f;
+        }
+        for(unsigned int j = 0; j < 4; j++)
+        {
+            coeffX[k * 4 + j] = c[j].x;
+            coeffY[k * 4 + j] = c[j].y;
+            coeffZ[k * 4 + j] = c[j].z;
+        }
+
+        // running length over the samples, each sample span measured with a few chords
+        float *table = &lut[k * (LUT_SAMPLES + 1)];
+        const unsigned int chords = 4;
+        glm::vec3 previous = c[3];
+        float length = 0.0f;
+        table[0] = 0.0f;
+        for(unsigned int j = 1; j <= LUT_SAMPLES * chords; j++)
+        {
+            glm::vec3 q = glm::cubic(c[0], c[1], c[2], c[3], (float)j / (LUT_SAMPLES * chords));
+            length += glm::length(q - previous);
+            previous = q;
+            if(j % chords == 0)
+                table[j / chords] = length;
+        }
+    }
+};
+#endif
@@ -0,0 +1,177 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/render_stats.h>
+
+#include <iostream>
+using namespace std;
+
+// Streams per-frame data (particle vertices, instance data, uniform blocks, ...) to the GPU without
+// re-specifying buffers. One buffer is split into FRAMES regions, one per frame in flight; a frame bump
+// allocates out of its region and fences it when it ends, and the region is only written again once that
+// fence has signalled. With GL 4.4 the buffer is mapped once, persistently and coherently; on a 3.3 context
+// every allocation maps its range unsynchronized instead, the fences doing the synchronization. A frame
+// needing more than a region replaces the buffer by a larger one.
+//
+// Bytes streamed and the times a region was still in use when its turn came (stalls) go into renderStats().
+class StreamBuffer
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    StreamBuffer() : id(0), regionSize(0), region(0), head(0), mapped(NULL), persistentMapping(false), initialized(false)
+    {
+        for(unsigned int i = 0; i < FRAMES; i++)
+            fences[i] = NULL;
+    }
+
+    // creates the buffer with `frameSize` bytes per frame; needs a current context.
+    void init(unsigned int frameSize)
+    {
+        create(frameSize);
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if(!initialized)
+            return;
+        for(unsigned int i = 0; i < FRAMES; i++)
+            wait(i);
+        release();
+        initialized = false;
+    }
+
+    unsigned int buffer() const { return id; }
+    bool persistent() const { return persistentMapping; }
+
+    // moves on to the next region, waiting for the GPU if it still reads that region's last frame.
+    void beginFrame()
+    {
+        if(!initialized)
+            return;
+        region = (region + 1) % FRAMES;
+        head = 0;
+        wait(region);
+    }
+
+    // fences what the frame's commands read, so the region isn't overwritten before they ran.
+    void endFrame()
+    {
+        if(!initialized)
+            return;
+        if(fences[region])
+            glDeleteSync(fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // reserves `bytes` for this frame at a multiple of `alignment` (a power of two; uniform blocks need
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT) and returns where to write them. `offset` gets their position in
+    // buffer(), for glVertexAttribPointer or glBindBufferRange. Call unmap() before drawing from them.
+    void *map(unsigned int bytes, unsigned int alignment, unsigned int &offset)
+    {
+        unsigned int at = (head + alignment - 1) & ~(alignment - 1);
+        if(at + bytes > regionSize)
+        {
+            grow(at + bytes);
+            at = 0;
+        }
+        head = at + bytes;
+        offset = region * regionSize + at;
+        renderStats().streamedBytes += bytes;
+        if(persistentMapping)
+            return mapped + offset;
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        return glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    }
+
+    void unmap()
+    {
+        if(persistentMapping)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+private:
+    unsigned int id;
+    unsigned int regionSize;
+    unsigned int region;		// the current frame's region
+    unsigned int head;			// bytes allocated in it
+    char *mapped;				// the whole buffer, when mapped persistently
+    bool persistentMapping;
+    bool initialized;
+    GLsync fences[FRAMES];
+
+    void create(unsigned int frameSize)
+    {
+        regionSize = frameSize;
+        GLsizeiptr size = (GLsizeiptr)FRAMES * frameSize;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        persistentMapping = GLAD_GL_VERSION_4_4 && glBufferStorage != NULL;
+        if(persistentMapping)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+            mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+            if(mapped)
+                return;
+            cout << "ERROR::STREAM_BUFFER:: Persistent mapping failed, mapping every allocation instead" << endl;
+            persistentMapping = false;
+            glDeleteBuffers(1, &id);
+            glGenBuffers(1, &id);
+            glBindBuffer(GL_ARRAY_BUFFER, id);
+        }
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+
+    void release()
+    {
+        if(persistentMapping)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, id);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            mapped = NULL;
+        }
+        glDeleteBuffers(1, &id);
+        id = 0;
+    }
+
+    void wait(unsigned int r)
+    {
+        if(!fences[r])
+            return;
+        GLenum result = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if(result == GL_TIMEOUT_EXPIRED)
+        {
+            renderStats().streamStalls++;
+            do
+                result = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            while(result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fences[r]);
+        fences[r] = NULL;
+    }
+
+    // replaces the buffer by one with regions of at least `bytes`. Draws already issued keep reading the
+    // old buffer, which GL frees once they're done, so nothing has to wait; the current frame starts over
+    // in the new one.
+    void grow(unsigned int bytes)
+    {
+        unsigned int size = regionSize ? regionSize * 2 : bytes;
+        while(size < bytes)
+            size *= 2;
+        for(unsigned int i = 0; i < FRAMES; i++)
+            if(fences[i])
+            {
+                glDeleteSync(fences[i]);
+                fences[i] = NULL;
+            }
+        release();
+        create(size);
+    }
+};
+#endif
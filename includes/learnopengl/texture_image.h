@@ -0,0 +1,152 @@
+#ifndef TEXTURE_IMAGE_H
+#define TEXTURE_IMAGE_H
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+// A texture's pixels kept in memory for the CPU renderers, as RGBA8 with a full mip chain, sampled like
+// the GL path samples the texture arrays: repeat wrapping and GL_LINEAR_MIPMAP_LINEAR filtering. Missing
+// components read as in GL (RED is (r, 0, 0, 1), RG is (r, g, 0, 1)).
+class TextureImage
+{
+public:
+    struct Level {
+        int width, height;
+        vector<unsigned int> texels;	// RGBA8, first row first, like the image file
+    };
+    vector<Level> levels;
+
+    bool load(const string &path)
+    {
+        int width, height, nrComponents;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+        if(!data)
+        {
+            cout << "Texture failed to load at path: " << path << endl;
+            return false;
+        }
+        levels.assign(1, Level());
+        Level &base = levels[0];
+        base.width = width;
+        base.height = height;
+        base.texels.resize(width * height);
+        for(int i = 0; i < width * height; i++)
+        {
+            const unsigned char *p = data + i * nrComponents;
+            unsigned int r = p[0];
+            unsigned int g = nrComponents > 1 ? p[1] : 0;
+            unsigned int b = nrComponents > 2 ? p[2] : 0;
+            unsigned int a = nrComponents > 3 ? p[3] : 255;
+            base.texels[i] = r | g << 8 | b << 16 | a << 24;
+        }
+        stbi_image_free(data);
+        buildMips();
+        return true;
+    }
+
+    bool empty() const { return levels.empty(); }
+
+    // trilinear sample at `uv` and level of detail `lod`, as a colour in [0, 1]
+    glm::vec4 sample(glm::vec2 uv, float lod) const
+    {
+        if(levels.empty())
+            return glm::vec4(1.0f);
+        float top = (float)(levels.size() - 1);
+        if(lod <= 0.0f)
+            return bilinear(levels[0], uv);
+        if(lod >= top)
+            return bilinear(levels.back(), uv);
+        int level = (int)lod;
+        float t = lod - level;
+        return glm::mix(bilinear(levels[level], uv), bilinear(levels[level + 1], uv), t);
+    }
+
+    int width() const { return levels.empty() ? 1 : levels[0].width; }
+    int height() const { return levels.empty() ? 1 : levels[0].height; }
+
+private:
+    // 2x2 box filtered levels down to 1x1; odd sizes repeat the last row or column
+    void buildMips()
+    {
+        while(levels.back().width > 1 || levels.back().height > 1)
+        {
+            const Level &src = levels.back();
+            Level dst;
+            dst.width = src.width > 1 ? src.width / 2 : 1;
+            dst.height = src.height > 1 ? src.height / 2 : 1;
+            dst.texels.resize(dst.width * dst.height);
+            for(int y = 0; y < dst.height; y++)
+                for(int x = 0; x < dst.width; x++)
+                {
+                    int x0 = glm::min(2 * x, src.width - 1), x1 = glm::min(2 * x + 1, src.width - 1);
+                    int y0 = glm::min(2 * y, src.height - 1), y1 = glm::min(2 * y + 1, src.height - 1);
+                    unsigned int a = src.texels[y0 * src.width + x0], b = src.texels[y0 * src.width + x1];
+                    unsigned int c = src.texels[y1 * src.width + x0], d = src.texels[y1 * src.width + x1];
+                    unsigned int result = 0;
+                    for(int shift = 0; shift < 32; shift += 8)
+                    {
+                        unsigned int sum = (a >> shift & 255) + (b >> shift & 255) + (c >> shift & 255) + (d >> shift & 255);
+                        result |= (sum + 2) / 4 << shift;
+                    }
+                    dst.texels[y * dst.width + x] = result;
+                }
+            levels.push_back(dst);
+        }
+    }
+
+    static glm::vec4 texel(const Level &level, int x, int y)
+    {
+        x %= level.width;
+        y %= level.height;
+        if(x < 0)
+            x += level.width;
+        if(y < 0)
+            y += level.height;
+        unsigned int c = level.texels[y * level.width + x];
+        return glm::vec4(c & 255, c >> 8 & 255, c >> 16 & 255, c >> 24) * (1.0f / 255.0f);
+    }
+
+    static glm::vec4 bilinear(const Level &level, glm::vec2 uv)
+    {
+        uv -= glm::floor(uv);
+        float x = uv.x * level.width - 0.5f, y = uv.y * level.height - 0.5f;
+        float fx = floor(x), fy = floor(y);
+        int x0 = (int)fx, y0 = (int)fy;
+        float tx = x - fx, ty = y - fy;
+        glm::vec4 top = glm::mix(texel(level, x0, y0), texel(level, x0 + 1, y0), tx);
+        glm::vec4 bottom = glm::mix(texel(level, x0, y0 + 1), texel(level, x0 + 1, y0 + 1), tx);
+        return glm::mix(top, bottom, ty);
+    }
+};
+
+// The images of the CPU renderers, loaded once per file and shared by all of them. Renderers on different
+// threads can ask for images at the same time; the images themselves are never changed once loaded.
+class TextureLibrary
+{
+public:
+    // the image of the file at `path`, loaded on the first request; empty if it couldn't be loaded
+    const TextureImage *get(const string &path)
+    {
+        lock_guard<mutex> lock(m);
+        map<string, TextureImage>::iterator found = images.find(path);
+        if(found == images.end())
+        {
+            found = images.insert(make_pair(path, TextureImage())).first;
+            found->second.load(path);
+        }
+        return &found->second;
+    }
+
+private:
+    map<string, TextureImage> images;	// nodes don't move, so the pointers handed out stay valid
+    mutex m;
+};
+#endif
@@ -0,0 +1,403 @@
+#ifndef TRANSFORM_STORE_H
+#define TRANSFORM_STORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <learnopengl/entity_store.h>
+
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <limits>
+using namespace std;
+
+// Shear coefficients of one instance; `xy` is how much x leaks into y, and so on.
+struct Shear {
+    float xy, xz, yx, yz, zx, zy;
+};
+
+// The decomposed transform of one instance, as saved for undo.
+struct TransformComponents {
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scale;
+    Shear shear;
+};
+
+// Instance transforms stored as separate position/rotation/scale/shear arrays instead of accumulated matrices.
+// Every edit changes only its own component (a rotation never touches the scale, shears add up), so nothing
+// drifts no matter how many steps are applied. The world matrix of an instance is
+//
+//   translate(position) * rotation * shear * scale
+//
+// and is composed in update(), which walks the instances marked dirty in one pass over the arrays.
+class TransformStore
+{
+public:
+    vector<glm::vec3> position;
+    vector<glm::quat> rotation;
+    vector<glm::vec3> scale;
+    vector<Shear> shear;
+
+    unsigned int size() const { return position.size(); }
+
+    // appends an instance and returns its index.
+    unsigned int add(const glm::vec3 &p, const glm::quat &r = glm::quat(), const glm::vec3 &s = glm::vec3(1.0f))
+    {
+        Shear none = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        position.push_back(p);
+        rotation.push_back(r);
+        scale.push_back(s);
+        shear.push_back(none);
+        world.push_back(glm::mat4());
+        dirty.push_back(1);
+        moved.push_back(1);
+        return size() - 1;
+    }
+
+    unsigned int add(const glm::mat4 &mat)
+    {
+        unsigned int i = add(glm::vec3(0.0f));
+        setMatrix(i, mat);
+        return i;
+    }
+
+    // removes an instance by moving the last one into its place (see EntityStore::destroy).
+    void swapRemove(unsigned int i)
+    {
+        unsigned int last = size() - 1;
+        ::swapRemove(position, i);
+        ::swapRemove(rotation, i);
+        ::swapRemove(scale, i);
+        ::swapRemove(shear, i);
+        ::swapRemove(world, i);
+        ::swapRemove(dirty, i);
+        ::swapRemove(moved, i);
+        // forget the undo steps of the instance, and keep the moved one's pointing at it
+        unsigned int kept = 0;
+        for(unsigned int k = 0; k < undoStack.size(); k++)
+        {
+            if(undoStack[k].index == i)
+                continue;
+            undoStack[kept] = undoStack[k];
+            if(undoStack[kept].index == last)
+                undoStack[kept].index = i;
+            kept++;
+        }
+        undoStack.resize(kept);
+    }
+
+    void clear()
+    {
+        position.clear();
+        rotation.clear();
+        scale.clear();
+        shear.clear();
+        world.clear();
+        dirty.clear();
+        moved.clear();
+        undoStack.clear();
+    }
+
+    // edits, all in the instance's local space
+    // ------------------------------------------------------------------------
+    void translate(unsigned int i, const glm::vec3 &offset)
+    {
+        position[i] += linear(i) * offset;
+        touch(i);
+    }
+
+    void rotate(unsigned int i, float angle, const glm::vec3 &axis)
+    {
+        rotation[i] = glm::normalize(rotation[i] * glm::angleAxis(angle, glm::normalize(axis)));
+        touch(i);
+    }
+
+    // rotates by `angle`, moves by `offset` in the rotated frame and rotates by `angle` again: an orbit
+    void orbit(unsigned int i, float angle, const glm::vec3 &axis, const glm::vec3 &offset)
+    {
+        glm::quat q = glm::angleAxis(angle, glm::normalize(axis));
+        position[i] += linear(i) * (q * offset);
+        rotation[i] = glm::normalize(rotation[i] * q * q);
+        touch(i);
+    }
+
+    void scaleBy(unsigned int i, const glm::vec3 &factor)
+    {
+        scale[i] *= factor;
+        touch(i);
+    }
+
+    void setPosition(unsigned int i, const glm::vec3 &p)
+    {
+        position[i] = p;
+        touch(i);
+    }
+
+    void setRotation(unsigned int i, const glm::quat &r)
+    {
+        rotation[i] = r;
+        touch(i);
+    }
+
+    void setScale(unsigned int i, const glm::vec3 &s)
+    {
+        scale[i] = s;
+        touch(i);
+    }
+
+    // shears along one axis: `a` and `b` are how much of it goes into the two other axes
+    void shearAlong(unsigned int i, char axis, float a, float b)
+    {
+        Shear &s = shear[i];
+        if(axis == 'x') { s.xy += a; s.xz += b; }
+        if(axis == 'y') { s.yx += a; s.yz += b; }
+        if(axis == 'z') { s.zx += a; s.zy += b; }
+        touch(i);
+    }
+
+    // replaces the components with the decomposition of an affine matrix (Gram-Schmidt on its columns, so the
+    // shear comes out upper triangular and composing the result gives the matrix back)
+    void setMatrix(unsigned int i, const glm::mat4 &mat)
+    {
+        glm::vec3 c0(mat[0]), c1(mat[1]), c2(mat[2]);
+        float sx = glm::length(c0);
+        glm::vec3 q0 = c0 / nonZero(sx);
+        float u01 = glm::dot(q0, c1);
+        glm::vec3 r1 = c1 - u01 * q0;
+        float sy = glm::length(r1);
+        glm::vec3 q1 = r1 / nonZero(sy);
+        float u02 = glm::dot(q0, c2), u12 = glm::dot(q1, c2);
+        glm::vec3 r2 = c2 - u02 * q0 - u12 * q1;
+        float sz = glm::length(r2);
+        glm::vec3 q2 = r2 / nonZero(sz);
+        // keep the rotation proper, a mirroring goes into the scale
+        if(glm::dot(glm::cross(q0, q1), q2) < 0.0f)
+        {
+            q2 = -q2;
+            sz = -sz;
+        }
+
+        position[i] = glm::vec3(mat[3]);
+        rotation[i] = glm::normalize(glm::quat_cast(glm::mat3(q0, q1, q2)));
+        scale[i] = glm::vec3(sx, sy, sz);
+        Shear s = { 0.0f, 0.0f, u01 / nonZero(sy), 0.0f, u02 / nonZero(sz), u12 / nonZero(sz) };
+        shear[i] = s;
+        touch(i);
+    }
+
+    // the composed matrix of an instance, up to date even before update()
+    glm::mat4 matrix(unsigned int i) const
+    {
+        if(!dirty[i])
+            return world[i];
+        return compose(position[i], rotation[i], scale[i], shear[i]);
+    }
+
+    // composes the world matrices of every dirty instance.
+    void update()
+    {
+        for(unsigned int i = 0; i < dirty.size(); i++)
+        {
+            if(!dirty[i])
+                continue;
+            world[i] = compose(position[i], rotation[i], scale[i], shear[i]);
+            dirty[i] = 0;
+        }
+    }
+
+    const vector<glm::mat4> &matrices()
+    {
+        update();
+        return world;
+    }
+
+    // starts a simulation step: from here on `moved` tells which instances the step changed.
+    void beginStep()
+    {
+        moved.assign(moved.size(), 0);
+    }
+
+    // the matrices between a previous state and this one; instances that didn't move in the last step (or
+    // that only exist here) reuse their world matrix, the others blend their components. `out` may live in
+    // the frame arena.
+    template<class Allocator>
+    void interpolate(const TransformStore &previous, float alpha, vector<glm::mat4, Allocator> &out)
+    {
+        update();
+        out.resize(size());
+        for(unsigned int i = 0; i < size(); i++)
+        {
+            if(!moved[i] || i >= previous.size())
+            {
+                out[i] = world[i];
+                continue;
+            }
+            const Shear &a = previous.shear[i], &b = shear[i];
+            Shear s = { glm::mix(a.xy, b.xy, alpha), glm::mix(a.xz, b.xz, alpha), glm::mix(a.yx, b.yx, alpha),
+                        glm::mix(a.yz, b.yz, alpha), glm::mix(a.zx, b.zx, alpha), glm::mix(a.zy, b.zy, alpha) };
+            out[i] = compose(glm::mix(previous.position[i], position[i], alpha),
+                             glm::slerp(previous.rotation[i], rotation[i], alpha),
+                             glm::mix(previous.scale[i], scale[i], alpha), s);
+        }
+    }
+
+    // takes over the components of every instance of another store (not its undo steps).
+    void copy(const TransformStore &other)
+    {
+        position = other.position;
+        rotation = other.rotation;
+        scale = other.scale;
+        shear = other.shear;
+        world.resize(size());
+        dirty.assign(size(), 1);
+        moved.assign(size(), 1);
+    }
+
+    // replaces every instance (and forgets the undo steps) with the given components, all of the same size.
+    void assign(const vector<glm::vec3> &p, const vector<glm::quat> &r, const vector<glm::vec3> &s, const vector<Shear> &h)
+    {
+        position = p;
+        rotation = r;
+        scale = s;
+        shear = h;
+        world.resize(size());
+        dirty.assign(size(), 1);
+        moved.assign(size(), 1);
+        undoStack.clear();
+    }
+
+    // makes instance `i` equal to the same instance of another store, so it won't blend.
+    void copy(unsigned int i, const TransformStore &other)
+    {
+        position[i] = other.position[i];
+        rotation[i] = other.rotation[i];
+        scale[i] = other.scale[i];
+        shear[i] = other.shear[i];
+        touch(i);
+    }
+
+    // undo: saves the components of an instance before an edit; undo() restores them bit for bit and returns
+    // the instance, or -1 if there is nothing to undo.
+    // ------------------------------------------------------------------------
+    void pushUndo(unsigned int i)
+    {
+        UndoStep step;
+        step.index = i;
+        step.components = components(i);
+        undoStack.push_back(step);
+        if(undoStack.size() > MAX_UNDO)
+            undoStack.erase(undoStack.begin());
+    }
+
+    int undo()
+    {
+        if(undoStack.empty())
+            return -1;
+        UndoStep step = undoStack.back();
+        undoStack.pop_back();
+        setComponents(step.index, step.components);
+        return step.index;
+    }
+
+    TransformComponents components(unsigned int i) const
+    {
+        TransformComponents c = { position[i], rotation[i], scale[i], shear[i] };
+        return c;
+    }
+
+    void setComponents(unsigned int i, const TransformComponents &c)
+    {
+        position[i] = c.position;
+        rotation[i] = c.rotation;
+        scale[i] = c.scale;
+        shear[i] = c.shear;
+        touch(i);
+    }
+
+    // serialization: one instance per line, position, rotation (w x y z), scale and shear, written with enough
+    // digits that reading them back gives the same floats
+    // ------------------------------------------------------------------------
+    void write(ostream &out) const
+    {
+        streamsize precision = out.precision(numeric_limits<float>::max_digits10);
+        out << size() << "\n";
+        for(unsigned int i = 0; i < size(); i++)
+        {
+            const glm::vec3 &p = position[i], &s = scale[i];
+            const glm::quat &r = rotation[i];
+            const Shear &h = shear[i];
+            out << p.x << " " << p.y << " " << p.z << "  "
+                << r.w << " " << r.x << " " << r.y << " " << r.z << "  "
+                << s.x << " " << s.y << " " << s.z << "  "
+                << h.xy << " " << h.xz << " " << h.yx << " " << h.yz << " " << h.zx << " " << h.zy << "\n";
+        }
+        out.precision(precision);
+    }
+
+    bool read(istream &in)
+    {
+        unsigned int n = 0;
+        if(!(in >> n))
+            return false;
+        clear();
+        for(unsigned int i = 0; i < n; i++)
+        {
+            TransformComponents c;
+            Shear &h = c.shear;
+            if(!(in >> c.position.x >> c.position.y >> c.position.z
+                    >> c.rotation.w >> c.rotation.x >> c.rotation.y >> c.rotation.z
+                    >> c.scale.x >> c.scale.y >> c.scale.z
+                    >> h.xy >> h.xz >> h.yx >> h.yz >> h.zx >> h.zy))
+            {
+                clear();
+                return false;
+            }
+            add(c.position);
+            setComponents(i, c);
+        }
+        return true;
+    }
+
+    static glm::mat4 compose(const glm::vec3 &p, const glm::quat &r, const glm::vec3 &s, const Shear &h)
+    {
+        glm::mat3 rot = glm::mat3_cast(r);
+        glm::mat4 mat;
+        mat[0] = glm::vec4(rot * (glm::vec3(1.0f, h.xy, h.xz) * s.x), 0.0f);
+        mat[1] = glm::vec4(rot * (glm::vec3(h.yx, 1.0f, h.yz) * s.y), 0.0f);
+        mat[2] = glm::vec4(rot * (glm::vec3(h.zx, h.zy, 1.0f) * s.z), 0.0f);
+        mat[3] = glm::vec4(p, 1.0f);
+        return mat;
+    }
+
+private:
+    static const unsigned int MAX_UNDO = 256;
+
+    struct UndoStep {
+        unsigned int index;
+        TransformComponents components;
+    };
+
+    vector<glm::mat4> world;
+    vector<unsigned char> dirty;	// world matrix needs composing
+    vector<unsigned char> moved;	// changed since beginStep()
+    vector<UndoStep> undoStack;
+
+    void touch(unsigned int i)
+    {
+        dirty[i] = 1;
+        moved[i] = 1;
+    }
+
+    glm::mat3 linear(unsigned int i) const
+    {
+        return glm::mat3(compose(glm::vec3(0.0f), rotation[i], scale[i], shear[i]));
+    }
+
+    static float nonZero(float x)
+    {
+        return x != 0.0f ? x : 1e-30f;
+    }
+};
+#endif
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in float Age;
+
+void main()
+{
+    // round sprites that cool down from orange to dark rock as they age
+    vec2 d = gl_PointCoord - vec2(0.5);
+    if(dot(d, d) > 0.25)
+        discard;
+    FragColor = vec4(mix(vec3(1.0, 0.6, 0.2), vec3(0.35, 0.3, 0.25), Age), 1.0);
+}
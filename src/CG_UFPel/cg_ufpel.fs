@@ -3,9 +3,10 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D texture_diffuse1;
+uniform sampler2DArray texture_diffuse1;
+uniform float texture_diffuse1_layer;
 
 void main()
 {    
-    FragColor = texture(texture_diffuse1, TexCoords);
+    FragColor = texture(texture_diffuse1, vec3(TexCoords, texture_diffuse1_layer));
 }
\ No newline at end of file
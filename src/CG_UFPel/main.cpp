@@ -1,3 +1,5 @@
+// the replaced operator new/delete live in this file when allocations are tracked (see alloc_tracker.h)
+#define ALLOC_TRACKER_IMPLEMENTATION
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -5,52 +7,480 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform2.hpp>
-#include <glm/gtx/spline.hpp>
 
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/benchmark.h>
+#include <learnopengl/profiler.h>
+#include <learnopengl/alloc_tracker.h>
+#include <learnopengl/frame_arena.h>
+#include <learnopengl/gpu_timer.h>
+#include <learnopengl/input.h>
+#include <learnopengl/entity_store.h>
+#include <learnopengl/transform_store.h>
+#include <learnopengl/scene_graph.h>
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/job_system.h>
+#include <learnopengl/particle_system.h>
+#include <learnopengl/particle_renderer.h>
+#include <learnopengl/stream_buffer.h>
+#include <learnopengl/software_rasterizer.h>
+#include <learnopengl/ray_tracer.h>
+#include <learnopengl/draw_list.h>
+#include <learnopengl/frame_pipeline.h>
+#include <learnopengl/scene_snapshot.h>
+#include <learnopengl/collision_world.h>
+#ifdef CG_HEADLESS
+#include <learnopengl/headless.h>
+#endif
+#ifdef CG_FARM
+#include <learnopengl/render_farm.h>
+#endif
 
 #include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+// everything the GL thread needs to draw a frame, copied out of the simulation so it can be drawn while
+// the next frame is simulated
+struct FrameSnapshot {
+    vector<DrawCommand> commands;	// culled and sorted
+    DrawListStats drawStats;
+    CollisionStats collisionStats;
+    vector<CollisionPair> collisionPairs;	// the first few overlapping pairs
+    glm::mat4 view, projection;
+    int width, height;				// viewport
+    vector<float> particles;		// packed by ParticleSystem::pack()
+    double inputTime;				// wall time when the input of the frame was read
+    bool software;					// drawn by the software rasterizer
+};
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void render(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> transform);
-void processInput(GLFWwindow *window, vector<Model> objs, vector<int> *models, vector<glm::mat4> *transform, Shader shader);
+void render(GLFWwindow *window, Shader shader, const vector<Model> &objs, const FrameSnapshot &frame);
+void buildSnapshot(const vector<int> &models, const vector<glm::mat4> &world, FrameSnapshot &frame, double inputTime);
+void renderThread(GLFWwindow *window, Shader shader, const vector<Model> &objs);
+void processInput(GLFWwindow *window, const vector<Model> &objs, vector<int> *models, TransformStore *transform, Shader shader);
 void printState();
-void createModel(const int obj, vector<int> *models, vector<glm::mat4> *transform);
-void deleteModel(vector<int> *models, vector<glm::mat4> *transform);
-void setDimension(GLFWwindow *window, int key);
-void translate(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const char axis, const int sign);
-void rotate(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const char axis, const int sign);
-void scale(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const int sign);
-void shear(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const int x, const int y);
-glm::mat4 bigRotation(glm::mat4 mat, float deg, glm::vec3 rot, glm::vec3 transl);
-void animation1(GLFWwindow *window, vector<int> *models, vector<glm::mat4> *transform, Shader shader);
-void animation2(GLFWwindow *window, vector<int> *models, vector<glm::mat4> *transform, Shader shader);
+void printStats();
+void printArenas();
+double getTime();
+double wallTime();
+GLFWwindow *createWindow();
+void initRendering();
+void loadObjects(vector<Model> &objs);
+void present(GLFWwindow *window);
+void createModel(const int obj, vector<int> *models, TransformStore *transform);
+void deleteModel(vector<int> *models, TransformStore *transform);
+void removeModel(Entity entity, vector<int> *models, TransformStore *transform);
+void setDimension(int key);
+void bindKeys();
+void translateStep(vector<int> *models, TransformStore *transform, const char axis, const int sign, float delta);
+bool moveBlocked(vector<int> *models, TransformStore *transform, const glm::vec3 &offset);
+bool related(int a, int b);
+void reportCollisions();
+void rotateStep(TransformStore *transform, const char axis, const int sign, float delta);
+void scaleStep(TransformStore *transform, const int sign, float delta);
+void shearStep(TransformStore *transform, const int axis, const int sign, float delta);
+bool saveScene(const char *path, vector<int> *models, TransformStore *transform);
+bool loadScene(const char *path, vector<int> *models, TransformStore *transform);
+bool readScene(const char *path, unsigned int objectCount, vector<int> &objs, vector<int> &parents, TransformStore &transform);
+bool saveSnapshot(const char *path, const vector<Model> &objs, vector<int> *models, TransformStore *transform);
+bool loadSnapshot(const char *path, const vector<Model> &objs, vector<int> *models, TransformStore *transform);
+void playClip(const AnimationClip *clip, vector<int> *models, TransformStore *transform);
+void stepClips(vector<int> *models, TransformStore *transform, float delta);
+void runFrame(GLFWwindow *window, Shader shader, const vector<Model> &objs, vector<int> *models, TransformStore *transform);
+void renderImage(const vector<int> &models, const vector<glm::mat4> &world);
+void pickModel(const vector<Model> &objs, const vector<int> &models, const vector<glm::mat4> &world);
+void simulate(vector<int> *models, TransformStore *transform, float delta);
+void addInstance(const int obj, const glm::mat4 &mat, vector<int> *models, TransformStore *transform, int parent = -1);
+glm::mat4 worldMatrix(TransformStore *transform, int i);
+int active();
+void attachModel(TransformStore *transform, int child, int parent);
+void clearModels(vector<int> *models, TransformStore *transform);
+void runBenchmark(GLFWwindow *window, Shader shader, const vector<Model> &objs, vector<int> *models, TransformStore *transform);
+void applyBenchEvent(vector<int> *models, TransformStore *transform, const BenchEvent &event, bool start);
+#ifdef CG_FARM
+int runFarmWorker(const string &jobList);
+#endif
+
+// input actions, bound to keys in bindKeys()
+enum Action {
+    ACTION_QUIT,
+    ACTION_FORWARD, ACTION_BACKWARD, ACTION_LEFT, ACTION_RIGHT,
+    ACTION_CREATE_1, ACTION_CREATE_2, ACTION_CREATE_3, ACTION_CREATE_4,
+    ACTION_DELETE, ACTION_NEXT_MODEL, ACTION_PREVIOUS_MODEL,
+    ACTION_TOGGLE_X, ACTION_TOGGLE_Y, ACTION_TOGGLE_Z,
+    ACTION_TRANSLATE_X_POS, ACTION_TRANSLATE_X_NEG, ACTION_TRANSLATE_Y_POS, ACTION_TRANSLATE_Y_NEG, ACTION_TRANSLATE_Z_POS, ACTION_TRANSLATE_Z_NEG,
+    ACTION_FOCUS,
+    ACTION_ROTATE_X_CW, ACTION_ROTATE_X_CCW, ACTION_ROTATE_Y_CW, ACTION_ROTATE_Y_CCW, ACTION_ROTATE_Z_CW, ACTION_ROTATE_Z_CCW,
+    ACTION_SCALE_DOWN, ACTION_SCALE_UP,
+    ACTION_REFLECT,
+    ACTION_SHEAR_X_NEG, ACTION_SHEAR_X_POS, ACTION_SHEAR_Y_NEG, ACTION_SHEAR_Y_POS, ACTION_SHEAR_Z_NEG, ACTION_SHEAR_Z_POS,
+    ACTION_PROJECT,
+    ACTION_ANIMATION1, ACTION_ANIMATION2,
+    ACTION_STATS, ACTION_TRACE, ACTION_RENDERER, ACTION_RENDER_IMAGE, ACTION_PICK,
+    ACTION_UNDO, ACTION_SAVE, ACTION_LOAD, ACTION_SAVE_SNAPSHOT, ACTION_LOAD_SNAPSHOT,
+    ACTION_ATTACH, ACTION_DETACH,
+    ACTION_SOLID,
+    ACTION_COUNT
+};
+Input input;
 
 // settings
-const unsigned int SCR_WIDTH = 800;
-const unsigned int SCR_HEIGHT = 600;
-int nModels = 0;
+unsigned int scrWidth = 800;
+unsigned int scrHeight = 600;
 int position = 0;
-int activeModel = 0;
+// instances are entities; their handle maps to the dense index shared by `models`, the transforms and the scene graph
+EntityStore entities;
+Entity activeModel = NO_ENTITY;
+Entity previousModel = NO_ENTITY;	// the model that was active before the current one
 int focus = 0;
 glm::vec3 dim(1.0, 1.0, 1.0);
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
-float lastX = SCR_WIDTH / 2.0f;
-float lastY = SCR_HEIGHT / 2.0f;
+float lastX = scrWidth / 2.0f;
+float lastY = scrHeight / 2.0f;
 bool firstMouse = true;
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+double lastPresent = 0.0;	// wall time of the last presented frame
+int maxFps = 0;				// render rate cap, 0 for none
+
+// simulation: transforms and animations advance in fixed steps, rendering interpolates between the
+// state before and after the last step so the result doesn't depend on the frame rate
+const double SIM_STEP = 1.0 / 60.0;
+double accumulator = 0.0;
+TransformStore previousTransform;
+
+// parent/child relations of the instances; the transforms above are local to the parent
+SceneGraph sceneGraph;
+
+// the animations are keyframe clips loaded from resources/animations; any number of them play at once,
+// each on its own instances, and the animator advances them all in the simulation steps
+vector<AnimationClip> clips;
+Animator animator;
+
+// debris particles, emitted by the clips' burst events; simulated and packed for drawing on the worker threads
+JobSystem jobs;
+ParticleSystem particles;
+ParticleRenderer *particleRenderer = NULL;
+
+// per-frame data for the GPU (the particle vertices) is bump allocated from a fenced ring of frame regions
+StreamBuffer streamBuffer;
+
+// rendering on the CPU, for machines without a GPU: --renderer software or F6. When pipelined it runs on the
+// render thread while the main thread uses `jobs`, so the render thread makes a pool of its own with
+// `rasterThreads` of the hardware threads, and `jobs` is held to the others while software rendering is on.
+bool softwareRendering = false;
+bool drewSoftware = false;			// the last frame drawn was, which may lag behind the choice
+TextureLibrary textureImages;		// the textures of the CPU renderers
+SoftwareRasterizer softwareRasterizer(textureImages);
+JobSystem *rasterJobs = &jobs;
+unsigned int rasterThreads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+
+// reference images: F7 ray traces the scene as the camera sees it into render.ppm, on the worker threads
+RayTracer rayTracer(textureImages);
+bool imageRequested = false;
+
+// picking: a left click selects the model under the crosshair, tested against the meshes' triangle BVHs.
+// --bvh-cache keeps the trees next to the models, so later runs don't build them again.
+bool pickRequested = false;
+bool bvhCache = false;
+size_t bvhBytes = 0, meshBytes = 0;	// of all the trees, and of the meshes they index
+
+// collisions: the pairs of instances whose convex hulls overlap are found every frame. With --solid or T,
+// translations that would push the active model into another are refused.
+CollisionWorld collisions;
+bool solid = false;
+vector<unsigned int> activeContacts;	// the models the active one overlapped in the last frame
+CollisionStats collisionStats;			// of the last frame drawn
+vector<CollisionPair> collisionPairs;
+
+#ifdef CG_ALLOC_TRACKING
+// what the last frame allocated; with --alloc-limit N, a frame making more than N allocations fails the run
+AllocFrame allocFrame;
+#endif
 
-int main()
+// culling and draw command building, done on the worker threads before the GL thread submits the commands
+DrawListBuilder drawList;
+vector<DrawBounds> objBounds;		// bounding sphere of each object
+DrawListStats drawListStats;		// of the last frame drawn
+
+// headless mode: render offscreen for a fixed number of frames, optionally dumping them to disk
+bool headless = false;
+int headlessFrames = 1;
+string frameDir;
+int frameCount = 0;
+#ifdef CG_HEADLESS
+HeadlessContext headlessContext;
+#endif
+
+// snapshots: F8 writes the instances and the camera to a binary file, appending only what changed when it
+// saves to the same file again, and F10 restores it; --snapshot FILE picks the file and restores it at startup
+SceneSnapshot snapshot;
+string snapshotPath = "scene.snap";
+bool restoreSnapshot = false;
+
+// render farm: --farm JOBS renders a job list into PNG sequences on worker processes, which are this program
+// started again with --farm-worker JOBS (see render_farm.h)
+string farmPath, farmWorkerPath;
+unsigned int farmWorkers = 0;		// 0 for one per hardware thread
+
+// benchmark mode: drive the scene from a script with a fixed timestep and report what each frame cost
+bool benchMode = false;
+string reportPath;
+BenchScript benchScript;
+BenchReport benchReport;
+
+// gpu timing of the render passes, read back a few frames late so we never stall on it
+GpuTimer gpuTimer;
+unsigned int framePass, clearPass, geometryPass, particlesPass;
+
+// pipelined frames: in a window, a render thread owns the GL context and draws the snapshots the main
+// thread publishes, while the main thread polls events and simulates the next frame. Benchmarks and
+// headless runs stay on one thread so they are reproducible.
+bool pipelined = true;
+FramePipeline<FrameSnapshot> pipeline;
+FrameSnapshot syncFrame;			// the snapshot when not pipelined
+LatencyStats latency;				// input to present, kept by the thread that presents
+std::atomic<bool> statsRequested(false);
+int viewportWidth = 0, viewportHeight = 0;
+
+int main(int argc, char **argv)
+{
+    // command line
+    // ------------
+    string benchPath;
+#ifdef CG_BENCH
+    // the benchmark target runs the default script offscreen unless told otherwise
+    benchPath = "resources/bench/default.bench";
+#ifdef CG_HEADLESS
+    headless = true;
+#endif
+#endif
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "--headless"))
+            headless = true;
+        else if(!strcmp(argv[i], "--windowed"))
+            headless = false;
+        else if(!strcmp(argv[i], "--bench") && i + 1 < argc)
+            benchPath = argv[++i];
+        else if(!strcmp(argv[i], "--report") && i + 1 < argc)
+            reportPath = argv[++i];
+        else if(!strcmp(argv[i], "--hitch") && i + 1 < argc)
+            PROFILE_SET_HITCH_THRESHOLD(atof(argv[++i]) / 1000.0);
+        else if(!strcmp(argv[i], "--frame-arena") && i + 1 < argc)
+            FrameArena::initialCapacity() = (size_t)std::max(atoi(argv[++i]), 0) * 1024;
+        else if(!strcmp(argv[i], "--alloc-limit") && i + 1 < argc)
+            ALLOC_SET_LIMIT(strtoull(argv[++i], NULL, 10));
+        else if(!strcmp(argv[i], "--alloc-sample") && i + 1 < argc)
+            ALLOC_SET_SAMPLE_INTERVAL(atoi(argv[++i]));
+        else if(!strcmp(argv[i], "--size") && i + 1 < argc)
+            sscanf(argv[++i], "%ux%u", &scrWidth, &scrHeight);
+        else if(!strcmp(argv[i], "--frames") && i + 1 < argc)
+            headlessFrames = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--out") && i + 1 < argc)
+            frameDir = argv[++i];
+        else if(!strcmp(argv[i], "--fps") && i + 1 < argc)
+            maxFps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--no-pipeline"))
+            pipelined = false;
+        else if(!strcmp(argv[i], "--bvh-cache"))
+            bvhCache = true;
+        else if(!strcmp(argv[i], "--solid"))
+            solid = true;
+        else if(!strcmp(argv[i], "--samples") && i + 1 < argc)
+            rayTracer.samples = std::max(atoi(argv[++i]), 1);
+        else if(!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            snapshotPath = argv[++i];
+            restoreSnapshot = true;
+        }
+        else if(!strcmp(argv[i], "--farm") && i + 1 < argc)
+            farmPath = argv[++i];
+        else if(!strcmp(argv[i], "--workers") && i + 1 < argc)
+            farmWorkers = std::max(atoi(argv[++i]), 1);
+        else if(!strcmp(argv[i], "--farm-worker") && i + 1 < argc)
+            farmWorkerPath = argv[++i];
+        else if(!strcmp(argv[i], "--renderer") && i + 1 < argc && (!strcmp(argv[i + 1], "gl") || !strcmp(argv[i + 1], "software")))
+            softwareRendering = !strcmp(argv[++i], "software");
+        else {
+            std::cout << "Usage: " << argv[0] << " [--headless | --windowed] [--size WxH] [--frames N] [--out DIR] [--fps N] [--no-pipeline] [--renderer gl|software] [--samples N] [--bvh-cache] [--solid] [--snapshot FILE] [--bench SCRIPT [--report FILE]] [--farm JOBS [--workers N]] [--hitch MS] [--frame-arena KB] [--alloc-limit N] [--alloc-sample N]" << std::endl;
+            return -1;
+        }
+    }
+    if(!farmPath.empty() || !farmWorkerPath.empty()) {
+#ifdef CG_FARM
+        // the farm itself never touches GL, its workers each make a headless context of their own
+        if(!farmWorkerPath.empty())
+            return runFarmWorker(farmWorkerPath);
+        RenderFarm farm;
+        unsigned int workers = farmWorkers > 0 ? farmWorkers : std::max(std::thread::hardware_concurrency(), 1u);
+        return farm.load(farmPath) && farm.run(workers, "/proc/self/exe") ? 0 : -1;
+#else
+        std::cout << "The render farm is not available in this build (it needs headless rendering and zlib, configure with -DCG_HEADLESS=ON)" << std::endl;
+        return -1;
+#endif
+    }
+    if(!benchPath.empty()) {
+        if(!benchScript.load(benchPath))
+            return -1;
+        benchMode = true;
+        scrWidth = benchScript.width;
+        scrHeight = benchScript.height;
+    }
+    pipelined = pipelined && !headless && !benchMode;
+    FrameArena::local().name = "main";
+
+    GLFWwindow* window = NULL;
+    if(headless) {
+#ifdef CG_HEADLESS
+        // egl: create a surfaceless context rendering into an offscreen framebuffer
+        // -------------------------------------------------------------------------
+        if(!headlessContext.create(scrWidth, scrHeight))
+            return -1;
+#else
+        std::cout << "Headless rendering is not available in this build (configure with -DCG_HEADLESS=ON)" << std::endl;
+        return -1;
+#endif
+    }
+    else {
+        window = createWindow();
+        if(window == NULL)
+            return -1;
+    }
+    viewportWidth = scrWidth;
+    viewportHeight = scrHeight;
+    if(window != NULL)
+        glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+
+    initRendering();
+
+    // build and compile shaders
+    // -------------------------
+    Shader shader("resources/cg_ufpel.vs", "resources/cg_ufpel.fs");
+    ParticleRenderer debris("resources/particle.vs", "resources/particle.fs", streamBuffer);
+    particleRenderer = &debris;
+    vector<Model> objs;
+    vector<int> models;
+    TransformStore transform;
+    loadObjects(objs);
+    double bvhStart = wallTime();
+    unsigned int cachedBVHs = 0;
+    for(unsigned int i = 0; i < objs.size(); ++i) {
+        cachedBVHs += objs[i].buildBVH(&jobs, bvhCache);
+        bvhBytes += objs[i].bvhMemory();
+        meshBytes += objs[i].meshMemory();
+    }
+    printf(" Mesh BVHs: %.1f KB, %.1f%% on top of the %.1f KB of mesh data; %u of %u models from the cache, %.1f ms\n",
+           bvhBytes / 1024.0, 100.0 * bvhBytes / std::max(meshBytes, (size_t)1), meshBytes / 1024.0, cachedBVHs,
+           (unsigned int)objs.size(), (wallTime() - bvhStart) * 1000.0);
+    for(unsigned int i = 0; i < objs.size(); ++i) {
+        softwareRasterizer.addObject(objs[i].meshes, objs[i].directory);
+        rayTracer.addObject(objs[i].meshes, objs[i].directory);
+        collisions.addObject(objs[i].hulls);
+    }
+    bindKeys();
+
+    // load animations
+    // ---------------
+    clips.resize(2);
+    // a clip that fails to load stays empty and plays nothing
+    if(!clips[0].load("resources/animations/explosion.clip"))
+        clips[0] = AnimationClip();
+    if(!clips[1].load("resources/animations/spline.clip"))
+        clips[1] = AnimationClip();
+
+    if(benchMode) {
+        ALLOC_BEGIN_FRAMES();
+        runBenchmark(window, shader, objs, &models, &transform);
+        if(!headless)
+            glfwTerminate();
+#ifdef CG_ALLOC_TRACKING
+        AllocTracker &allocs = AllocTracker::instance();
+        benchReport.allocationsTracked = true;
+        benchReport.allocationLimit = allocs.limit;
+        benchReport.allocationFailures = allocs.failedFrames;
+        benchReport.allocationZones = allocs.zoneTotals();
+        benchReport.allocationStacks = allocs.sampledStacks(10);
+        if(!benchReport.write(reportPath, benchScript) || allocs.failedFrames > 0)
+            return -1;
+        return 0;
+#else
+        return benchReport.write(reportPath, benchScript) ? 0 : -1;
+#endif
+    }
+
+    // render loop
+    // -----------
+    if(restoreSnapshot) {
+        if(!loadSnapshot(snapshotPath.c_str(), objs, &models, &transform))
+            return -1;
+    }
+    else {
+        createModel(0, &models, &transform);
+        printState();
+    }
+
+    std::thread renderer;
+    if(pipelined) {
+        // hand the GL context over to the render thread
+        glfwMakeContextCurrent(NULL);
+        renderer = std::thread(renderThread, window, shader, std::cref(objs));
+    }
+
+    ALLOC_BEGIN_FRAMES();
+    lastFrame = getTime();
+    while (headless ? frameCount < headlessFrames : !glfwWindowShouldClose(window))
+        runFrame(window, shader, objs, &models, &transform);
+
+    if(pipelined) {
+        pipeline.close();
+        renderer.join();
+        glfwMakeContextCurrent(window);
+    }
+    if(latency.count > 0)
+        printf(" Input to present latency: %.3f ms average, %.3f ms worst over %u frames (%s)\n", latency.overallAverage() * 1000.0,
+               latency.worst * 1000.0, latency.count, pipelined ? "pipelined" : "one thread");
+    printArenas();
+#ifdef CG_ALLOC_TRACKING
+    AllocTracker::instance().printSummary();
+    vector<AllocationSite> stacks = AllocTracker::instance().sampledStacks(5);
+    for(unsigned int i = 0; i < stacks.size(); ++i)
+        printf("   %llu samples, %.1f KB: %s\n", stacks[i].count, stacks[i].bytes / 1024.0, stacks[i].name.c_str());
+#endif
+
+#ifdef CG_HEADLESS
+    if(headless)
+        headlessContext.destroy();
+#endif
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    if(!headless)
+        glfwTerminate();
+#ifdef CG_ALLOC_TRACKING
+    if(AllocTracker::instance().failedFrames > 0)
+        return -1;
+#endif
+    return 0;
+}
+
+// glfw: create the window and its OpenGL 3.3 core context, and load the GL functions into it
+// --------------------------------------------------------------------------------------------
+GLFWwindow *createWindow()
 {
     // glfw: initialize and configure
     // ------------------------------
@@ -65,17 +495,21 @@ int main()
 
     // glfw window creation
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    GLFWwindow *window = glfwCreateWindow(scrWidth, scrHeight, "LearnOpenGL", NULL, NULL);
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
-        return -1;
+        return NULL;
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    input.attach(window);
+
+    // wait for vsync instead of spinning through frames nobody will see
+    glfwSwapInterval(1);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -85,235 +519,575 @@ int main()
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        return NULL;
     }
 
-    // configure global opengl state
-    // -----------------------------
+    return window;
+}
+
+// configure global opengl state and what the render passes need
+// --------------------------------------------------------------
+void initRendering()
+{
     glEnable(GL_DEPTH_TEST);
 
-    // build and compile shaders
-    // -------------------------
-    Shader shader("resources/cg_ufpel.vs", "resources/cg_ufpel.fs");
+    gpuTimer.init();
+    framePass = gpuTimer.pass("frame");
+    clearPass = gpuTimer.pass("clear");
+    geometryPass = gpuTimer.pass("geometry");
+    particlesPass = gpuTimer.pass("particles");
+    streamBuffer.init(4 << 20);
+}
+
+// load models: the objects instances are made of, with the bounding spheres culling uses
+// ---------------------------------------------------------------------------------------
+void loadObjects(vector<Model> &objs)
+{
     Model rock("resources/objects/rock/rock.obj");
     Model planet("resources/objects/planet/planet.obj");
     Model cyborg("resources/objects/cyborg/cyborg.obj");
     Model nanosuit("resources/objects/nanosuit/nanosuit.obj");
-    vector<Model> objs;
-    vector<int> models;
-    vector<glm::mat4> transform;
+    Model dog("resources/objects/doggo/planet.obj");
 
     objs.push_back(rock);
     objs.push_back(planet);
     objs.push_back(cyborg);
     objs.push_back(nanosuit);
-    // load models
-    // -----------
-
-    // draw in wireframe
-    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    objs.push_back(dog);	// only used by the animations
+    for(unsigned int i = 0; i < objs.size(); ++i) {
+        DrawBounds bounds = { objs[i].boundsCenter, objs[i].boundsRadius };
+        objBounds.push_back(bounds);
+    }
+}
 
-    // render loop
-    // -----------
-    createModel(0, &models, &transform);
-    printState();
+// one iteration of the main loop: input, as many fixed simulation steps as the elapsed time asks for, render
+// ----------------------------------------------------------------------------------------------------------
+void runFrame(GLFWwindow *window, Shader shader, const vector<Model> &objs, vector<int> *models, TransformStore *transform)
+{
+    // per-frame time logic
+    // --------------------
+    float currentFrame = getTime();
+    deltaTime = currentFrame - lastFrame;
+    lastFrame = currentFrame;
+    // after a long hitch, catch up at most a few steps instead of spiralling
+    accumulator += std::min((double)deltaTime, 0.25);
+
+    // input
+    // -----
+    if(window != NULL)
+        glfwPollEvents();
+    double inputTime = wallTime();
+    input.beginFrame();
+    processInput(window, objs, models, transform, shader);
+
+    // simulation
+    // ----------
+    // the render thread rasterizes on its own pool meanwhile, leave it its share of the cores
+    jobs.limitThreads(pipelined && softwareRendering ? std::max(jobs.threads(), rasterThreads + 1) - rasterThreads : 0);
+    while(accumulator >= SIM_STEP - 1e-9) {
+        previousTransform.copy(*transform);
+        transform->beginStep();
+        simulate(models, transform, SIM_STEP);
+        accumulator -= SIM_STEP;
+    }
 
-    while (!glfwWindowShouldClose(window))
+    FrameVector<glm::mat4> matrices;
+    transform->interpolate(previousTransform, accumulator / SIM_STEP, matrices);
+    const vector<glm::mat4> &world = sceneGraph.update(matrices);
+    if(imageRequested) {
+        renderImage(*models, world);
+        imageRequested = false;
+    }
+    if(pickRequested) {
+        pickModel(objs, *models, world);
+        pickRequested = false;
+    }
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        PROFILE_ZONE("collisions");
+        collisions.update(*models, world, &jobs);
+    }
+    reportCollisions();
+    if(pipelined) {
+        // the render thread draws the previous frame meanwhile; this waits until it took that one
+        buildSnapshot(*models, world, pipeline.writeSlot(), inputTime);
+        pipeline.publish();
+    }
+    else {
+        buildSnapshot(*models, world, syncFrame, inputTime);
+        render(window, shader, objs, syncFrame);
+    }
+
+    // throttle the render rate if asked to; the simulation doesn't care
+    if(maxFps > 0) {
+        double wait = 1.0 / maxFps - (getTime() - currentFrame);
+        if(wait > 0.0 && !benchMode)
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+    FrameArena::local().reset();
+}
 
-        // input
-        // -----
-        processInput(window, objs, &models, &transform, shader);
+// advances everything that moves by one fixed step
+// ------------------------------------------------
+void simulate(vector<int> *models, TransformStore *transform, float delta)
+{
+    PROFILE_ZONE("simulate");
+    stepClips(models, transform, delta);
+    particles.update(delta, &jobs);
+    if (active() < 0)
+        return;
+
+    // Translation
+    if (input.isHeld(ACTION_TRANSLATE_X_POS))
+        translateStep(models, transform, 'x', 1, delta);
+    if (input.isHeld(ACTION_TRANSLATE_X_NEG))
+        translateStep(models, transform, 'x', -1, delta);
+    if (input.isHeld(ACTION_TRANSLATE_Y_POS))
+        translateStep(models, transform, 'y', 1, delta);
+    if (input.isHeld(ACTION_TRANSLATE_Y_NEG))
+        translateStep(models, transform, 'y', -1, delta);
+    if (input.isHeld(ACTION_TRANSLATE_Z_POS))
+        translateStep(models, transform, 'z', 1, delta);
+    if (input.isHeld(ACTION_TRANSLATE_Z_NEG))
+        translateStep(models, transform, 'z', -1, delta);
+
+    // Rotation
+    if (input.isHeld(ACTION_ROTATE_X_CW))
+        rotateStep(transform, 'x', -1, delta);
+    if (input.isHeld(ACTION_ROTATE_X_CCW))
+        rotateStep(transform, 'x', 1, delta);
+    if (input.isHeld(ACTION_ROTATE_Y_CW))
+        rotateStep(transform, 'y', -1, delta);
+    if (input.isHeld(ACTION_ROTATE_Y_CCW))
+        rotateStep(transform, 'y', 1, delta);
+    if (input.isHeld(ACTION_ROTATE_Z_CW))
+        rotateStep(transform, 'z', 1, delta);
+    if (input.isHeld(ACTION_ROTATE_Z_CCW))
+        rotateStep(transform, 'z', -1, delta);
+
+    // Scaling
+    if (input.isHeld(ACTION_SCALE_DOWN))
+        scaleStep(transform, -1, delta);
+    if (input.isHeld(ACTION_SCALE_UP))
+        scaleStep(transform, 1, delta);
 
-        render(window, shader, objs, models, transform);
+    // Shear
+    if (input.isHeld(ACTION_SHEAR_X_NEG))
+        shearStep(transform, 'x', -1, delta);
+    if (input.isHeld(ACTION_SHEAR_X_POS))
+        shearStep(transform, 'x', 1, delta);
+    if (input.isHeld(ACTION_SHEAR_Y_NEG))
+        shearStep(transform, 'y', -1, delta);
+    if (input.isHeld(ACTION_SHEAR_Y_POS))
+        shearStep(transform, 'y', 1, delta);
+    if (input.isHeld(ACTION_SHEAR_Z_NEG))
+        shearStep(transform, 'z', -1, delta);
+    if (input.isHeld(ACTION_SHEAR_Z_POS))
+        shearStep(transform, 'z', 1, delta);
+}
+
+// ray traces the scene as the camera sees it now into render.ppm, at the window's size; the frame waits for it
+// -----------------------------------------------------------------------------------------------------------
+void renderImage(const vector<int> &models, const vector<glm::mat4> &world)
+{
+    PROFILE_ZONE("renderImage");
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)scrWidth / (float)scrHeight, 0.1f, 100.0f);
+    rayTracer.build(models, world, &jobs);
+    rayTracer.render(camera.GetViewMatrix(), projection, scrWidth, scrHeight, &jobs);
+    if(!rayTracer.save("render.ppm"))
+        return;
+    const RayTracerStats &stats = rayTracer.stats;
+    printf(" Rendered render.ppm: %ux%u, %d samples per pixel, %u triangles (BVH of %u nodes built in %.1f ms), %llu rays in %.1f ms, %.2f Mrays/s on %u threads\n",
+           scrWidth, scrHeight, rayTracer.samples * rayTracer.samples, stats.triangles, stats.nodes, stats.buildTime * 1000.0,
+           stats.rays, stats.renderTime * 1000.0, stats.raysPerSecond() / 1e6, jobs.threads());
+}
+
+// selects the model whose triangles the ray through the crosshair hits first; the cursor is captured to steer
+// the camera, so the crosshair is the centre of the view
+// -------------------------------------------------------------------------------------------------------------
+void pickModel(const vector<Model> &objs, const vector<int> &models, const vector<glm::mat4> &world)
+{
+    PROFILE_ZONE("pickModel");
+    glm::vec3 origin = camera.Position, direction = glm::normalize(camera.Front);
+    MeshHit hit;
+    hit.t = 100.0f;		// the far plane
+    int picked = -1;
+    for(unsigned int i = 0; i < models.size(); ++i) {
+        int obj = models[i];
+        if(obj < 0)
+            continue;
+        // only instances whose bounding sphere the ray enters before the closest hit so far
+        glm::mat3 linear(world[i]);
+        float scale = std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+        glm::vec3 center = glm::vec3(world[i] * glm::vec4(objBounds[obj].center, 1.0f)) - origin;
+        float radius = objBounds[obj].radius * scale, along = glm::dot(center, direction);
+        float across = glm::dot(center, center) - along * along;
+        if(across > radius * radius || along + radius < 0.0f || along - sqrt(radius * radius - across) > hit.t)
+            continue;
+        if(objs[obj].intersect(world[i], origin, direction, hit))
+            picked = i;
+    }
+    if(picked < 0) {
+        printf(" Nothing under the crosshair\n");
+        return;
     }
+    previousModel = activeModel;
+    activeModel = entities.at(picked);
+    printState();
+    printf(" Picked model %d at %.2f units: mesh %u, triangle %u\n", picked + 1, hit.t, hit.mesh, hit.triangle);
+}
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
+// copies what the next frame draws out of the simulation state: the draw commands, culled and sorted on
+// the workers, the camera and the packed particles
+// --------------------------------------------------------------------------------------------------------
+void buildSnapshot(const vector<int> &models, const vector<glm::mat4> &world, FrameSnapshot &frame, double inputTime)
+{
+    PROFILE_ZONE("snapshot");
+    frame.width = viewportWidth;
+    frame.height = viewportHeight;
+    // view/projection transformations
+    frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)scrWidth / (float)scrHeight, 0.1f, 100.0f);
+    frame.view = camera.GetViewMatrix();
+    drawList.build(models, world, objBounds, frame.view, frame.projection, (float)scrHeight, &jobs, frame.commands, &frame.drawStats);
+    frame.particles.resize(4 * particles.size());
+    if(!frame.particles.empty())
+        particles.pack(&frame.particles[0], &jobs);
+    frame.collisionStats = collisions.stats;
+    frame.collisionPairs.assign(collisions.pairs.begin(), collisions.pairs.begin() + std::min((size_t)16, collisions.pairs.size()));
+    frame.inputTime = inputTime;
+    frame.software = softwareRendering;
 }
 
-void render(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> transform) {
+// the render thread: takes the GL context over and draws the published snapshots until the pipeline closes
+// ----------------------------------------------------------------------------------------------------------
+void renderThread(GLFWwindow *window, Shader shader, const vector<Model> &objs)
+{
+    glfwMakeContextCurrent(window);
+    FrameArena::local().name = "render";
+    JobSystem raster(rasterThreads);
+    rasterJobs = &raster;
+    while(const FrameSnapshot *frame = pipeline.acquire()) {
+        render(window, shader, objs, *frame);
+        FrameArena::local().reset();
+    }
+    rasterJobs = &jobs;
+    glfwMakeContextCurrent(NULL);
+}
+
+void render(GLFWwindow *window, Shader shader, const vector<Model> &objs, const FrameSnapshot &frame) {
+    PROFILE_ZONE("render");
+    renderStats().reset();
+    double submitStart = wallTime();
+    streamBuffer.beginFrame();
+    glViewport(0, 0, frame.width, frame.height);
+    gpuTimer.begin(framePass);
+    gpuTimer.begin(clearPass);
     glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    // don't forget to enable shader before setting uniforms
-    shader.use();
+    gpuTimer.end(clearPass);
+    gpuTimer.begin(geometryPass);
+    if(frame.software) {
+        // the meshes are drawn on the CPU and copied over, the particles only exist on the GL path
+        softwareRasterizer.render(frame.commands, frame.view, frame.projection, frame.width, frame.height, rasterJobs);
+        softwareRasterizer.blit();
+        gpuTimer.end(geometryPass);
+    }
+    else {
+        // don't forget to enable shader before setting uniforms
+        shader.use();
+
+        shader.setMat4("projection", frame.projection);
+        shader.setMat4("view", frame.view);
 
-    shader.setMat4("projection", projection);
-    shader.setMat4("view", view);
+        // the commands were culled and sorted before; only the GL calls happen here
+        for(unsigned int i = 0; i < frame.commands.size(); ++i) {
+            shader.setMat4("model", frame.commands[i].model);
+            objs[frame.commands[i].obj].Draw(shader);
+        }
+        gpuTimer.end(geometryPass);
+        gpuTimer.begin(particlesPass);
+        if(!frame.particles.empty())
+            particleRenderer->draw(&frame.particles[0], frame.particles.size() / 4, frame.projection * frame.view);
+        gpuTimer.end(particlesPass);
+    }
+    gpuTimer.end(framePass);
+    streamBuffer.endFrame();
+    renderStats().submitTime = wallTime() - submitStart;
+    drawListStats = frame.drawStats;
+    collisionStats = frame.collisionStats;
+    collisionPairs = frame.collisionPairs;
+    drewSoftware = frame.software;
+
+    present(window);
+    latency.add(wallTime() - frame.inputTime);
+    if(statsRequested.exchange(false))
+        printStats();
+}
 
-    for(int i = 0; i < nModels; ++i) {
-        // render the loaded model
-        shader.setMat4("model", transform[i]);
-        objs[models[i]].Draw(shader);
+// finishes a frame: swaps buffers in a window, or saves the offscreen frame when headless
+// ----------------------------------------------------------------------------------------
+void present(GLFWwindow *window)
+{
+    ++frameCount;
+    double now = wallTime();
+    bool exportedHitch = PROFILE_FRAME_END(now - lastPresent);
+#ifdef CG_ALLOC_TRACKING
+    allocFrame = AllocTracker::instance().endFrame();
+#endif
+    FrameVector<GpuTiming> timings;
+    gpuTimer.nextFrame(benchMode ? &timings : NULL);
+    if(benchMode) {
+        for(unsigned int i = 0; i < timings.size(); ++i)
+            benchReport.addGpuTime(gpuTimer.passes[timings[i].pass].name, timings[i].time);
+        benchReport.gpuDroppedFrames = gpuTimer.droppedFrames;
+        FrameSample sample;
+        RenderStats &stats = renderStats();
+        sample.cpuTime = now - lastPresent;
+        sample.submitTime = stats.submitTime;
+        sample.drawCalls = stats.drawCalls;
+        sample.stateChanges = stats.textureBinds + stats.uniformUpdates;
+        sample.streamedBytes = stats.streamedBytes;
+        sample.streamStalls = stats.streamStalls;
+#ifdef CG_ALLOC_TRACKING
+        sample.allocations = allocFrame.count;
+        sample.allocatedBytes = allocFrame.bytes;
+#else
+        sample.allocations = sample.allocatedBytes = 0;
+#endif
+        benchReport.add(sample);
+        stats.reset();
     }
+    // a hitch trace export takes long and is no part of the next frame
+    lastPresent = exportedHitch ? wallTime() : now;
+    if(headless) {
+#ifdef CG_HEADLESS
+        if(!frameDir.empty()) {
+            char name[32];
+            sprintf(name, "/frame_%05d.ppm", frameCount);
+            headlessContext.saveFrame(frameDir + name);
+        }
+        else
+            glFinish();
+#endif
+    }
+    else {
+        // glfw: swap buffers; IO events are polled by the main thread at the start of a frame
+        // -----------------------------------------------------------------------------------
+        glfwSwapBuffers(window);
+    }
+}
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    // -------------------------------------------------------------------------------
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+// seconds since the program started; doesn't need GLFW, so it also works headless
+// ---------------------------------------------------------------------------------
+double wallTime()
+{
+    static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window, vector<Model> objs, vector<int> *models, vector<glm::mat4> *transform, Shader shader)
+// simulation time: wall time, or a fixed step per presented frame in benchmark mode so runs are reproducible
+// ------------------------------------------------------------------------------------------------------------
+double getTime()
+{
+    if(benchMode)
+        return frameCount * (double)benchScript.timestep;
+    return wallTime();
+}
+
+// process all input: consume this frame's input commands and react to the actions they changed
+// ------------------------------------------------------------------------------------------------
+void processInput(GLFWwindow *window, const vector<Model> &objs, vector<int> *models, TransformStore *transform, Shader shader)
 {
+    PROFILE_ZONE("processInput");
     float x = dim.x, y = dim.y, z = dim.z;
 
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (input.wasPressed(ACTION_QUIT) && window != NULL)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (input.isHeld(ACTION_FORWARD))
         camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (input.isHeld(ACTION_BACKWARD))
         camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (input.isHeld(ACTION_LEFT))
         camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (input.isHeld(ACTION_RIGHT))
         camera.ProcessKeyboard(RIGHT, deltaTime);
 
-    // Model creation
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
-        createModel(0, models, transform);
-        while(glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
-            glfwPollEvents();
-    }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
-        createModel(1, models, transform);
-        while(glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
-            glfwPollEvents();
-    }
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
-        createModel(2, models, transform);
-        while(glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
-            glfwPollEvents();
+    // Statistics, printed by the thread that draws once the next frame is presented
+    if (input.wasPressed(ACTION_STATS))
+        statsRequested = true;
+
+    // Profiler trace
+    if (input.wasPressed(ACTION_TRACE))
+        PROFILE_EXPORT("trace.json");
+
+    // Picking, done once the frame's transforms are known
+    if (input.wasPressed(ACTION_PICK))
+        pickRequested = true;
+
+    // Reference image, ray traced once the frame's transforms are known
+    if (input.wasPressed(ACTION_RENDER_IMAGE))
+        imageRequested = true;
+
+    // Collisions: block moves into other models or not
+    if (input.wasPressed(ACTION_SOLID)) {
+        solid = !solid;
+        printf(" Solid models: %s\n", solid ? "ON" : "OFF");
     }
-    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
-        createModel(3, models, transform);
-        while(glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
-            glfwPollEvents();
+
+    // Renderer: GL or software
+    if (input.wasPressed(ACTION_RENDERER)) {
+        softwareRendering = !softwareRendering;
+        printf(" Renderer: %s\n", softwareRendering ? "software" : "GL");
     }
 
+    // Scene file
+    if (input.wasPressed(ACTION_SAVE))
+        saveScene("scene.txt", models, transform);
+    if (input.wasPressed(ACTION_LOAD))
+        loadScene("scene.txt", models, transform);
+    if (input.wasPressed(ACTION_SAVE_SNAPSHOT))
+        saveSnapshot(snapshotPath.c_str(), objs, models, transform);
+    if (input.wasPressed(ACTION_LOAD_SNAPSHOT))
+        loadSnapshot(snapshotPath.c_str(), objs, models, transform);
+
+    // Model creation
+    for(int obj = 0; obj < 4; ++obj)
+        if (input.wasPressed(ACTION_CREATE_1 + obj))
+            createModel(obj, models, transform);
+
     // Delete active model
-    if (glfwGetKey(window, GLFW_KEY_DELETE) == GLFW_PRESS) {
+    if (input.wasPressed(ACTION_DELETE) && active() >= 0)
         deleteModel(models, transform);
-        while(glfwGetKey(window, GLFW_KEY_DELETE) == GLFW_PRESS)
-            glfwPollEvents();
-    }
 
     // Select model
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-        activeModel = (activeModel + 1) % nModels;
+    if (input.wasPressed(ACTION_NEXT_MODEL) && entities.size() > 0) {
+        previousModel = activeModel;
+        activeModel = entities.at((active() + 1) % entities.size());
         printState();
-        while(glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-            glfwPollEvents();
     }
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-        activeModel -= 1;
-        if(activeModel < 0)
-
-            activeModel = nModels - 1;
+    if (input.wasPressed(ACTION_PREVIOUS_MODEL) && entities.size() > 0) {
+        previousModel = activeModel;
+        int i = active() - 1;
+        if(i < 0)
+            i = entities.size() - 1;
+        activeModel = entities.at(i);
         printState();
-        while(glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-            glfwPollEvents();
     }
 
     // Dimension selector
-    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
-        setDimension(window, GLFW_KEY_X);
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
-        setDimension(window, GLFW_KEY_Y);
-    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
-        setDimension(window, GLFW_KEY_Z);
-    // Translation
-    if (glfwGetKey(window, GLFW_KEY_KP_6) == GLFW_PRESS)
-        translate(window, shader, objs, *models, transform, GLFW_KEY_KP_6, 'x', 1);
-    if (glfwGetKey(window, GLFW_KEY_KP_4) == GLFW_PRESS)
-        translate(window, shader, objs, *models, transform, GLFW_KEY_KP_4, 'x', -1);
-    if (glfwGetKey(window, GLFW_KEY_KP_8) == GLFW_PRESS)
-        translate(window, shader, objs, *models, transform, GLFW_KEY_KP_8, 'y', 1);
-    if (glfwGetKey(window, GLFW_KEY_KP_2) == GLFW_PRESS)
-        translate(window, shader, objs, *models, transform, GLFW_KEY_KP_2, 'y', -1);
-    if (glfwGetKey(window, GLFW_KEY_KP_7) == GLFW_PRESS)
-        translate(window, shader, objs, *models, transform, GLFW_KEY_KP_7, 'z', 1);
-    if (glfwGetKey(window, GLFW_KEY_KP_9) == GLFW_PRESS)
-        translate(window, shader, objs, *models, transform, GLFW_KEY_KP_9, 'z', -1);
+    if (input.wasPressed(ACTION_TOGGLE_X))
+        setDimension(GLFW_KEY_X);
+    if (input.wasPressed(ACTION_TOGGLE_Y))
+        setDimension(GLFW_KEY_Y);
+    if (input.wasPressed(ACTION_TOGGLE_Z))
+        setDimension(GLFW_KEY_Z);
 
     // Set rotation focus
-    if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) {
+    if (input.wasPressed(ACTION_FOCUS)) {
         focus = ((int) focus + 1) % 2;
         printState();
-        while(glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
-            glfwPollEvents();
     }
-    // Rotation
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
-        rotate(window, shader, objs, *models, transform, GLFW_KEY_I, 'x', -1);
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
-        rotate(window, shader, objs, *models, transform, GLFW_KEY_K, 'x', 1);
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
-        rotate(window, shader, objs, *models, transform, GLFW_KEY_J, 'y', -1);
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-        rotate(window, shader, objs, *models, transform, GLFW_KEY_L, 'y', 1);
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS)
-        rotate(window, shader, objs, *models, transform, GLFW_KEY_U, 'z', 1);
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
-        rotate(window, shader, objs, *models, transform, GLFW_KEY_O, 'z', -1);
 
-    // Scaling
-    if (glfwGetKey(window, GLFW_KEY_KP_SUBTRACT) == GLFW_PRESS)
-        scale(window, shader, objs, *models, transform, GLFW_KEY_KP_SUBTRACT, -1);
-    if (glfwGetKey(window, GLFW_KEY_KP_ADD) == GLFW_PRESS)
-        scale(window, shader, objs, *models, transform, GLFW_KEY_KP_ADD, 1);
+    // Animations
+    if (input.wasPressed(ACTION_ANIMATION1))
+        playClip(&clips[0], models, transform);
+    if (input.wasPressed(ACTION_ANIMATION2))
+        playClip(&clips[1], models, transform);
+
+    int selected = active();
+    if (selected < 0)
+        return;
+
+    // Undo: every edit saves the model as it was when its key went down
+    for (int action = ACTION_TRANSLATE_X_POS; action <= ACTION_PROJECT; ++action)
+        if (input.wasPressed(action) && action != ACTION_FOCUS) {
+            transform->pushUndo(selected);
+            break;
+        }
 
-    // Reflection
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
-        (*transform)[activeModel] = glm::scale((*transform)[activeModel], glm::vec3(-40.0f * x + 1.0f, -40.0f * y + 1.0f, -40.0f * z + 1.0f));
-        while(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-            glfwPollEvents();
-    }
+    // Hierarchy: attach the active model to the one selected before it, or detach it, keeping it in place
+    if (input.wasPressed(ACTION_ATTACH) && entities.alive(previousModel) && previousModel != activeModel)
+        attachModel(transform, selected, entities.indexOf(previousModel));
+    if (input.wasPressed(ACTION_DETACH))
+        attachModel(transform, selected, -1);
 
-    // Shear
-    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS)
-        shear(window, shader, objs, *models, transform, GLFW_KEY_V, 'x', -1.0);
-    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
-        shear(window, shader, objs, *models, transform, GLFW_KEY_N, 'x', 1.0);
-    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
-        shear(window, shader, objs, *models, transform, GLFW_KEY_G, 'y', -1.0);
-    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS)
-        shear(window, shader, objs, *models, transform, GLFW_KEY_B, 'y', 1.0);
-    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
-        shear(window, shader, objs, *models, transform, GLFW_KEY_F, 'z', -1.0);
-    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
-        shear(window, shader, objs, *models, transform, GLFW_KEY_H, 'z', 1.0);
-
-    // Projection
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
-        (*transform)[activeModel] = glm::proj3D((*transform)[activeModel], glm::vec3(1.0f*x, 1.0f*y, 1.0f*z));
-        while(glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-            glfwPollEvents();
+    if (input.wasPressed(ACTION_UNDO)) {
+        int undone = transform->undo();
+        if (undone >= 0)
+            previousTransform.copy(undone, *transform);
     }
 
-    // Animations
-    if (glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS) {
-        animation1(window, models, transform, shader);
-        while(glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS)
-            glfwPollEvents();
-    }
-    if (glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS) {
-        animation2(window, models, transform, shader);
-        while(glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS)
-            glfwPollEvents();
-    }
+    // Reflection
+    if (input.wasPressed(ACTION_REFLECT))
+        transform->scaleBy(selected, glm::vec3(-40.0f * x + 1.0f, -40.0f * y + 1.0f, -40.0f * z + 1.0f));
+
+    // Projection: flattens the model along the selected axes
+    if (input.wasPressed(ACTION_PROJECT))
+        transform->scaleBy(selected, glm::vec3(1.0f - x, 1.0f - y, 1.0f - z));
+
+    // discrete edits jump, they aren't blended in over the next step
+    if (input.wasPressed(ACTION_REFLECT) || input.wasPressed(ACTION_PROJECT))
+        previousTransform.copy(selected, *transform);
+}
+
+// the key -> action map, see COMMANDS.txt
+// ----------------------------------------
+void bindKeys()
+{
+    input.resize(ACTION_COUNT);
+    input.bind(GLFW_KEY_ESCAPE, ACTION_QUIT);
+    input.bind(GLFW_KEY_W, ACTION_FORWARD);
+    input.bind(GLFW_KEY_S, ACTION_BACKWARD);
+    input.bind(GLFW_KEY_A, ACTION_LEFT);
+    input.bind(GLFW_KEY_D, ACTION_RIGHT);
+    input.bind(GLFW_KEY_1, ACTION_CREATE_1);
+    input.bind(GLFW_KEY_2, ACTION_CREATE_2);
+    input.bind(GLFW_KEY_3, ACTION_CREATE_3);
+    input.bind(GLFW_KEY_4, ACTION_CREATE_4);
+    input.bind(GLFW_KEY_DELETE, ACTION_DELETE);
+    input.bind(GLFW_KEY_RIGHT, ACTION_NEXT_MODEL);
+    input.bind(GLFW_KEY_LEFT, ACTION_PREVIOUS_MODEL);
+    input.bind(GLFW_KEY_X, ACTION_TOGGLE_X);
+    input.bind(GLFW_KEY_Y, ACTION_TOGGLE_Y);
+    input.bind(GLFW_KEY_Z, ACTION_TOGGLE_Z);
+    input.bind(GLFW_KEY_KP_6, ACTION_TRANSLATE_X_POS);
+    input.bind(GLFW_KEY_KP_4, ACTION_TRANSLATE_X_NEG);
+    input.bind(GLFW_KEY_KP_8, ACTION_TRANSLATE_Y_POS);
+    input.bind(GLFW_KEY_KP_2, ACTION_TRANSLATE_Y_NEG);
+    input.bind(GLFW_KEY_KP_7, ACTION_TRANSLATE_Z_POS);
+    input.bind(GLFW_KEY_KP_9, ACTION_TRANSLATE_Z_NEG);
+    input.bind(GLFW_KEY_LEFT_CONTROL, ACTION_FOCUS);
+    input.bind(GLFW_KEY_I, ACTION_ROTATE_X_CW);
+    input.bind(GLFW_KEY_K, ACTION_ROTATE_X_CCW);
+    input.bind(GLFW_KEY_J, ACTION_ROTATE_Y_CW);
+    input.bind(GLFW_KEY_L, ACTION_ROTATE_Y_CCW);
+    input.bind(GLFW_KEY_U, ACTION_ROTATE_Z_CW);
+    input.bind(GLFW_KEY_O, ACTION_ROTATE_Z_CCW);
+    input.bind(GLFW_KEY_KP_SUBTRACT, ACTION_SCALE_DOWN);
+    input.bind(GLFW_KEY_KP_ADD, ACTION_SCALE_UP);
+    input.bind(GLFW_KEY_LEFT_SHIFT, ACTION_REFLECT);
+    input.bind(GLFW_KEY_V, ACTION_SHEAR_X_NEG);
+    input.bind(GLFW_KEY_N, ACTION_SHEAR_X_POS);
+    input.bind(GLFW_KEY_G, ACTION_SHEAR_Y_NEG);
+    input.bind(GLFW_KEY_B, ACTION_SHEAR_Y_POS);
+    input.bind(GLFW_KEY_F, ACTION_SHEAR_Z_NEG);
+    input.bind(GLFW_KEY_H, ACTION_SHEAR_Z_POS);
+    input.bind(GLFW_KEY_P, ACTION_PROJECT);
+    input.bind(GLFW_KEY_F1, ACTION_ANIMATION1);
+    input.bind(GLFW_KEY_F2, ACTION_ANIMATION2);
+    input.bind(GLFW_KEY_F3, ACTION_STATS);
+    input.bind(GLFW_KEY_F4, ACTION_TRACE);
+    input.bind(GLFW_KEY_F6, ACTION_RENDERER);
+    input.bind(GLFW_KEY_F7, ACTION_RENDER_IMAGE);
+    input.bindMouseButton(GLFW_MOUSE_BUTTON_LEFT, ACTION_PICK);
+    input.bind(GLFW_KEY_BACKSPACE, ACTION_UNDO);
+    input.bind(GLFW_KEY_F5, ACTION_SAVE);
+    input.bind(GLFW_KEY_F9, ACTION_LOAD);
+    input.bind(GLFW_KEY_F8, ACTION_SAVE_SNAPSHOT);
+    input.bind(GLFW_KEY_F10, ACTION_LOAD_SNAPSHOT);
+    input.bind(GLFW_KEY_M, ACTION_ATTACH);
+    input.bind(GLFW_KEY_C, ACTION_DETACH);
+    input.bind(GLFW_KEY_T, ACTION_SOLID);
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -321,8 +1095,10 @@ void processInput(GLFWwindow *window, vector<Model> objs, vector<int> *models, v
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // height will be significantly larger than specified on retina displays. The render thread may own
+    // the context, so the viewport is set when the next frame is drawn.
+    viewportWidth = width;
+    viewportHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -352,13 +1128,13 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(yoffset);
 }
 
-void setDimension(GLFWwindow *window, int key) {
+void setDimension(int key) {
     float *dimension;
     if(key == GLFW_KEY_X)
         dimension = &dim.x;
-    if(key == GLFW_KEY_Y)
+    else if(key == GLFW_KEY_Y)
         dimension = &dim.y;
-    if(key == GLFW_KEY_Z)
+    else
         dimension = &dim.z;
 
     if(*dimension > 0)
@@ -367,40 +1143,106 @@ void setDimension(GLFWwindow *window, int key) {
         *dimension = 1.0;
 
     printState();
-    while(glfwGetKey(window, key) == GLFW_PRESS)
-        glfwPollEvents();
 }
 
-void createModel(const int obj, vector<int> *models, vector<glm::mat4> *transform) {
-    ++nModels;
-
+void createModel(const int obj, vector<int> *models, TransformStore *transform) {
     glm::mat4 mat;
     mat = glm::translate(mat, glm::vec3((float) position++, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
     mat = glm::scale(mat, glm::vec3(0.1f, 0.1f, 0.1f));	// it's a bit too big for our scene, so scale it down;
-    transform->push_back(mat);
+    addInstance(obj, mat, models, transform);
 
-    models->push_back(obj);
-    activeModel = nModels - 1;
+    previousModel = activeModel;
+    activeModel = entities.at(entities.size() - 1);
     printState();
 }
 
-void deleteModel(vector<int> *models, vector<glm::mat4> *transform) {
-    models->erase(models->begin() + activeModel);
-    transform->erase(transform->begin() + activeModel);
-    --nModels;
+// appends an instance; the previous simulation state gets the same transform so it doesn't interpolate in from nowhere
+void addInstance(const int obj, const glm::mat4 &mat, vector<int> *models, TransformStore *transform, int parent) {
+    entities.create();
+    sceneGraph.add(parent);
+    transform->add(mat);
+    while(previousTransform.size() + 1 < transform->size())
+        previousTransform.add(glm::vec3(0.0f));
+    previousTransform.add(glm::vec3(0.0f));
+    previousTransform.copy(transform->size() - 1, *transform);
+    models->push_back(obj);
+}
+
+void clearModels(vector<int> *models, TransformStore *transform) {
+    models->clear();
+    transform->clear();
+    previousTransform.clear();
+    sceneGraph.clear();
+    entities.clear();
+    animator.instances.clear();
+    activeModel = NO_ENTITY;
+    previousModel = NO_ENTITY;
+}
+
+void deleteModel(vector<int> *models, TransformStore *transform) {
+    int i = active();
+    removeModel(activeModel, models, transform);
 
-    if(activeModel == nModels)
-        activeModel -= 1;
+    if(entities.size() == 0)
+        activeModel = NO_ENTITY;
+    else
+        activeModel = entities.at(i < (int)entities.size() ? i : entities.size() - 1);
     printState();
 }
 
+// removes an instance; the last one moves into the freed index everywhere, and handles to it stay valid
+void removeModel(Entity entity, vector<int> *models, TransformStore *transform) {
+    int i = entities.indexOf(entity);
+    if(i < 0)
+        return;
+    // the children move up to the removed model's parent without moving in the world
+    vector<unsigned int> children = sceneGraph.children(i);
+    for(unsigned int c = 0; c < children.size(); ++c) {
+        transform->setMatrix(children[c], transform->matrix(i) * transform->matrix(children[c]));
+        previousTransform.copy(children[c], *transform);
+    }
+
+    entities.destroy(entity);
+    sceneGraph.swapRemove(i);
+    swapRemove(*models, i);
+    transform->swapRemove(i);
+    if(i < (int)previousTransform.size())
+        previousTransform.swapRemove(i);
+}
+
+// the dense index of the active model, -1 if there is none
+int active() {
+    return entities.indexOf(activeModel);
+}
+
+// the world matrix of an instance from the current (not interpolated) state
+glm::mat4 worldMatrix(TransformStore *transform, int i) {
+    glm::mat4 mat;
+    for(; i >= 0; i = sceneGraph.parentOf(i))
+        mat = transform->matrix(i) * mat;
+    return mat;
+}
+
+// reparents a model (-1 makes it a root); its local transform is recomputed so it stays where it is
+void attachModel(TransformStore *transform, int child, int parent) {
+    glm::mat4 world = worldMatrix(transform, child);
+    glm::mat4 parentWorld = parent >= 0 ? worldMatrix(transform, parent) : glm::mat4();
+    if(!sceneGraph.setParent(child, parent))
+        return;
+    transform->pushUndo(child);
+    transform->setMatrix(child, glm::inverse(parentWorld) * world);
+    previousTransform.copy(child, *transform);
+}
+
 void printState() {
+    if(benchMode)
+        return;
     printf("\n ##############################################################################\n");
     printf(  " #                                                                            #\n");
     printf(  " #                                                                            #\n");
     printf(  " #                                                                            #\n");
     printf(  " #                                                                            #\n");
-    printf( " #                              Active model: %d                               #\n", activeModel + 1);
+    printf( " #                              Active model: %d                               #\n", active() + 1);
     printf(  " #                                                                            #\n");
     printf(  " #                                                                            #\n");
     printf(  " #                                                                            #\n");
@@ -432,188 +1274,197 @@ void printState() {
     printf("\n ##############################################################################\n\n");
 }
 
-void animation1(GLFWwindow *window, vector<int> *models, vector<glm::mat4> *transform, Shader shader) {
-    int n = nModels;
-    for(int i = 0; i < n; ++i) {
-        deleteModel(models, transform);
+void printStats() {
+    RenderStats &stats = renderStats();
+    printf("\n Last frame: %u draw calls, %u texture binds (%u redundant skipped), %u uniform updates, %.3f ms CPU submit\n",
+           stats.drawCalls, stats.textureBinds, stats.redundantBinds, stats.uniformUpdates, stats.submitTime * 1000.0);
+    printf(" Streamed %.1f KB (%s), %u stalls waiting for the GPU\n", stats.streamedBytes / 1024.0,
+           streamBuffer.persistent() ? "persistent mapping" : "unsynchronized mapping", stats.streamStalls);
+    if(drewSoftware)
+        printf(" Software rasterizer: %u triangles set up, %u culled, %u tile bins\n", softwareRasterizer.stats.triangles,
+               softwareRasterizer.stats.culled, softwareRasterizer.stats.binned);
+    printf(" Mesh BVHs: %.1f KB, %.1f%% on top of the mesh data\n", bvhBytes / 1024.0, 100.0 * bvhBytes / std::max(meshBytes, (size_t)1));
+    printf(" Instances: %u drawn, %u outside the view, %u too small to see\n",
+           drawListStats.visible, drawListStats.outside, drawListStats.tooSmall);
+    printf(" Collisions: %u overlapping pairs of %u with touching boxes, %u grid cells of %.2f, %u instances too big for them; %.3f ms broadphase, %.3f ms hulls\n",
+           collisionStats.overlaps, collisionStats.candidates, collisionStats.cells, collisionStats.cellSize, collisionStats.oversized,
+           collisionStats.broadTime * 1000.0, collisionStats.narrowTime * 1000.0);
+    if(!collisionPairs.empty()) {
+        printf(" ");
+        for(unsigned int k = 0; k < collisionPairs.size(); ++k)
+            printf(" %u-%u", collisionPairs[k].a + 1, collisionPairs[k].b + 1);
+        printf(collisionStats.overlaps > collisionPairs.size() ? " ...\n" : "\n");
     }
-    vector<Model> elems;
-    vector<glm::mat4> mats;
-
-    Model planet("resources/objects/planet/planet.obj");
-    Model rock("resources/objects/rock/rock.obj");
-    Model dog("resources/objects/doggo/planet.obj");
+    for(unsigned int i = 0; i < gpuTimer.passes.size(); ++i)
+        printf(" GPU %-10s last %.3f ms, average %.3f ms, max %.3f ms\n", gpuTimer.passes[i].name.c_str(),
+               gpuTimer.passes[i].last * 1000.0, gpuTimer.passes[i].average() * 1000.0, gpuTimer.passes[i].maximum() * 1000.0);
+    printf(" Input to present latency: average %.3f ms, max %.3f ms (%s)\n", latency.average() * 1000.0,
+           latency.maximum() * 1000.0, pipelined ? "pipelined" : "one thread");
+    printArenas();
+#ifdef CG_ALLOC_TRACKING
+    printf(" Allocations: %llu (%.1f KB) in the last frame, %llu frees\n", allocFrame.count, allocFrame.bytes / 1024.0, allocFrame.frees);
+#endif
+    printf("\n");
+}
 
-    elems.push_back(planet);
-    elems.push_back(rock);
+// the high-water mark of every thread's frame arena, to size them with --frame-arena
+// -------------------------------------------------------------------------------------
+void printArenas() {
+    vector<FrameArena*> arenas = FrameArena::all();
+    for(unsigned int i = 0; i < arenas.size(); ++i)
+        printf(" Frame arena %-8s %.1f KB high water of %.1f KB, grew %u times\n", arenas[i]->name.c_str(),
+               arenas[i]->highWaterMark() / 1024.0, arenas[i]->capacity() / 1024.0, arenas[i]->growCount());
+}
 
-    glm::mat4 mat;
+// starts a clip on new instances of its nodes, added to the scene as it is
+// ---------------------------------------------------------------------------
+void playClip(const AnimationClip *clip, vector<int> *models, TransformStore *transform) {
+    for(unsigned int i = 0; i < clip->nodes.size(); ++i)
+        if(clip->nodes[i].obj < -1 || clip->nodes[i].obj >= (int)objBounds.size()) {
+            std::cout << "ERROR::CLIP:: Node " << clip->nodes[i].name << " of " << clip->path << " shows object "
+                      << clip->nodes[i].obj << ", which doesn't exist" << std::endl;
+            return;
+        }
+    if(clip->nodes.empty())
+        return;
+    vector<Entity> nodes;
+    for(unsigned int i = 0; i < clip->nodes.size(); ++i) {
+        const ClipNode &node = clip->nodes[i];
+        const TransformComponents &pose = node.pose;
+        int parent = node.parent >= 0 ? entities.indexOf(nodes[node.parent]) : -1;
+        addInstance(node.obj, TransformStore::compose(pose.position, pose.rotation, pose.scale, pose.shear), models, transform, parent);
+        nodes.push_back(entities.at(entities.size() - 1));
+    }
+    animator.play(clip, nodes);
+}
 
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-
-    mats[0] = glm::scale(mats[0], glm::vec3(0.1f, 0.1f, 0.1f));
-    mats[1] = glm::translate(mats[0], glm::vec3(-7.5f, 0.0f, 0.0f));
-    mats[1] = glm::scale(mats[1], glm::vec3(0.5f, 0.5f, 0.5f));
-    mats[1] = glm::rotate(mats[1], glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    mats[1] = glm::rotate(mats[1], glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    mats[2] = glm::translate(mats[0], glm::vec3(0.0f, 7.5f, 0.0f));
-    mats[2] = glm::scale(mats[2], glm::vec3(0.5f, 0.5f, 0.5f));
-    mats[2] = glm::rotate(mats[2], glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    mats[3] = glm::translate(mats[0], glm::vec3(0.0f, -7.5f, 0.0f));
-    mats[3] = glm::scale(mats[3], glm::vec3(0.5f, 0.5f, 0.5f));
-    mats[3] = glm::rotate(mats[3], glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    mats[0] = glm::translate(mats[0], glm::vec3(-0.5f, 0.0f, 0.0f));
-    mats[0] = glm::rotate(mats[0], glm::radians(45.0f), glm::vec3(0.0f, 0.0f, -1.0f));
-    mats[4] = glm::translate(mats[0], glm::vec3(0.0f, 0.0f, 7.5f));
-    mats[4] = glm::scale(mats[4], glm::vec3(0.5f, 0.5f, 0.5f));
-    mats[4] = glm::rotate(mats[4], glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    mats[4] = glm::rotate(mats[4], glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    mats[5] = glm::translate(mats[0], glm::vec3(0.0f, 0.0f, -7.5f));
-    mats[5] = glm::scale(mats[5], glm::vec3(0.5f, 0.5f, 0.5f));
-    mats[5] = glm::rotate(mats[5], glm::radians(90.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
-
-    mat = mats[0];
-    float timer = 0.0;
-    glm::mat4 view = camera.GetViewMatrix();
-    int change = 0;
-    
-    while(timer < 10.0) {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        timer += deltaTime;
-
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        view;
-
-        mats[0] = glm::rotate(mats[0], glm::radians(deltaTime*180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        for(int i = 1; i < 6; ++i) {
-            if(timer < 4.5) {
-                mats[i] = bigRotation(mats[i], glm::radians(deltaTime*180.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(-deltaTime*90, 0.0f, 0.0f));
+// advances every playing clip by one simulation step, handles the events they pass and removes the
+// instances of the clips that ended
+// ---------------------------------------------------------------------------------------------------
+void stepClips(vector<int> *models, TransformStore *transform, float delta) {
+    vector<FiredClipEvent> events;
+    vector<unsigned int> ended;
+    animator.update(delta, entities, *transform, &events, &ended);
+
+    for(unsigned int e = 0; e < events.size(); ++e) {
+        const ClipInstance &instance = animator.instances[events[e].instance];
+        const ClipEvent &event = *events[e].event;
+        // model <node> <obj>: the node shows another object from now on
+        if(event.name == "model" && event.args.size() == 2) {
+            int node = instance.clip->findNode(event.args[0]);
+            int i = node >= 0 ? entities.indexOf(instance.nodes[node]) : -1;
+            int obj = atoi(event.args[1].c_str());
+            if(obj < -1 || obj >= (int)objBounds.size())
+                std::cout << "ERROR::CLIP:: Event model in " << instance.clip->path << " shows object " << obj
+                          << ", which doesn't exist" << std::endl;
+            else if(i >= 0) {
+                (*models)[i] = obj;
+                // a different object now, don't blend from the old one
+                previousTransform.copy(i, *transform);
             }
-            if(timer > 3.5) {
-                mats[i] = glm::translate(mats[i], glm::vec3(deltaTime*300.0, deltaTime*300.0, deltaTime*300.0));
-            }
-        }
-        if(timer > 3.25 && timer < 4.0) {
-            mats[0] = glm::scale(mats[0], glm::vec3(1.0f - deltaTime*6, 1.0f - deltaTime*6, 1.0f - deltaTime*6));
         }
-        if(timer > 4.5 && change == 0) {
-            change = 1;
-            elems[0] = dog;
-            // mats[0] = glm::mat4();
-            mats[0] = glm::scale(mat, glm::vec3(0.01, 0.01, 0.01));
-            mats[0] = glm::rotate(mats[0], glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-            mats[0] = glm::rotate(mats[0], glm::radians(15.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+        // burst <node> <count> <speed> <lifetime>: debris flies out of the node
+        else if(event.name == "burst" && event.args.size() == 4) {
+            int node = instance.clip->findNode(event.args[0]);
+            int i = node >= 0 ? entities.indexOf(instance.nodes[node]) : -1;
+            if(i >= 0)
+                particles.burst(glm::vec3(worldMatrix(transform, i)[3]), atoi(event.args[1].c_str()),
+                                (float)atof(event.args[2].c_str()), (float)atof(event.args[3].c_str()), &jobs);
         }
-        if(timer > 5.5 && timer < 6.0) {
-            mats[0] = glm::scale(mats[0], glm::vec3(1.0f + deltaTime*11, 1.0f + deltaTime*11, 1.0f + deltaTime*11));
-        }
-        // don't forget to enable shader before setting uniforms
-        shader.use();
-
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-
-        for(int i = 0; i < 6; ++i) {
-
-            // render the loaded model
-            shader.setMat4("model", mats[i]);
-            if(i == 0)
-                elems[0].Draw(shader);
-            else
-                elems[1].Draw(shader);
-        }
-        glfwSwapBuffers(window);
+        else
+            std::cout << "ERROR::CLIP:: Unknown event " << event.name << " in " << instance.clip->path << std::endl;
     }
-}
 
-void animation2(GLFWwindow *window, vector<int> *models, vector<glm::mat4> *transform, Shader shader) {
-    int n = nModels;
-    for(int i = 0; i < n; ++i) {
-        deleteModel(models, transform);
+    // children first, so nothing gets re-based onto a node that goes away next
+    for(unsigned int e = 0; e < ended.size(); ++e) {
+        const vector<Entity> &nodes = animator.instances[ended[e]].nodes;
+        for(int i = nodes.size() - 1; i >= 0; --i)
+            removeModel(nodes[i], models, transform);
     }
-    vector<Model> elems;
-    vector<glm::mat4> mats;
-
-    Model planet("resources/objects/planet/planet.obj");
-    elems.push_back(planet);
-
-    glm::mat4 mat;
+}
 
-    glm::vec3 cp1 = glm::vec3(-1.5, 0.0, 0.0);
-    glm::vec3 cp2 = glm::vec3(-1.0, 0.5, -0.5);
-    glm::vec3 cp3 = glm::vec3(1.0, -0.5, -0.5);
-    glm::vec3 cp4 = glm::vec3(1.5, -0.5, 0.0);
-
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-    mats.push_back(mat);
-
-    mats[1] = glm::translate(mats[1], cp1);
-    mats[1] = glm::scale(mats[1], glm::vec3(0.01, 0.01, 0.01));
-    mats[2] = glm::translate(mats[2], cp2);
-    mats[2] = glm::scale(mats[2], glm::vec3(0.01, 0.01, 0.01));
-    mats[3] = glm::translate(mats[3], cp3);
-    mats[3] = glm::scale(mats[3], glm::vec3(0.01, 0.01, 0.01));
-    mats[4] = glm::translate(mats[4], cp4);
-    mats[4] = glm::scale(mats[4], glm::vec3(0.01, 0.01, 0.01));
-
-    float timer = 0.0;
-    float t;
-    glm::vec3 cp;
-    mats[0] = glm::translate(mats[0], glm::vec3(-20.0, 0.0, 0.0));
-    while(timer < 5.0) {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        timer += deltaTime;
-
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        cp = glm::cubic<glm::vec3>(cp4, cp3, cp2, cp1, timer/5);
-
-        glm::vec3 old = glm::vec3(mats[0][3][0], mats[0][3][1], mats[0][3][2]);
-        glm::vec3 trans = cp - old;
-        mats[0] = glm::translate(mats[0], trans);
-        mat = glm::scale(mats[0], glm::vec3(0.04f, 0.04f, 0.04f));
-        for(int i = 1; i < 5; ++i) {
-            // don't forget to enable shader before setting uniforms
-            shader.use();
-
-            shader.setMat4("projection", projection);
-            shader.setMat4("view", view);
-            // render the loaded model
-            shader.setMat4("model", mats[i]);
-            elems[0].Draw(shader);
+// runs the benchmark script: fires its scripted operations, moves the camera along its path and renders
+// until the requested number of frames has been presented. Frames are sampled in present().
+// ----------------------------------------------------------------------------------------------------
+void runBenchmark(GLFWwindow *window, Shader shader, const vector<Model> &objs, vector<int> *models, TransformStore *transform)
+{
+    vector<BenchEvent> events = benchScript.events;
+    std::stable_sort(events.begin(), events.end(), [](const BenchEvent &a, const BenchEvent &b) { return a.frame < b.frame; });
+    vector<bool> fired(events.size(), false);
+
+    lastPresent = wallTime();
+    lastFrame = getTime();
+    benchReport.samples.reserve(benchScript.frames);
+    while(frameCount < benchScript.frames)
+    {
+        // one shot events fire once their frame is reached; continuous events are held down like a key
+        // from their first frame until their duration runs out
+        int frame = frameCount;
+        for(unsigned int i = 0; i < events.size(); ++i) {
+            if(events[i].frame > frame)
+                continue;
+            if(events[i].duration == 0) {
+                if(!fired[i]) {
+                    fired[i] = true;
+                    applyBenchEvent(models, transform, events[i], true);
+                }
+            }
+            else if(frame == events[i].frame)
+                applyBenchEvent(models, transform, events[i], true);
+            else if(frame == events[i].frame + events[i].duration)
+                applyBenchEvent(models, transform, events[i], false);
         }
-        // don't forget to enable shader before setting uniforms
-        shader.use();
 
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        // render the loaded model
-        shader.setMat4("model", mat);
-        elems[0].Draw(shader);
-        glfwSwapBuffers(window);
+        glm::vec3 camPosition;
+        float yaw, pitch;
+        if(benchScript.cameraAt(frameCount, camPosition, yaw, pitch))
+            camera.SetPose(camPosition, yaw, pitch);
+
+        runFrame(window, shader, objs, models, transform);
     }
 }
 
-void translate(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const char axis, const int sign) {
-    float currentFrame, x = 0.0, y = 0.0, z = 0.0;
+// applies a scripted operation; continuous ones are turned into input commands for the simulation,
+// `start` tells whether their key goes down or up
+// ----------------------------------------------------------------------------------------------------
+void applyBenchEvent(vector<int> *models, TransformStore *transform, const BenchEvent &event, bool start)
+{
+    const string &op = event.op;
+    char axis = event.args.size() > 0 ? event.args[0][0] : 'x';
+    int sign = event.args.size() > 1 ? atoi(event.args[1].c_str()) : 1;
+    int a = axis == 'y' ? 1 : axis == 'z' ? 2 : 0;
+
+    int action = -1;
+    if(op == "create" && !event.args.empty())
+        createModel(atoi(event.args[0].c_str()), models, transform);
+    else if(op == "delete" && active() >= 0)
+        deleteModel(models, transform);
+    else if(op == "select" && !event.args.empty() && entities.size() > 0)
+        activeModel = entities.at(atoi(event.args[0].c_str()) % entities.size());
+    else if(op == "animation1")
+        playClip(&clips[0], models, transform);
+    else if(op == "animation2")
+        playClip(&clips[1], models, transform);
+    else if(op == "translate")
+        action = ACTION_TRANSLATE_X_POS + 2 * a + (sign < 0);
+    else if(op == "rotate")
+        // see simulate(): around z the clockwise action rotates by a positive angle
+        action = ACTION_ROTATE_X_CW + 2 * a + (a == 2 ? sign < 0 : sign > 0);
+    else if(op == "scale")
+        action = (event.args.empty() || atoi(event.args[0].c_str()) > 0) ? ACTION_SCALE_UP : ACTION_SCALE_DOWN;
+    else if(op == "shear")
+        action = ACTION_SHEAR_X_NEG + 2 * a + (sign > 0);
+    else if(op != "delete" && op != "select")
+        std::cout << "ERROR::BENCH:: Unknown operation " << op << std::endl;
+
+    if(action >= 0)
+        input.push(action, start ? INPUT_PRESSED : INPUT_RELEASED);
+}
+
+// continuous transformations: advance the active model by one simulation step of `delta` seconds
+// --------------------------------------------------------------------------------------------------
+void translateStep(vector<int> *models, TransformStore *transform, const char axis, const int sign, float delta) {
+    float x = 0.0, y = 0.0, z = 0.0;
     if(axis == 'x')
         x = 1.0 * sign;
     if(axis == 'y')
@@ -621,17 +1472,14 @@ void translate(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int
     if(axis == 'z')
         z = 1.0 * sign;
 
-    while(glfwGetKey(window, key) == GLFW_PRESS) {
-        currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        (*transform)[activeModel] = glm::translate((*transform)[activeModel], glm::vec3(deltaTime*2.0*x, deltaTime*2.0*y, deltaTime*2.0*z));
-        render(window, shader, objs, models, *transform);
-    }
+    glm::vec3 offset(delta*2.0*x, delta*2.0*y, delta*2.0*z);
+    if(solid && moveBlocked(models, transform, offset))
+        return;
+    transform->translate(active(), offset);
 }
 
-void rotate(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const char axis, const int sign) {
-    float currentFrame, x = 0.0, y = 0.0, z = 0.0;
+void rotateStep(TransformStore *transform, const char axis, const int sign, float delta) {
+    float x = 0.0, y = 0.0, z = 0.0;
     if(axis == 'x')
         x = 1.0 * sign;
     if(axis == 'y')
@@ -639,56 +1487,290 @@ void rotate(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> m
     if(axis == 'z')
         z = 1.0 * sign;
 
-    while(glfwGetKey(window, key) == GLFW_PRESS) {
-        currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        if(focus)
-            (*transform)[activeModel] = bigRotation((*transform)[activeModel], glm::radians(deltaTime*120.0f), glm::vec3(x, y, z), glm::vec3((-deltaTime*15*y) + (-deltaTime*15*z), -deltaTime*15*x, 0.0f));
-        else
-            (*transform)[activeModel] = glm::rotate((*transform)[activeModel], glm::radians(deltaTime*120.0f), glm::vec3(x, y, z));
-        render(window, shader, objs, models, *transform);
+    if(focus)
+        transform->orbit(active(), glm::radians(delta*120.0f), glm::vec3(x, y, z), glm::vec3((-delta*15*y) + (-delta*15*z), -delta*15*x, 0.0f));
+    else
+        transform->rotate(active(), glm::radians(delta*120.0f), glm::vec3(x, y, z));
+}
+
+void scaleStep(TransformStore *transform, const int sign, float delta) {
+    float param = delta*sign, x = dim.x, y = dim.y, z = dim.z;
+
+    transform->scaleBy(active(), glm::vec3(1.0f + (param*x), 1.0f + (param*y), 1.0f + (param*z)));
+}
+
+void shearStep(TransformStore *transform, const int axis, const int sign, float delta) {
+    float param = delta*sign;
+
+    transform->shearAlong(active(), axis, param, param);
+}
+
+// whether moving the active model by `offset`, in its own axes like TransformStore::translate, pushes it into
+// a model it doesn't overlap yet. The others are where the last frame drew them; models attached to it, or it
+// to them, move along and don't count.
+// ---------------------------------------------------------------------------------------------------------------
+bool moveBlocked(vector<int> *models, TransformStore *transform, const glm::vec3 &offset) {
+    int i = active(), obj = (*models)[i];
+    const vector<glm::mat4> &world = sceneGraph.world();
+    glm::mat4 from = worldMatrix(transform, i), to = from;
+    to[3] += glm::vec4(glm::mat3(from) * offset, 0.0f);
+    vector<unsigned int> near;
+    collisions.query(obj, to, near);
+    for(unsigned int k = 0; k < near.size(); ++k) {
+        int j = near[k];
+        // instances may have come or gone since the last frame
+        if(j == i || j >= (int)models->size() || j >= (int)world.size() || related(i, j))
+            continue;
+        if(collisions.overlaps(obj, to, (*models)[j], world[j]) && !collisions.overlaps(obj, from, (*models)[j], world[j]))
+            return true;
     }
+    return false;
 }
 
-void scale(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const int sign) {
-    float currentFrame, param, x = dim.x, y = dim.y, z = dim.z;
+// whether one model is an ancestor of the other
+bool related(int a, int b) {
+    for(int p = sceneGraph.parentOf(a); p >= 0; p = sceneGraph.parentOf(p))
+        if(p == b)
+            return true;
+    for(int p = sceneGraph.parentOf(b); p >= 0; p = sceneGraph.parentOf(p))
+        if(p == a)
+            return true;
+    return false;
+}
 
-    while(glfwGetKey(window, key) == GLFW_PRESS) {
-        currentFrame = glfwGetTime();
-        deltaTime = (currentFrame - lastFrame);
-        lastFrame = currentFrame;
+// tells when the models the active one overlaps change; every pair is in the statistics (F3)
+// --------------------------------------------------------------------------------------------
+void reportCollisions() {
+    int i = active();
+    // without an active model there is nothing to report
+    if(i < 0) {
+        activeContacts.clear();
+        return;
+    }
+    FrameVector<unsigned int> contacts;
+    for(unsigned int k = 0; k < collisions.pairs.size(); ++k) {
+        const CollisionPair &pair = collisions.pairs[k];
+        if((int)pair.a == i)
+            contacts.push_back(pair.b);
+        else if((int)pair.b == i)
+            contacts.push_back(pair.a);
+    }
+    std::sort(contacts.begin(), contacts.end());
+    if(contacts.size() == activeContacts.size() && std::equal(contacts.begin(), contacts.end(), activeContacts.begin()))
+        return;
+    activeContacts.assign(contacts.begin(), contacts.end());
+    if(contacts.empty()) {
+        printf(" Model %d overlaps nothing\n", i + 1);
+        return;
+    }
+    printf(" Model %d overlaps model", i + 1);
+    for(unsigned int k = 0; k < contacts.size(); ++k)
+        printf(" %u", contacts[k] + 1);
+    printf("\n");
+}
 
-        param = deltaTime*sign;
+// scene file: the object of every model followed by the stored transforms, see TransformStore::write
+// ----------------------------------------------------------------------------------------------------
+bool saveScene(const char *path, vector<int> *models, TransformStore *transform) {
+    std::ofstream file(path);
+    if(!file) {
+        std::cout << "ERROR::SCENE:: Could not write " << path << std::endl;
+        return false;
+    }
+    file << models->size() << "\n";
+    for(unsigned int i = 0; i < models->size(); ++i)
+        file << (*models)[i] << (i + 1 < models->size() ? " " : "\n");
+    for(unsigned int i = 0; i < models->size(); ++i)
+        file << sceneGraph.parentOf(i) << (i + 1 < models->size() ? " " : "\n");
+    transform->write(file);
+    std::cout << "Scene saved to " << path << std::endl;
+    return true;
+}
 
-        (*transform)[activeModel] = glm::scale((*transform)[activeModel], glm::vec3(1.0f + (param*x), 1.0f + (param*y), 1.0f + (param*z)));
-        render(window, shader, objs, models, *transform);
+bool loadScene(const char *path, vector<int> *models, TransformStore *transform) {
+    vector<int> objs, parents;
+    TransformStore loaded;
+    if(!readScene(path, objBounds.size(), objs, parents, loaded))
+        return false;
+    SceneGraph graph;
+    if(!graph.assign(parents)) {
+        std::cout << "ERROR::SCENE:: " << path << ": the parents of the instances make a cycle" << std::endl;
+        return false;
     }
+    unsigned int n = objs.size();
+    clearModels(models, transform);
+    *models = objs;
+    *transform = loaded;
+    previousTransform.copy(loaded);
+    std::swap(sceneGraph, graph);
+    for(unsigned int i = 0; i < n; ++i)
+        entities.create();
+    activeModel = n > 0 ? entities.at(0) : NO_ENTITY;
+    printState();
+    return true;
+}
+
+// writes the scene and the camera to a binary snapshot; instances refer to their model by its file
+// ------------------------------------------------------------------------------------------------
+bool saveSnapshot(const char *path, const vector<Model> &objs, vector<int> *models, TransformStore *transform) {
+    double start = wallTime();
+    snapshot.assets.resize(objs.size());
+    for(unsigned int i = 0; i < objs.size(); ++i)
+        snapshot.assets[i] = objs[i].path;
+    snapshot.objs = *models;
+    snapshot.parents.resize(models->size());
+    for(unsigned int i = 0; i < models->size(); ++i)
+        snapshot.parents[i] = sceneGraph.parentOf(i);
+    snapshot.position = transform->position;
+    snapshot.rotation = transform->rotation;
+    snapshot.scale = transform->scale;
+    snapshot.shear = transform->shear;
+    SnapshotCamera pose = { camera.Position, camera.Yaw, camera.Pitch, camera.Zoom };
+    snapshot.camera = pose;
+    if(!snapshot.save(path))
+        return false;
+    if(snapshot.appended)
+        printf(" Snapshot %s: %u changes appended (%u bytes) in %.2f ms\n", path, snapshot.writtenRecords,
+               (unsigned int)snapshot.writtenBytes, (wallTime() - start) * 1000.0);
+    else
+        printf(" Snapshot saved to %s: %u instances (%u bytes) in %.2f ms\n", path, snapshot.size(),
+               (unsigned int)snapshot.writtenBytes, (wallTime() - start) * 1000.0);
+    return true;
 }
 
-void shear(GLFWwindow *window, Shader shader, vector<Model> objs, vector<int> models, vector<glm::mat4> *transform, const int key, const int axis, const int sign) {
-    float currentFrame, param;
+// replaces the scene and the camera with a snapshot's
+// -----------------------------------------------------
+bool loadSnapshot(const char *path, const vector<Model> &objs, vector<int> *models, TransformStore *transform) {
+    double start = wallTime();
+    if(!snapshot.load(path))
+        return false;
+    // the assets are model files; an instance gets whichever loaded object has its file
+    vector<int> objOf(snapshot.assets.size(), -1);
+    for(unsigned int a = 0; a < snapshot.assets.size(); ++a)
+        for(unsigned int k = 0; k < objs.size() && objOf[a] < 0; ++k)
+            if(objs[k].path == snapshot.assets[a])
+                objOf[a] = k;
+    unsigned int n = snapshot.size();
+    for(unsigned int i = 0; i < n; ++i)
+        if(objOf[snapshot.objs[i]] < 0) {
+            std::cout << "ERROR::SNAPSHOT:: " << path << " uses " << snapshot.assets[snapshot.objs[i]] << ", which isn't loaded" << std::endl;
+            return false;
+        }
+    SceneGraph graph;
+    if(!graph.assign(snapshot.parents)) {
+        std::cout << "ERROR::SNAPSHOT:: " << path << ": the parents of the instances make a cycle" << std::endl;
+        return false;
+    }
 
-    while(glfwGetKey(window, key) == GLFW_PRESS) {
-        currentFrame = glfwGetTime();
-        deltaTime = (currentFrame - lastFrame);
-        lastFrame = currentFrame;
+    clearModels(models, transform);
+    models->resize(n);
+    for(unsigned int i = 0; i < n; ++i)
+        (*models)[i] = objOf[snapshot.objs[i]];
+    transform->assign(snapshot.position, snapshot.rotation, snapshot.scale, snapshot.shear);
+    previousTransform.copy(*transform);
+    std::swap(sceneGraph, graph);
+    for(unsigned int i = 0; i < n; ++i)
+        entities.create();
+    camera.SetPose(snapshot.camera.position, snapshot.camera.yaw, snapshot.camera.pitch);
+    camera.Zoom = snapshot.camera.zoom;
+    activeModel = n > 0 ? entities.at(0) : NO_ENTITY;
+    printf(" Snapshot %s restored: %u instances in %.2f ms\n", path, n, (wallTime() - start) * 1000.0);
+    printState();
+    return true;
+}
 
-        param = deltaTime*sign;
-        if(axis == 'x')
-            (*transform)[activeModel] = glm::shearX3D((*transform)[activeModel], param, param);
-        if(axis == 'y')
-            (*transform)[activeModel] = glm::shearY3D((*transform)[activeModel], param, param);
-        if(axis == 'z')
-            (*transform)[activeModel] = glm::shearZ3D((*transform)[activeModel], param, param);
-        render(window, shader, objs, models, *transform);
+// reads a scene file written by saveScene(): the object and the parent of every instance, and the transforms;
+// every instance has to show one of the `objectCount` loaded objects
+// -----------------------------------------------------------------------------------------------------------
+bool readScene(const char *path, unsigned int objectCount, vector<int> &objs, vector<int> &parents, TransformStore &transform) {
+    std::ifstream file(path);
+    unsigned int n = 0;
+    objs.clear();
+    parents.clear();
+    if(file >> n) {
+        objs.resize(n);
+        parents.resize(n);
+        for(unsigned int i = 0; i < n && file; ++i)
+            file >> objs[i];
+        for(unsigned int i = 0; i < n && file; ++i)
+            file >> parents[i];
     }
+    for(unsigned int i = 0; i < parents.size(); ++i)
+        if(parents[i] < -1 || parents[i] >= (int)n)
+            file.setstate(std::ios::failbit);
+    if(!file || !transform.read(file) || transform.size() != n) {
+        std::cout << "ERROR::SCENE:: Could not read " << path << std::endl;
+        return false;
+    }
+    for(unsigned int i = 0; i < n; ++i)
+        if(objs[i] < 0 || objs[i] >= (int)objectCount) {
+            std::cout << "ERROR::SCENE:: " << path << " uses object " << objs[i] << ", which doesn't exist" << std::endl;
+            return false;
+        }
+    return true;
 }
 
-glm::mat4 bigRotation(glm::mat4 mat, float deg, glm::vec3 rot, glm::vec3 transl) {
-    mat = glm::rotate(mat, deg, glm::vec3(rot.x, rot.y, rot.z));
-    mat = glm::translate(mat, glm::vec3(transl.x, transl.y, transl.z));
-    mat = glm::rotate(mat, deg, glm::vec3(rot.x, rot.y, rot.z));
+#ifdef CG_FARM
+// a render farm worker: renders the frames the farm hands it into PNG files, keeping the objects, and the
+// scene while consecutive tasks share it, loaded from one task to the next
+// ---------------------------------------------------------------------------------------------------------
+int runFarmWorker(const string &jobList)
+{
+    RenderFarm farm;
+    if(!farm.load(jobList))
+        return -1;
+    headless = true;
+    if(!headlessContext.create(scrWidth, scrHeight))
+        return -1;
+    initRendering();
+    Shader shader("resources/cg_ufpel.vs", "resources/cg_ufpel.fs");
+    vector<Model> objs;
+    loadObjects(objs);
+
+    string scene;
+    bool sceneLoaded = false;
+    vector<int> models, parents;
+    TransformStore transform;
+    vector<glm::mat4> world;
+    vector<unsigned char> pixels;
+    FarmTask task;
+    while(RenderFarm::nextTask(task)) {
+        const FarmJob &job = farm.jobs[task.job];
+        if(job.scene != scene) {
+            scene = job.scene;
+            sceneLoaded = readScene(scene.c_str(), objs.size(), models, parents, transform);
+            // the scene doesn't move, its world matrices are worked out once
+            SceneGraph graph;
+            if(sceneLoaded && !graph.assign(parents)) {
+                std::cout << "ERROR::SCENE:: " << scene << ": the parents of the instances make a cycle" << std::endl;
+                sceneLoaded = false;
+            }
+            if(sceneLoaded)
+                world = graph.update(transform.matrices());
+        }
 
-    return mat;
-}
\ No newline at end of file
+        headlessContext.resize(job.width, job.height);
+        scrWidth = viewportWidth = job.width;
+        scrHeight = viewportHeight = job.height;
+        pixels.resize(job.width * job.height * 3);
+        camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f));
+        for(int frame = task.first; frame <= task.last; ++frame) {
+            if(!sceneLoaded) {
+                RenderFarm::report(task, frame, false);
+                continue;
+            }
+            glm::vec3 camPosition;
+            float yaw, pitch;
+            if(cameraPathAt(job.cameraPath, frame, camPosition, yaw, pitch))
+                camera.SetPose(camPosition, yaw, pitch);
+            buildSnapshot(models, world, syncFrame, wallTime());
+            render(NULL, shader, objs, syncFrame);
+            headlessContext.readPixels(&pixels[0]);
+            RenderFarm::report(task, frame, RenderFarm::writePNG(job.framePath(frame), job.width, job.height, &pixels[0], true));
+            FrameArena::local().reset();
+        }
+    }
+    headlessContext.destroy();
+    return 0;
+}
+#endif
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec4 aParticle;	// position, age over lifetime
+
+out float Age;
+
+uniform mat4 viewProjection;
+uniform float pointSize;
+
+void main()
+{
+    Age = aParticle.w;
+    gl_Position = viewProjection * vec4(aParticle.xyz, 1.0);
+    // farther particles get smaller
+    gl_PointSize = max(pointSize / gl_Position.w, 1.0);
+}
@@ -0,0 +1,101 @@
+// Animation clip microbenchmark: plays a clip on thousands of instances at once, with staggered start times,
+// and measures how long the animator takes to evaluate all of them per simulation step, plus composing the
+// matrices the evaluation dirtied. Run from the repository root so the clip file is found.
+//
+//   ./clip_bench [instances] [clip]     (default 5000 resources/animations/explosion.clip)
+
+#include <learnopengl/animation_clip.h>
+#include <learnopengl/entity_store.h>
+#include <learnopengl/transform_store.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int n = argc > 1 ? atoi(argv[1]) : 5000;
+    const char *path = argc > 2 ? argv[2] : "resources/animations/explosion.clip";
+    AnimationClip clip;
+    if(!clip.load(path))
+        return 1;
+    // looping keeps every instance playing for the whole run
+    clip.loop = true;
+    // a marker at the very start, which must fire when an instance starts and on every loop
+    ClipEvent start;
+    start.time = 0.0f;
+    start.name = "start";
+    clip.events.push_back(start);
+
+    EntityStore entities;
+    TransformStore transforms;
+    Animator animator;
+    for(unsigned int i = 0; i < n; i++)
+    {
+        vector<Entity> nodes;
+        for(unsigned int k = 0; k < clip.nodes.size(); k++)
+        {
+            nodes.push_back(entities.create());
+            const TransformComponents &pose = clip.nodes[k].pose;
+            transforms.add(pose.position, pose.rotation, pose.scale);
+        }
+        unsigned int instance = animator.play(&clip, nodes);
+        animator.instances[instance].time = clip.duration * i / n;
+    }
+    unsigned int tracks = n * clip.tracks.size();
+    printf("%u instances of %s: %u nodes, %u tracks\n", n, path, (unsigned int)transforms.size(), tracks);
+
+    const unsigned int steps = 600;
+    const float delta = 1.0f / 60.0f;
+    vector<FiredClipEvent> events;
+    double evaluate = 0.0, compose = 0.0;
+    unsigned int fired = 0;
+    for(unsigned int s = 0; s < steps; s++)
+    {
+        events.clear();
+        double start = now();
+        animator.update(delta, entities, transforms, &events);
+        double mid = now();
+        transforms.update();
+        compose += now() - mid;
+        evaluate += mid - start;
+        fired += events.size();
+    }
+
+    printf("%-28s %10.3f ms/step %10.1f ns/track\n", "evaluate", evaluate * 1000.0 / steps, evaluate * 1e9 / steps / tracks);
+    printf("%-28s %10.3f ms/step %10.1f ns/node\n", "compose matrices", compose * 1000.0 / steps, compose * 1e9 / steps / transforms.size());
+
+    // the evaluation must never produce a NaN
+    unsigned int errors = 0;
+    for(unsigned int i = 0; i < transforms.size(); i++)
+        if(glm::any(glm::isnan(transforms.position[i])) || glm::any(glm::isnan(transforms.scale[i])) || glm::isnan(transforms.rotation[i].w))
+            errors++;
+
+    // a new instance fires the start marker on its first update, and only then
+    Animator fresh;
+    vector<Entity> nodes;
+    for(unsigned int k = 0; k < clip.nodes.size(); k++)
+        nodes.push_back(entities.at(k));
+    fresh.play(&clip, nodes);
+    unsigned int starts[2] = { 0, 0 };
+    for(unsigned int s = 0; s < 2; s++)
+    {
+        events.clear();
+        fresh.update(delta, entities, transforms, &events);
+        for(unsigned int e = 0; e < events.size(); e++)
+            starts[s] += events[e].event->name == "start";
+    }
+    if(starts[0] != 1 || starts[1] != 0)
+        errors++;
+
+    printf("%u events, %u errors\n", fired, errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+// Collision microbenchmark: moves up to 100k instances of a few convex shapes around a box every frame and
+// measures what finding their overlapping pairs costs, at 1%, 10% and 100% of the instance count, so the
+// scaling shows. The smallest run is checked against testing every pair of boxes, and a sample of the
+// hull tests against separating face planes and vertex containment.
+//
+//   ./collision_bench [instances] [frames]     (default 100000 100)
+
+#include <learnopengl/collision_world.h>
+#include <learnopengl/job_system.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+static float random01()
+{
+    return rand() / (float)RAND_MAX;
+}
+
+// a hull of `n` random points on a sphere, squashed along y by `flatten`
+static ConvexHull blob(unsigned int n, float flatten)
+{
+    vector<glm::vec3> points(n);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        glm::vec3 p(random01() * 2.0f - 1.0f, random01() * 2.0f - 1.0f, random01() * 2.0f - 1.0f);
+        points[i] = glm::normalize(p + glm::vec3(1e-3f)) * glm::vec3(1.0f, flatten, 1.0f);
+    }
+    ConvexHull hull;
+    hull.build(&points[0], n);
+    return hull;
+}
+
+// a hull moved to world space: its vertices and the planes of its faces (normal and offset)
+struct Placed {
+    vector<glm::vec3> vertices;
+    vector<glm::vec4> planes;
+};
+
+static Placed place(const ConvexHull &hull, const glm::mat4 &matrix)
+{
+    Placed placed;
+    for(unsigned int i = 0; i < hull.vertices.size(); i++)
+        placed.vertices.push_back(glm::vec3(matrix * glm::vec4(hull.vertices[i], 1.0f)));
+    for(unsigned int f = 0; f < hull.faces.size(); f += 3)
+    {
+        const glm::vec3 &p0 = placed.vertices[hull.faces[f]], &p1 = placed.vertices[hull.faces[f + 1]], &p2 = placed.vertices[hull.faces[f + 2]];
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if(length > 1e-12f)
+            placed.planes.push_back(glm::vec4(normal / length, glm::dot(normal, p0) / length));
+    }
+    return placed;
+}
+
+// whether all of `b` lies more than `margin` in front of one face plane of `a`
+static bool separatedBy(const Placed &a, const Placed &b, float margin)
+{
+    for(unsigned int f = 0; f < a.planes.size(); f++)
+    {
+        glm::vec3 normal(a.planes[f]);
+        bool front = true;
+        for(unsigned int i = 0; i < b.vertices.size() && front; i++)
+            front = glm::dot(normal, b.vertices[i]) - a.planes[f].w > margin;
+        if(front)
+            return true;
+    }
+    return false;
+}
+
+// whether a vertex of `b` lies more than `margin` behind every face plane of `a`
+static bool containsVertex(const Placed &a, const Placed &b, float margin)
+{
+    for(unsigned int i = 0; i < b.vertices.size(); i++)
+    {
+        bool inside = !a.planes.empty();
+        for(unsigned int f = 0; f < a.planes.size() && inside; f++)
+            inside = glm::dot(glm::vec3(a.planes[f]), b.vertices[i]) - a.planes[f].w < -margin;
+        if(inside)
+            return true;
+    }
+    return false;
+}
+
+// two hulls tested without GJK: 1 if they overlap, 0 if a face plane separates them, -1 if neither shows
+// (only an edge against edge contact, or closer than `margin`)
+static int faceTest(const Placed &a, const Placed &b, float margin)
+{
+    if(separatedBy(a, b, margin) || separatedBy(b, a, margin))
+        return 0;
+    if(containsVertex(a, b, margin) || containsVertex(b, a, margin))
+        return 1;
+    return -1;
+}
+
+struct Mover {
+    glm::vec3 position, velocity;
+    float angle, spin;
+};
+
+// one run: `n` instances in a box sized for about the same density at any count
+static bool run(unsigned int n, unsigned int frames, JobSystem &jobs, bool check)
+{
+    CollisionWorld world;
+    vector<ConvexHull> cube(1), shapes(2);
+    glm::vec3 corners[8];
+    for(int i = 0; i < 8; i++)
+        corners[i] = glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f);
+    cube[0].build(corners, 8);
+    shapes[0] = blob(500, 1.0f);
+    shapes[1] = blob(200, 0.4f);
+    world.addObject(cube);
+    world.addObject(shapes);
+
+    float side = cbrt((float)n) * 2.5f;
+    vector<Mover> movers(n);
+    vector<int> models(n);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        Mover &m = movers[i];
+        m.position = glm::vec3(random01(), random01(), random01()) * side;
+        m.velocity = glm::vec3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f) * 2.0f;
+        m.angle = random01() * 6.28f;
+        m.spin = random01() - 0.5f;
+        models[i] = i % 2;
+    }
+
+    vector<glm::mat4> matrices(n);
+    double broad = 0.0, narrow = 0.0;
+    unsigned long long candidates = 0, overlaps = 0, cells = 0;
+    const float delta = 1.0f / 60.0f;
+    for(unsigned int f = 0; f < frames; f++)
+    {
+        JobSystem::Job move = [&](unsigned int begin, unsigned int end, unsigned int) {
+            for(unsigned int i = begin; i < end; i++)
+            {
+                Mover &m = movers[i];
+                m.position += m.velocity * delta;
+                for(int axis = 0; axis < 3; axis++)
+                    if((m.position[axis] < 0.0f && m.velocity[axis] < 0.0f) || (m.position[axis] > side && m.velocity[axis] > 0.0f))
+                        m.velocity[axis] = -m.velocity[axis];
+                m.angle += m.spin * delta;
+                matrices[i] = glm::rotate(glm::translate(glm::mat4(), m.position), m.angle, glm::vec3(0.0f, 1.0f, 0.0f));
+            }
+        };
+        jobs.parallelFor(n, 4096, move);
+        world.update(models, matrices, &jobs);
+        broad += world.stats.broadTime;
+        narrow += world.stats.narrowTime;
+        candidates += world.stats.candidates;
+        overlaps += world.stats.overlaps;
+        cells += world.stats.cells;
+    }
+
+    double total = broad + narrow;
+    printf("%7u instances: %8.3f ms/frame (broadphase %.3f, narrow phase %.3f), %6.1f ns/instance, %.0f cells, %.0f box pairs, %.0f overlapping\n",
+           n, total * 1000.0 / frames, broad * 1000.0 / frames, narrow * 1000.0 / frames, total * 1e9 / frames / n,
+           (double)cells / frames, (double)candidates / frames, (double)overlaps / frames);
+    if(!check)
+        return true;
+
+    // every pair the sweep reported, and no other, must have overlapping boxes; and the hull test must agree,
+    // for a sample of the pairs also with the test on face planes
+    unsigned int expected = 0, errors = 0;
+    glm::vec3 objLower[2] = { cube[0].lower, glm::min(shapes[0].lower, shapes[1].lower) };
+    glm::vec3 objUpper[2] = { cube[0].upper, glm::max(shapes[0].upper, shapes[1].upper) };
+    vector<glm::vec3> lower(n), upper(n);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        glm::vec3 lo = objLower[models[i]], hi = objUpper[models[i]], extent;
+        glm::vec3 c = glm::vec3(matrices[i] * glm::vec4((lo + hi) * 0.5f, 1.0f)), half = (hi - lo) * 0.5f;
+        for(int r = 0; r < 3; r++)
+            extent[r] = fabs(matrices[i][0][r]) * half.x + fabs(matrices[i][1][r]) * half.y + fabs(matrices[i][2][r]) * half.z;
+        lower[i] = c - extent;
+        upper[i] = c + extent;
+    }
+    const vector<ConvexHull> *objects[2] = { &cube, &shapes };
+    const unsigned int SAMPLE = 16;
+    unsigned int sampled = 0, undecided = 0;
+    unsigned int next = 0;
+    for(unsigned int a = 0; a < n; a++)
+        for(unsigned int b = a + 1; b < n; b++)
+        {
+            if(glm::any(glm::lessThan(upper[a], lower[b])) || glm::any(glm::lessThan(upper[b], lower[a])))
+                continue;
+            expected++;
+            bool hit = world.overlaps(models[a], matrices[a], models[b], matrices[b]);
+            bool reported = next < world.pairs.size() && world.pairs[next].a == a && world.pairs[next].b == b;
+            if(reported)
+                next++;
+            if(hit != reported)
+                errors++;
+            if((expected - 1) % SAMPLE != 0)
+                continue;
+            // the objects overlap if any of their hulls do and are apart if every pair of hulls is
+            const vector<ConvexHull> &hullsA = *objects[models[a]], &hullsB = *objects[models[b]];
+            int answer = 0;
+            for(unsigned int i = 0; i < hullsA.size() && answer != 1; i++)
+                for(unsigned int j = 0; j < hullsB.size() && answer != 1; j++)
+                {
+                    int test = faceTest(place(hullsA[i], matrices[a]), place(hullsB[j], matrices[b]), 1e-4f);
+                    answer = test == 0 ? answer : test;
+                }
+            sampled++;
+            if(answer < 0)
+                undecided++;
+            else if(hit != (answer == 1))
+                errors++;
+        }
+    errors += world.pairs.size() - next;
+    printf("checked against all %u pairs: %u box overlaps, %u of them against face planes (%u undecided), %u errors\n",
+           n * (n - 1) / 2, expected, sampled, undecided, errors);
+    return errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int n = argc > 1 ? atoi(argv[1]) : 100000;
+    unsigned int frames = argc > 2 ? atoi(argv[2]) : 100;
+    JobSystem jobs;
+    printf("%u threads, %u frames per run\n", jobs.threads(), frames);
+    srand(1);
+    bool ok = run(max(n / 100, 2u), frames, jobs, true);
+    run(max(n / 10, 2u), frames, jobs, false);
+    run(n, frames, jobs, false);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+// Culling microbenchmark: builds the draw commands of a large scene (frustum and size culling, sort keys,
+// per-thread command lists, merge) the way render() does, with 1, 2, 4, ... worker threads, while the
+// camera turns around. Every thread count must produce exactly the same commands.
+//
+//   ./cull_bench [instances] [threads]     (default 200000, all hardware threads)
+
+#include <learnopengl/draw_list.h>
+#include <learnopengl/job_system.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float random01()
+{
+    return rand() / (float)RAND_MAX;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int n = argc > 1 ? atoi(argv[1]) : 200000;
+    unsigned int maxThreads = argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency();
+    if(maxThreads == 0)
+        maxThreads = 1;
+    srand(1);
+
+    // instances of four objects scattered around the camera, some groups among them
+    vector<DrawBounds> bounds;
+    for(int i = 0; i < 4; i++)
+    {
+        DrawBounds b = { glm::vec3(0.0f, 0.5f * i, 0.0f), 1.0f + i };
+        bounds.push_back(b);
+    }
+    vector<int> models(n);
+    vector<glm::mat4> world(n);
+    for(unsigned int i = 0; i < n; i++)
+    {
+        models[i] = i % 50 == 0 ? -1 : rand() % 4;
+        glm::vec3 p(random01() * 200.0f - 100.0f, random01() * 40.0f - 20.0f, random01() * 200.0f - 100.0f);
+        world[i] = glm::scale(glm::translate(glm::mat4(), p), glm::vec3(0.01f + 0.2f * random01()));
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    printf("%u instances\n", n);
+    printf("%8s %12s %10s %10s %10s\n", "threads", "build ms", "drawn", "outside", "too small");
+
+    const unsigned int frames = 60;
+    vector< vector<unsigned long long> > reference(frames);
+    unsigned int errors = 0;
+    for(unsigned int threads = 1; ; threads *= 2)
+    {
+        if(threads > maxThreads)
+            threads = maxThreads;
+        JobSystem jobs(threads);
+        DrawListBuilder builder;
+        vector<DrawCommand> commands;
+        DrawListStats stats = { 0, 0, 0 };
+        double total = 0.0;
+        for(unsigned int f = 0; f < frames; f++)
+        {
+            float angle = 6.2831853f * f / frames;
+            glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(cos(angle), 0.0f, sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+            double start = now();
+            builder.build(models, world, bounds, view, projection, 600.0f, &jobs, commands, &stats);
+            total += now() - start;
+
+            vector<unsigned long long> keys(commands.size());
+            for(unsigned int i = 0; i < commands.size(); i++)
+            {
+                keys[i] = commands[i].key;
+                if(i > 0 && keys[i] <= keys[i - 1])
+                    errors++;
+            }
+            if(threads == 1)
+                reference[f] = keys;
+            else if(keys != reference[f])
+                errors++;
+        }
+        printf("%8u %12.3f %10u %10u %10u\n", jobs.threads(), total * 1000.0 / frames, stats.visible, stats.outside, stats.tooSmall);
+        if(threads == maxThreads)
+            break;
+    }
+    printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}
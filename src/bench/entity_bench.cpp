@@ -0,0 +1,110 @@
+// Entity store microbenchmark: create, iterate, destroy and re-create entities with a model id and a
+// transform each, the same component layout as the application, and compare deleting from the middle
+// with swap-remove against vector::erase.
+//
+//   ./entity_bench [entities]     (default 100000)
+
+#include <learnopengl/entity_store.h>
+#include <learnopengl/transform_store.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char *name, double seconds, unsigned int ops)
+{
+    printf("%-28s %10.3f ms %10.1f ns/op\n", name, seconds * 1000.0, seconds * 1e9 / ops);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int n = argc > 1 ? atoi(argv[1]) : 100000;
+    printf("%u entities\n", n);
+
+    EntityStore entities;
+    vector<int> models;
+    TransformStore transforms;
+    vector<Entity> handles;
+    handles.reserve(n);
+    srand(1);
+
+    double start = now();
+    for(unsigned int i = 0; i < n; i++)
+    {
+        handles.push_back(entities.create());
+        models.push_back(i % 4);
+        transforms.add(glm::vec3((float)i, 0.0f, 0.0f));
+    }
+    report("create", now() - start, n);
+
+    start = now();
+    float sum = 0.0f;
+    for(unsigned int i = 0; i < transforms.size(); i++)
+        sum += transforms.position[i].x;
+    report("iterate positions", now() - start, n);
+
+    start = now();
+    transforms.update();
+    report("compose matrices", now() - start, n);
+
+    // destroy a random half through their handles
+    vector<Entity> order(handles);
+    random_shuffle(order.begin(), order.end());
+    unsigned int half = n / 2;
+    start = now();
+    for(unsigned int i = 0; i < half; i++)
+    {
+        int dense = entities.destroy(order[i]);
+        swapRemove(models, dense);
+        transforms.swapRemove(dense);
+    }
+    report("destroy (swap-remove)", now() - start, half);
+
+    // every destroyed handle must be dead, every other one must still find its own transform
+    start = now();
+    unsigned int errors = 0;
+    for(unsigned int i = 0; i < n; i++)
+    {
+        int dense = entities.indexOf(order[i]);
+        if(i < half ? dense >= 0 : dense < 0 || transforms.position[dense].x != (float)order[i].index)
+            errors++;
+    }
+    report("lookup", now() - start, n);
+
+    start = now();
+    for(unsigned int i = 0; i < half; i++)
+    {
+        entities.create();
+        models.push_back(0);
+        transforms.add(glm::vec3(0.0f));
+    }
+    report("re-create (reuses slots)", now() - start, half);
+    for(unsigned int i = 0; i < half; i++)
+        if(entities.alive(order[i]))
+            errors++;
+
+    // what deleteModel used to do: erase from the middle of the arrays
+    unsigned int erases = min(n / 2, 1000u);
+    vector<int> erModels(n, 0);
+    vector<glm::mat4> erTransforms(n);
+    start = now();
+    for(unsigned int i = 0; i < erases; i++)
+    {
+        unsigned int at = rand() % erModels.size();
+        erModels.erase(erModels.begin() + at);
+        erTransforms.erase(erTransforms.begin() + at);
+    }
+    report("destroy (vector::erase)", now() - start, erases);
+
+    printf("checksum %g, %u errors\n", sum, errors);
+    return errors ? 1 : 0;
+}
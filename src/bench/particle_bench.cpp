@@ -0,0 +1,84 @@
+// Particle microbenchmark: bursts up to a million particles and measures integrating them (velocity, gravity,
+// drag, lifetime and compaction) and packing them into the vertex layout the renderer uploads, with 1, 2, 4,
+// ... worker threads. Reports particles per millisecond for each.
+//
+//   ./particle_bench [particles] [threads]     (default 1000000, all hardware threads)
+
+#include <learnopengl/particle_system.h>
+#include <learnopengl/job_system.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int maxCount = argc > 1 ? atoi(argv[1]) : 1000000;
+    unsigned int maxThreads = argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency();
+    if(maxThreads == 0)
+        maxThreads = 1;
+    printf("%-10s %8s %12s %14s %12s %14s\n", "particles", "threads", "update ms", "particles/ms", "pack ms", "particles/ms");
+
+    unsigned int errors = 0;
+    const unsigned int steps = 60;
+    const float delta = 1.0f / 60.0f;
+    for(unsigned int threads = 1; ; threads *= 2)
+    {
+        if(threads > maxThreads)
+            threads = maxThreads;
+        JobSystem jobs(threads);
+        for(unsigned int count = 10000; ; count *= 10)
+        {
+            if(count > maxCount)
+                count = maxCount;
+            ParticleSystem particles;
+            // lives long enough that none die during the run, so every step integrates them all
+            particles.burst(glm::vec3(0.0f), count, 2.0f, 1000.0f, &jobs);
+            vector<float> vertices(4 * count);
+
+            double update = 0.0, pack = 0.0;
+            for(unsigned int s = 0; s < steps; s++)
+            {
+                double start = now();
+                particles.update(delta, &jobs);
+                double mid = now();
+                particles.pack(&vertices[0], &jobs);
+                pack += now() - mid;
+                update += mid - start;
+            }
+            if(particles.size() != count)
+                errors++;
+            printf("%-10u %8u %12.3f %14.0f %12.3f %14.0f\n", count, jobs.threads(), update * 1000.0 / steps,
+                   count * steps / (update * 1000.0), pack * 1000.0 / steps, count * steps / (pack * 1000.0));
+            if(count == maxCount)
+                break;
+        }
+        if(threads == maxThreads)
+            break;
+    }
+
+    // lifetime: particles live between half and all of the burst's second, so after 0.75 s part of them must
+    // be left and after a second none
+    JobSystem jobs(maxThreads);
+    ParticleSystem particles;
+    particles.burst(glm::vec3(0.0f), 100000, 2.0f, 1.0f, &jobs);
+    for(unsigned int s = 0; s < 45; s++)
+        particles.update(delta, &jobs);
+    unsigned int halfway = particles.size();
+    for(unsigned int s = 0; s < 16; s++)
+        particles.update(delta, &jobs);
+    if(halfway == 0 || halfway == 100000 || particles.size() != 0)
+        errors++;
+    printf("lifetime: %u of 100000 alive after 0.75 s, %u after 1 s\n", halfway, particles.size());
+
+    printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+// Spline path microbenchmark: moves thousands of followers along Catmull-Rom, Bézier and B-spline paths at
+// constant speed, checks how constant the speed really is, and compares moving one point (incremental
+// rebuild) with rebuilding the whole path.
+//
+//   ./path_bench [followers] [points]     (default 10000 64)
+
+#include <learnopengl/spline_path.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+static double now()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float random01()
+{
+    return rand() / (float)RAND_MAX;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int n = argc > 1 ? atoi(argv[1]) : 10000;
+    unsigned int nPoints = argc > 2 ? atoi(argv[2]) : 64;
+    printf("%u followers, %u points\n", n, nPoints);
+    srand(1);
+
+    // a wandering path with uneven spacing, so travelling by parameter would change speed a lot
+    vector<glm::vec3> points;
+    glm::vec3 p(0.0f);
+    for(unsigned int i = 0; i < nPoints; i++)
+    {
+        points.push_back(p);
+        p += glm::vec3(random01() - 0.5f, random01() - 0.5f, random01() - 0.5f) * (0.1f + 4.0f * random01());
+    }
+
+    const char *names[] = { "catmull-rom", "bezier", "bspline" };
+    SplineKind kinds[] = { SPLINE_CATMULL_ROM, SPLINE_BEZIER, SPLINE_BSPLINE };
+    unsigned int errors = 0;
+    for(int k = 0; k < 3; k++)
+    {
+        SplinePath path(kinds[k]);
+        double start = now();
+        path.setPoints(points);
+        path.update();
+        double build = now() - start;
+
+        const unsigned int edits = 1000;
+        start = now();
+        for(unsigned int e = 0; e < edits; e++)
+        {
+            unsigned int i = rand() % nPoints;
+            path.setPoint(i, points[i] + glm::vec3(0.0f, 0.01f, 0.0f));
+            path.update();
+            path.setPoint(i, points[i]);
+            path.update();
+        }
+        double edit = (now() - start) / (2 * edits);
+
+        // followers spread over the path, each with its own speed
+        float length = path.length();
+        vector<float> distance(n), speed(n);
+        vector<unsigned char> wrapped(n, 0);
+        for(unsigned int i = 0; i < n; i++)
+        {
+            distance[i] = length * i / n;
+            speed[i] = 0.5f + random01();
+        }
+        vector<glm::vec3> previous, current;
+        path.evaluate(distance, previous);
+
+        const unsigned int steps = 600;
+        const float delta = 1.0f / 60.0f;
+        double evaluate = 0.0;
+        double total = 0.0;
+        float worst = 0.0f;
+        for(unsigned int s = 0; s < steps; s++)
+        {
+            for(unsigned int i = 0; i < n; i++)
+            {
+                distance[i] += speed[i] * delta;
+                wrapped[i] = distance[i] > length;
+                if(wrapped[i])
+                    distance[i] -= length;
+            }
+            double t = now();
+            path.evaluate(distance, current);
+            evaluate += now() - t;
+
+            // the distance covered in a step should be speed * delta (chords are a bit shorter than arcs)
+            for(unsigned int i = 0; i < n; i++)
+            {
+                if(wrapped[i])
+                    continue;
+                float moved = glm::length(current[i] - previous[i]);
+                float error = fabs(moved - speed[i] * delta) / (speed[i] * delta);
+                if(error > worst)
+                    worst = error;
+                total += error;
+                if(!(moved == moved))
+                    errors++;
+            }
+            previous.swap(current);
+        }
+
+        printf("%-12s length %8.2f, full build %8.3f ms, one point moved %8.3f us, evaluate %8.3f ms/step "
+               "(%5.1f ns/follower), speed error %.3f%% average, %.2f%% worst\n", names[k], length, build * 1000.0,
+               edit * 1e6, evaluate * 1000.0 / steps, evaluate * 1e9 / steps / n, total * 100.0 / steps / n, worst * 100.0f);
+        // the worst cases are at sharp turns of the random path, where a step's chord is much shorter than
+        // the arc it cuts; on average the error must stay small
+        if(total / steps / n > 0.02)
+            errors++;
+    }
+    printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}